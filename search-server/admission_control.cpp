@@ -0,0 +1,224 @@
+#include "admission_control.h"
+
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <utility>
+
+using namespace std;
+
+namespace {
+
+// Weight of the newest query in the moving averages of the execution time
+const double AVERAGE_WEIGHT = 0.1;
+
+size_t ToIndex(RequestPriority priority) {
+    return static_cast<size_t>(priority);
+}
+
+} // namespace
+
+AdmissionController::AdmissionController(const SearchServer& search_server, AdmissionOptions options,
+    QueryRunner query_runner)
+    : search_server_(search_server)
+    , options_([&] {
+        options.min_concurrency_limit = max(options.min_concurrency_limit, 1.0);
+        options.max_concurrency_limit = max(options.max_concurrency_limit, options.min_concurrency_limit);
+        options.batch_share = clamp(options.batch_share, 0.0, 1.0);
+        options.degraded_result_count = max<size_t>(options.degraded_result_count, 1);
+        return options;
+    }())
+    , query_runner_(move(query_runner))
+    , concurrency_limit_(clamp(options_.initial_concurrency_limit, options_.min_concurrency_limit,
+        options_.max_concurrency_limit)) {
+}
+
+SearchResponse AdmissionController::FindTopDocuments(const SearchRequest& request) {
+    SearchResponse response;
+    const auto arrival = Clock::now();
+    const RequestPriority priority = request.priority;
+    auto& priority_stats = counters_.priorities[ToIndex(priority)];
+    Waiter waiter;
+
+    unique_lock lock(mutex_);
+    auto& queue = queues_[ToIndex(priority)];
+    if (queue.empty() && HasFreeSlotLocked(priority)) {
+        waiter.granted = true;
+        ++in_flight_[ToIndex(priority)];
+    }
+    else {
+        if (queue.size() >= options_.max_queue_length) {
+            ++priority_stats.rejected_queue_full;
+            response.outcome = AdmissionOutcome::REJECTED_QUEUE_FULL;
+            return response;
+        }
+        // Shedding on arrival spares the client a wait that cannot end in time
+        const auto predicted_start = arrival + chrono::nanoseconds(llround(PredictWaitNsLocked(priority)));
+        if (!FitsDeadline(predicted_start, average_degraded_execution_ns_, request.deadline)) {
+            ++priority_stats.rejected_deadline;
+            response.outcome = AdmissionOutcome::REJECTED_DEADLINE;
+            return response;
+        }
+        queue.push_back(&waiter);
+        window_has_queued_ = true;
+        const auto is_granted = [&waiter] {
+            return waiter.granted;
+        };
+        if (request.deadline == Clock::time_point::max()) {
+            waiter.granted_condition.wait(lock, is_granted);
+        }
+        else if (!waiter.granted_condition.wait_until(lock, request.deadline, is_granted)) {
+            queue.erase(find(queue.begin(), queue.end(), &waiter));
+            ++priority_stats.rejected_deadline;
+            response.outcome = AdmissionOutcome::REJECTED_DEADLINE;
+            response.queue_time = Clock::now() - arrival;
+            return response;
+        }
+    }
+
+    // The slot is ours; the full query runs only if it is still expected to finish in time
+    const auto start = Clock::now();
+    response.queue_time = start - arrival;
+    waiter.degraded = !FitsDeadline(start, average_execution_ns_, request.deadline);
+    // A query alone on the server still runs, degraded, so the averages learn when it gets faster
+    const bool is_alone = GetInFlightLocked() == 1;
+    if (waiter.degraded && !is_alone && !FitsDeadline(start, average_degraded_execution_ns_, request.deadline)) {
+        ReleaseSlotLocked(priority);
+        ++priority_stats.rejected_deadline;
+        response.outcome = AdmissionOutcome::REJECTED_DEADLINE;
+        return response;
+    }
+    lock.unlock();
+
+    const auto run_query = [&] {
+        if (waiter.degraded) {
+            // A short page keeps only a heap of the few best matches instead of sorting every match
+            response.documents = search_server_.FindTopDocumentsPage(request.raw_query, request.filter, {},
+                options_.degraded_result_count).documents;
+        }
+        else {
+            response.documents = search_server_.FindTopDocuments(request.raw_query, request.filter);
+        }
+    };
+    try {
+        if (query_runner_) {
+            query_runner_(run_query);
+        }
+        else {
+            run_query();
+        }
+    }
+    catch (...) {
+        lock.lock();
+        ReleaseSlotLocked(priority);
+        throw;
+    }
+    response.execution_time = Clock::now() - start;
+
+    lock.lock();
+    RecordExecutionLocked(waiter.degraded, response.execution_time);
+    ReleaseSlotLocked(priority);
+    if (waiter.degraded) {
+        ++priority_stats.degraded;
+        response.outcome = AdmissionOutcome::DEGRADED;
+    }
+    else {
+        ++priority_stats.served;
+    }
+    return response;
+}
+
+AdmissionStats AdmissionController::GetStats() const {
+    lock_guard guard(mutex_);
+    AdmissionStats stats = counters_;
+    stats.concurrency_limit = concurrency_limit_;
+    stats.average_execution_time = chrono::nanoseconds(llround(average_execution_ns_));
+    stats.average_degraded_execution_time = chrono::nanoseconds(llround(average_degraded_execution_ns_));
+    for (size_t i = 0; i < REQUEST_PRIORITY_COUNT; ++i) {
+        stats.priorities[i].queued = queues_[i].size();
+        stats.priorities[i].in_flight = in_flight_[i];
+    }
+    return stats;
+}
+
+size_t AdmissionController::GetInFlightLocked() const {
+    size_t in_flight = 0;
+    for (const size_t count : in_flight_) {
+        in_flight += count;
+    }
+    return in_flight;
+}
+
+size_t AdmissionController::GetSlotCountLocked(RequestPriority priority) const {
+    if (priority == RequestPriority::BATCH) {
+        return max<size_t>(static_cast<size_t>(concurrency_limit_ * options_.batch_share), 1);
+    }
+    return static_cast<size_t>(concurrency_limit_);
+}
+
+bool AdmissionController::HasFreeSlotLocked(RequestPriority priority) const {
+    return GetInFlightLocked() < GetSlotCountLocked(RequestPriority::INTERACTIVE)
+        && in_flight_[ToIndex(priority)] < GetSlotCountLocked(priority);
+}
+
+double AdmissionController::PredictWaitNsLocked(RequestPriority priority) const {
+    // Requests of this and higher priorities go first, and slots free up at the rate of
+    // slot count / execution time
+    size_t ahead = 0;
+    for (size_t i = 0; i <= ToIndex(priority); ++i) {
+        ahead += queues_[i].size();
+    }
+    return (ahead + 1) * average_execution_ns_ / GetSlotCountLocked(priority);
+}
+
+bool AdmissionController::FitsDeadline(Clock::time_point start, double execution_ns, Clock::time_point deadline) {
+    if (deadline == Clock::time_point::max()) {
+        return true;
+    }
+    return start <= deadline && execution_ns <= chrono::duration<double, nano>(deadline - start).count();
+}
+
+void AdmissionController::DispatchLocked() {
+    for (size_t i = 0; i < REQUEST_PRIORITY_COUNT; ++i) {
+        const auto priority = static_cast<RequestPriority>(i);
+        auto& queue = queues_[i];
+        while (!queue.empty() && HasFreeSlotLocked(priority)) {
+            Waiter* const waiter = queue.front();
+            queue.pop_front();
+            waiter->granted = true;
+            ++in_flight_[i];
+            // Notified under the lock, so the waiter cannot have left before
+            waiter->granted_condition.notify_one();
+        }
+    }
+}
+
+void AdmissionController::ReleaseSlotLocked(RequestPriority priority) {
+    --in_flight_[ToIndex(priority)];
+    DispatchLocked();
+}
+
+void AdmissionController::RecordExecutionLocked(bool degraded, chrono::nanoseconds execution_time) {
+    const double execution_ns = static_cast<double>(execution_time.count());
+    double& average = degraded ? average_degraded_execution_ns_ : average_execution_ns_;
+    average = average == 0 ? execution_ns : average + AVERAGE_WEIGHT * (execution_ns - average);
+
+    // The window mean, not single queries, decides: query costs are heavy-tailed even on an idle server
+    window_execution_ns_ += execution_ns;
+    if (++window_count_ < static_cast<size_t>(concurrency_limit_)) {
+        return;
+    }
+    const double target_ns = chrono::duration<double, nano>(options_.target_latency).count();
+    if (window_execution_ns_ / window_count_ > target_ns) {
+        concurrency_limit_ = max(concurrency_limit_ * options_.backoff_ratio, options_.min_concurrency_limit);
+    }
+    else if (window_has_queued_) {
+        // A limit nobody runs into says nothing about the server, so it only grows under demand
+        concurrency_limit_ = min(concurrency_limit_ + 1, options_.max_concurrency_limit);
+    }
+    window_count_ = 0;
+    window_execution_ns_ = 0;
+    window_has_queued_ = false;
+    // A raised limit may admit queued requests right away
+    DispatchLocked();
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include "document.h"
+#include "document_filter.h"
+#include "search_server.h"
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+// Interactive requests are dispatched first; batch requests get at most a share of the
+// concurrency limit, so a flood of them cannot take every slot
+enum class RequestPriority {
+    INTERACTIVE,
+    BATCH,
+};
+
+inline constexpr int REQUEST_PRIORITY_COUNT = 2;
+
+struct AdmissionOptions {
+    // Queries allowed to run at once; the limit moves between the bounds with the latency
+    double initial_concurrency_limit = 4;
+    double min_concurrency_limit = 1;
+    double max_concurrency_limit = 64;
+    // AIMD over windows of as many queries as the limit: a window whose mean execution time
+    // exceeds this multiplies the limit by backoff_ratio, a faster one raises it by one if
+    // some request had to queue
+    std::chrono::microseconds target_latency{ 5'000 };
+    double backoff_ratio = 0.9;
+    // Longer queues reject new requests of their priority at once
+    size_t max_queue_length = 256;
+    // Slots batch requests may hold, as a share of the limit; always at least one
+    double batch_share = 0.5;
+    // Result count of a degraded query, which runs when the full one would miss its deadline
+    size_t degraded_result_count = 1;
+};
+
+struct SearchRequest {
+    std::string_view raw_query;
+    DocumentFilter filter = DocumentFilter(DocumentStatus::ACTUAL);
+    RequestPriority priority = RequestPriority::INTERACTIVE;
+    // An answer after this point is useless to the client; max() means no deadline
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+};
+
+enum class AdmissionOutcome {
+    SERVED,
+    // Fewer results than usual, see AdmissionOptions::degraded_result_count
+    DEGRADED,
+    REJECTED_QUEUE_FULL,
+    // Shed on arrival when the predicted wait already misses the deadline, or when the
+    // deadline passes in the queue
+    REJECTED_DEADLINE,
+};
+
+struct SearchResponse {
+    AdmissionOutcome outcome = AdmissionOutcome::SERVED;
+    std::vector<Document> documents;
+    std::chrono::nanoseconds queue_time{ 0 };
+    std::chrono::nanoseconds execution_time{ 0 };
+};
+
+struct AdmissionStats {
+    struct PriorityStats {
+        size_t queued = 0;
+        size_t in_flight = 0;
+        uint64_t served = 0;
+        uint64_t degraded = 0;
+        uint64_t rejected_queue_full = 0;
+        uint64_t rejected_deadline = 0;
+    };
+
+    double concurrency_limit = 0;
+    // Moving averages used to predict queue waits, 0 before the first query
+    std::chrono::nanoseconds average_execution_time{ 0 };
+    std::chrono::nanoseconds average_degraded_execution_time{ 0 };
+    std::array<PriorityStats, REQUEST_PRIORITY_COUNT> priorities;
+};
+
+// Admission control in front of a SearchServer shared by many client threads: at most
+// the concurrency limit of queries run at once, the rest wait in per-priority FIFO queues.
+// The limit adapts to the observed execution time, so an overloaded server queues requests
+// here, where their deadlines are checked, instead of slowing every running query down.
+class AdmissionController {
+public:
+    // Called with the admitted query in place of running it, and must call it exactly once.
+    // A caller sharing the server with writers takes its read lock here, so the lock is held
+    // only while the query runs and never while it waits for a slot.
+    using QueryRunner = std::function<void(const std::function<void()>& run_query)>;
+
+    explicit AdmissionController(const SearchServer& search_server, AdmissionOptions options = {},
+        QueryRunner query_runner = {});
+
+    AdmissionController(const AdmissionController&) = delete;
+    AdmissionController& operator=(const AdmissionController&) = delete;
+
+    // Blocks until the query is answered or shed; safe to call from any number of threads.
+    // Query errors such as invalid_argument propagate as from SearchServer::FindTopDocuments.
+    // The execution time includes the query runner, since the slot is held for all of it.
+    SearchResponse FindTopDocuments(const SearchRequest& request);
+
+    AdmissionStats GetStats() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    // Lives on the stack of the waiting caller
+    struct Waiter {
+        std::condition_variable granted_condition;
+        bool granted = false;
+        bool degraded = false;
+    };
+
+    const SearchServer& search_server_;
+    const AdmissionOptions options_;
+    const QueryRunner query_runner_;
+
+    mutable std::mutex mutex_;
+    std::array<std::deque<Waiter*>, REQUEST_PRIORITY_COUNT> queues_;
+    std::array<size_t, REQUEST_PRIORITY_COUNT> in_flight_{};
+    double concurrency_limit_;
+    // Queries finished since the last change of the limit
+    size_t window_count_ = 0;
+    double window_execution_ns_ = 0;
+    bool window_has_queued_ = false;
+    double average_execution_ns_ = 0;
+    double average_degraded_execution_ns_ = 0;
+    AdmissionStats counters_;
+
+    size_t GetInFlightLocked() const;
+    size_t GetSlotCountLocked(RequestPriority priority) const;
+    bool HasFreeSlotLocked(RequestPriority priority) const;
+    // Expected wait for a slot by a request arriving now, from the queries ahead of it
+    double PredictWaitNsLocked(RequestPriority priority) const;
+    // Whether a query started at start would finish by the deadline, given an average
+    static bool FitsDeadline(Clock::time_point start, double execution_ns, Clock::time_point deadline);
+    // Hands free slots to queued requests, higher priorities first
+    void DispatchLocked();
+    void ReleaseSlotLocked(RequestPriority priority);
+    // Updates the averages and, at the end of a window, the concurrency limit
+    void RecordExecutionLocked(bool degraded, std::chrono::nanoseconds execution_time);
+};
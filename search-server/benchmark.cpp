@@ -0,0 +1,470 @@
+// Reproducible benchmark of indexing and search over seeded Zipf-distributed corpora.
+// Usage: search_benchmark [--seed N] [--sizes 1000,10000] [--queries N] [--repetitions N] [--calibrate N]
+// Results are printed to stdout as JSON so that two runs can be diffed.
+// --calibrate N fits a QueryCostModel on a corpus of N documents instead and prints its figures.
+
+#include "corpus_loader.h"
+#include "impact_index.h"
+#include "process_queries.h"
+#include "remove_duplicates.h"
+#include "search_server.h"
+#include "sharded_search_server.h"
+#include "synthetic_data.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <execution>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+struct BenchmarkConfig {
+    uint32_t seed = 42;
+    vector<int> corpus_sizes = { 1'000, 10'000 };
+    int query_count = 1'000;
+    int repetitions = 5;
+    int dictionary_size = 20'000;
+    int max_document_words = 60;
+    int max_query_words = 6;
+    double zipf_exponent = 1.0;
+    double minus_prob = 0.1;
+    int match_document_sample = 200;
+    // Corpus size for --calibrate, 0 runs the benchmarks
+    int calibration_size = 0;
+};
+
+struct BenchmarkResult {
+    string name;
+    int corpus_size = 0;
+    int64_t operations = 0;
+    double ns_per_op_min = 0;
+    double ns_per_op_median = 0;
+    uint64_t checksum = 0;
+};
+
+struct Corpus {
+    vector<string> stop_words;
+    vector<string> documents;
+    vector<vector<int>> ratings;
+    vector<string> queries;
+};
+
+vector<int> ParseSizes(const string& text) {
+    vector<int> sizes;
+    stringstream stream(text);
+    string item;
+    while (getline(stream, item, ',')) {
+        sizes.push_back(stoi(item));
+    }
+    return sizes;
+}
+
+BenchmarkConfig ParseArguments(int argc, char* argv[]) {
+    BenchmarkConfig config;
+    for (int i = 1; i < argc; ++i) {
+        const string_view arg = argv[i];
+        if (i + 1 >= argc) {
+            throw invalid_argument("Missing value for "s + string(arg));
+        }
+        const string value = argv[++i];
+        if (arg == "--seed"sv) {
+            config.seed = static_cast<uint32_t>(stoul(value));
+        } else if (arg == "--sizes"sv) {
+            config.corpus_sizes = ParseSizes(value);
+        } else if (arg == "--queries"sv) {
+            config.query_count = stoi(value);
+        } else if (arg == "--repetitions"sv) {
+            config.repetitions = max(1, stoi(value));
+        } else if (arg == "--calibrate"sv) {
+            config.calibration_size = stoi(value);
+        } else {
+            throw invalid_argument("Unknown argument "s + string(arg));
+        }
+    }
+    return config;
+}
+
+Corpus GenerateCorpus(const BenchmarkConfig& config, int corpus_size) {
+    // Every corpus size gets its own deterministic stream
+    mt19937 generator(config.seed + static_cast<uint32_t>(corpus_size));
+    const auto dictionary = GenerateDictionary(generator, config.dictionary_size, 10);
+    const ZipfDistribution distribution(dictionary.size(), config.zipf_exponent);
+
+    Corpus corpus;
+    // The most frequent words act as stop words, as in real text
+    corpus.stop_words.assign(dictionary.begin(), dictionary.begin() + 3);
+    corpus.documents = GenerateZipfCorpus(generator, dictionary, distribution, corpus_size, config.max_document_words);
+    for (int i = 0; i < corpus_size; ++i) {
+        corpus.ratings.push_back(GenerateRatings(generator, 5));
+    }
+    // Every tenth document is a copy of an earlier one to give RemoveDuplicates some work
+    for (int i = 10; i < corpus_size; i += 10) {
+        corpus.documents[i] = corpus.documents[generator() % i];
+    }
+    for (int i = 0; i < config.query_count; ++i) {
+        const int word_count = 1 + static_cast<int>(generator() % config.max_query_words);
+        corpus.queries.push_back(GenerateZipfText(generator, dictionary, distribution, word_count, config.minus_prob));
+    }
+    return corpus;
+}
+
+void FillServer(SearchServer& search_server, const Corpus& corpus) {
+    for (size_t i = 0; i < corpus.documents.size(); ++i) {
+        search_server.AddDocument(static_cast<int>(i), corpus.documents[i], DocumentStatus::ACTUAL, corpus.ratings[i]);
+    }
+}
+
+uint64_t ChecksumDocuments(const vector<Document>& documents) {
+    uint64_t checksum = 0;
+    for (const Document& document : documents) {
+        checksum = checksum * 31 + static_cast<uint64_t>(document.id);
+    }
+    return checksum;
+}
+
+// prepare() runs untimed before every repetition; run() returns the number of operations and updates the checksum
+BenchmarkResult Measure(const string& name, int corpus_size, int repetitions,
+    const function<void()>& prepare, const function<int64_t(uint64_t&)>& run) {
+    using Clock = chrono::steady_clock;
+    BenchmarkResult result;
+    result.name = name;
+    result.corpus_size = corpus_size;
+
+    vector<double> ns_per_op;
+    for (int repetition = 0; repetition < repetitions; ++repetition) {
+        prepare();
+        uint64_t checksum = 0;
+        const auto start = Clock::now();
+        const int64_t operations = run(checksum);
+        const auto duration = chrono::duration_cast<chrono::nanoseconds>(Clock::now() - start).count();
+        result.operations = operations;
+        result.checksum = checksum;
+        ns_per_op.push_back(static_cast<double>(duration) / max<int64_t>(operations, 1));
+    }
+    sort(ns_per_op.begin(), ns_per_op.end());
+    result.ns_per_op_min = ns_per_op.front();
+    result.ns_per_op_median = ns_per_op[ns_per_op.size() / 2];
+    return result;
+}
+
+template <typename ExecutionPolicy>
+BenchmarkResult MeasureFindTopDocuments(const string& name, const BenchmarkConfig& config, const Corpus& corpus,
+    const SearchServer& search_server, const ExecutionPolicy& policy) {
+    return Measure(name, static_cast<int>(corpus.documents.size()), config.repetitions, [] {}, [&](uint64_t& checksum) {
+        for (const string& query : corpus.queries) {
+            checksum += ChecksumDocuments(search_server.FindTopDocuments(policy, query));
+        }
+        return static_cast<int64_t>(corpus.queries.size());
+    });
+}
+
+template <typename ExecutionPolicy>
+BenchmarkResult MeasureMatchDocument(const string& name, const BenchmarkConfig& config, const Corpus& corpus,
+    const SearchServer& search_server, const ExecutionPolicy& policy) {
+    const int document_count = min<int>(config.match_document_sample, static_cast<int>(corpus.documents.size()));
+    const int query_count = min<int>(50, static_cast<int>(corpus.queries.size()));
+    return Measure(name, static_cast<int>(corpus.documents.size()), config.repetitions, [] {}, [&](uint64_t& checksum) {
+        for (int query = 0; query < query_count; ++query) {
+            for (int document_id = 0; document_id < document_count; ++document_id) {
+                const auto [words, status] = search_server.MatchDocument(policy, corpus.queries[query], document_id);
+                checksum += words.size();
+            }
+        }
+        return static_cast<int64_t>(query_count) * document_count;
+    });
+}
+
+vector<BenchmarkResult> RunCorpusBenchmarks(const BenchmarkConfig& config, int corpus_size) {
+    const Corpus corpus = GenerateCorpus(config, corpus_size);
+    vector<BenchmarkResult> results;
+
+    results.push_back(Measure("AddDocument"s, corpus_size, config.repetitions, [] {}, [&](uint64_t& checksum) {
+        SearchServer search_server(corpus.stop_words);
+        FillServer(search_server, corpus);
+        checksum = search_server.GetDocumentCount();
+        return static_cast<int64_t>(corpus.documents.size());
+    }));
+
+    // The same documents through the mmap pipeline, file written once outside the timing
+    const auto corpus_path = filesystem::temp_directory_path() / ("search_benchmark_corpus_"s + to_string(corpus_size) + ".tsv"s);
+    {
+        ofstream corpus_file(corpus_path);
+        for (size_t i = 0; i < corpus.documents.size(); ++i) {
+            WriteCorpusDocument(corpus_file, static_cast<int>(i), DocumentStatus::ACTUAL, corpus.ratings[i], corpus.documents[i]);
+        }
+    }
+    results.push_back(Measure("LoadCorpus"s, corpus_size, config.repetitions, [] {}, [&](uint64_t& checksum) {
+        SearchServer search_server(corpus.stop_words);
+        CorpusLoader(search_server).Load(corpus_path.string());
+        checksum = search_server.GetDocumentCount();
+        return static_cast<int64_t>(corpus.documents.size());
+    }));
+    filesystem::remove(corpus_path);
+
+    SearchServer search_server(corpus.stop_words);
+    FillServer(search_server, corpus);
+
+    results.push_back(MeasureFindTopDocuments("FindTopDocuments/seq"s, config, corpus, search_server, execution::seq));
+    results.push_back(MeasureFindTopDocuments("FindTopDocuments/par"s, config, corpus, search_server, execution::par));
+    // The same queries with every plus word required, answered by posting-list intersection
+    vector<string> and_queries;
+    for (const string& query : corpus.queries) {
+        string and_query;
+        for (const string_view word : SplitIntoWords(query)) {
+            and_query += (word[0] == '-' ? ""s : "+"s) + string(word) + " "s;
+        }
+        and_queries.push_back(move(and_query));
+    }
+    results.push_back(Measure("FindTopDocuments/and"s, corpus_size, config.repetitions, [] {}, [&](uint64_t& checksum) {
+        for (const string& query : and_queries) {
+            checksum += ChecksumDocuments(search_server.FindTopDocuments(query));
+        }
+        return static_cast<int64_t>(and_queries.size());
+    }));
+    results.push_back(MeasureMatchDocument("MatchDocument/seq"s, config, corpus, search_server, execution::seq));
+    results.push_back(MeasureMatchDocument("MatchDocument/par"s, config, corpus, search_server, execution::par));
+
+    // Cursors of the tenth page, so that the row measures the cost of one deep page
+    const DocumentFilter actual_filter(DocumentStatus::ACTUAL);
+    vector<SearchCursor> deep_cursors;
+    for (const string& query : corpus.queries) {
+        SearchCursor cursor;
+        for (int page = 0; page < 9 && !cursor.IsAtEnd(); ++page) {
+            cursor = search_server.FindTopDocumentsPage(query, actual_filter, cursor).next_cursor;
+        }
+        deep_cursors.push_back(cursor);
+    }
+    results.push_back(Measure("FindTopDocumentsPage/deep"s, corpus_size, config.repetitions, [] {}, [&](uint64_t& checksum) {
+        for (size_t i = 0; i < corpus.queries.size(); ++i) {
+            checksum += ChecksumDocuments(search_server.FindTopDocumentsPage(corpus.queries[i], actual_filter, deep_cursors[i]).documents);
+        }
+        return static_cast<int64_t>(corpus.queries.size());
+    }));
+
+    results.push_back(Measure("ProcessQueries"s, corpus_size, config.repetitions, [] {}, [&](uint64_t& checksum) {
+        for (const auto& documents : ProcessQueries(search_server, corpus.queries)) {
+            checksum += ChecksumDocuments(documents);
+        }
+        return static_cast<int64_t>(corpus.queries.size());
+    }));
+    results.push_back(Measure("ProcessQueries/shared"s, corpus_size, config.repetitions, [] {}, [&](uint64_t& checksum) {
+        for (const auto& documents : ProcessQueries(search_server, corpus.queries, QueryBatchMode::SHARED_TRAVERSAL)) {
+            checksum += ChecksumDocuments(documents);
+        }
+        return static_cast<int64_t>(corpus.queries.size());
+    }));
+
+    ShardedSearchServer sharded_server(corpus.stop_words);
+    for (size_t i = 0; i < corpus.documents.size(); ++i) {
+        sharded_server.AddDocument(static_cast<int>(i), corpus.documents[i], DocumentStatus::ACTUAL, corpus.ratings[i]);
+    }
+    results.push_back(Measure("ShardedFindTopDocuments/par"s, corpus_size, config.repetitions, [] {}, [&](uint64_t& checksum) {
+        for (const string& query : corpus.queries) {
+            checksum += ChecksumDocuments(sharded_server.FindTopDocuments(execution::par, query));
+        }
+        return static_cast<int64_t>(corpus.queries.size());
+    }));
+
+    const ImpactIndex impact_index(search_server);
+    results.push_back(Measure("ImpactFindTopDocuments"s, corpus_size, config.repetitions, [] {}, [&](uint64_t& checksum) {
+        for (const string& query : corpus.queries) {
+            checksum += ChecksumDocuments(impact_index.FindTopDocuments(query));
+        }
+        return static_cast<int64_t>(corpus.queries.size());
+    }));
+    results.push_back(Measure("ImpactFindTopDocuments/budget"s, corpus_size, config.repetitions, [] {}, [&](uint64_t& checksum) {
+        for (const string& query : corpus.queries) {
+            checksum += ChecksumDocuments(impact_index.FindTopDocuments(query, DocumentFilter(DocumentStatus::ACTUAL), 1'000));
+        }
+        return static_cast<int64_t>(corpus.queries.size());
+    }));
+
+    // Removal benchmarks mutate the index, so every repetition starts from a freshly built server
+    unique_ptr<SearchServer> mutable_server;
+    const auto rebuild = [&] {
+        mutable_server = make_unique<SearchServer>(corpus.stop_words);
+        FillServer(*mutable_server, corpus);
+    };
+
+    results.push_back(Measure("RemoveDocument"s, corpus_size, config.repetitions, rebuild, [&](uint64_t& checksum) {
+        int64_t operations = 0;
+        for (int document_id = 0; document_id < corpus_size; document_id += 2) {
+            mutable_server->RemoveDocument(document_id);
+            ++operations;
+        }
+        checksum = mutable_server->GetDocumentCount();
+        return operations;
+    }));
+
+    results.push_back(Measure("RemoveDocuments/par"s, corpus_size, config.repetitions, rebuild, [&](uint64_t& checksum) {
+        vector<int> document_ids;
+        for (int document_id = 0; document_id < corpus_size; document_id += 2) {
+            document_ids.push_back(document_id);
+        }
+        mutable_server->RemoveDocuments(execution::par, document_ids);
+        checksum = mutable_server->GetDocumentCount();
+        return static_cast<int64_t>(document_ids.size());
+    }));
+
+    results.push_back(Measure("RemoveDuplicates"s, corpus_size, config.repetitions, rebuild, [&](uint64_t& checksum) {
+        // RemoveDuplicates reports to cout, which would corrupt the JSON output
+        stringstream sink;
+        auto* const old_buffer = cout.rdbuf(sink.rdbuf());
+        RemoveDuplicates(*mutable_server);
+        cout.rdbuf(old_buffer);
+        checksum = mutable_server->GetDocumentCount();
+        return static_cast<int64_t>(corpus_size);
+    }));
+
+    return results;
+}
+
+// Least-squares line through the points, as slope and intercept
+pair<double, double> FitLine(const vector<double>& xs, const vector<double>& ys) {
+    const double n = static_cast<double>(xs.size());
+    double sum_x = 0, sum_y = 0, sum_xx = 0, sum_xy = 0;
+    for (size_t i = 0; i < xs.size(); ++i) {
+        sum_x += xs[i];
+        sum_y += ys[i];
+        sum_xx += xs[i] * xs[i];
+        sum_xy += xs[i] * ys[i];
+    }
+    const double denominator = n * sum_xx - sum_x * sum_x;
+    if (xs.empty() || denominator == 0) {
+        return { 0.0, xs.empty() ? 0.0 : sum_y / n };
+    }
+    const double slope = (n * sum_xy - sum_x * sum_y) / denominator;
+    return { slope, (sum_y - slope * sum_x) / n };
+}
+
+// Fastest of the repetitions of one query, in nanoseconds
+template <typename ExecutionPolicy>
+double TimeQuery(const SearchServer& search_server, const ExecutionPolicy& policy, const string& query, int repetitions) {
+    using Clock = chrono::steady_clock;
+    double best = numeric_limits<double>::max();
+    for (int repetition = 0; repetition < repetitions; ++repetition) {
+        const auto start = Clock::now();
+        search_server.FindTopDocuments(policy, query);
+        best = min(best, static_cast<double>(chrono::duration_cast<chrono::nanoseconds>(Clock::now() - start).count()));
+    }
+    return best;
+}
+
+// Times every query on each execution path, forced through the cost model, and fits the
+// model's lines: cost against postings for the sequential paths, against the postings of the
+// longest parallel loop for the parallel one
+QueryCostModel CalibrateQueryCostModel(const BenchmarkConfig& config) {
+    const Corpus corpus = GenerateCorpus(config, config.calibration_size);
+    SearchServer search_server(corpus.stop_words);
+    FillServer(search_server, corpus);
+    const double slot_count = search_server.GetDocumentCount();
+
+    // Sequential costs are out of reach, so ExplainQuery's parallel cost counts the postings
+    // of the longest loops
+    QueryCostModel probe;
+    probe.sequential_ns_per_posting = 1e12;
+    probe.parallel_overhead_ns = 0;
+    probe.parallel_ns_per_posting = 1;
+    QueryCostModel dense;
+    dense.sequential_ns_per_touched_slot = 1e12;
+    QueryCostModel sparse;
+    sparse.sequential_ns_per_touched_slot = 0;
+
+    vector<double> posting_counts, critical_posting_counts, dense_ns, sparse_ns, parallel_ns;
+    for (const string& query : corpus.queries) {
+        search_server.SetQueryCostModel(probe);
+        const QueryPlan plan = search_server.ExplainQuery(query);
+        if (plan.posting_count == 0 || !plan.required_words.empty()) {
+            continue;
+        }
+        posting_counts.push_back(static_cast<double>(plan.posting_count));
+        critical_posting_counts.push_back(plan.parallel_cost_ns);
+        parallel_ns.push_back(TimeQuery(search_server, execution::par, query, config.repetitions));
+        search_server.SetQueryCostModel(dense);
+        dense_ns.push_back(TimeQuery(search_server, execution::seq, query, config.repetitions));
+        search_server.SetQueryCostModel(sparse);
+        sparse_ns.push_back(TimeQuery(search_server, execution::seq, query, config.repetitions));
+    }
+
+    QueryCostModel model;
+    const auto [dense_slope, dense_intercept] = FitLine(posting_counts, dense_ns);
+    const auto [sparse_slope, sparse_intercept] = FitLine(posting_counts, sparse_ns);
+    const auto [parallel_slope, parallel_intercept] = FitLine(critical_posting_counts, parallel_ns);
+    model.sequential_ns_per_posting = max(0.0, dense_slope);
+    model.sequential_ns_per_slot = max(0.0, dense_intercept / slot_count);
+    model.sequential_ns_per_touched_slot = max(0.0, sparse_slope - model.sequential_ns_per_posting);
+    model.parallel_ns_per_posting = max(0.0, parallel_slope);
+    model.parallel_overhead_ns = max(0.0, parallel_intercept);
+    return model;
+}
+
+void PrintCostModelJson(ostream& os, const BenchmarkConfig& config, const QueryCostModel& model) {
+    os << "{\n"s;
+    os << "  \"benchmark\": \"query_cost_model\",\n"s;
+    os << "  \"seed\": "s << config.seed << ",\n"s;
+    os << "  \"corpus_size\": "s << config.calibration_size << ",\n"s;
+    os << "  \"sequential_ns_per_posting\": "s << model.sequential_ns_per_posting << ",\n"s;
+    os << "  \"sequential_ns_per_slot\": "s << model.sequential_ns_per_slot << ",\n"s;
+    os << "  \"sequential_ns_per_touched_slot\": "s << model.sequential_ns_per_touched_slot << ",\n"s;
+    os << "  \"parallel_ns_per_posting\": "s << model.parallel_ns_per_posting << ",\n"s;
+    os << "  \"parallel_overhead_ns\": "s << model.parallel_overhead_ns << "\n"s;
+    os << "}"s << endl;
+}
+
+void PrintJson(ostream& os, const BenchmarkConfig& config, const vector<BenchmarkResult>& results) {
+    os << "{\n"s;
+    os << "  \"benchmark\": \"search_server\",\n"s;
+    os << "  \"seed\": "s << config.seed << ",\n"s;
+    os << "  \"query_count\": "s << config.query_count << ",\n"s;
+    os << "  \"repetitions\": "s << config.repetitions << ",\n"s;
+    os << "  \"dictionary_size\": "s << config.dictionary_size << ",\n"s;
+    os << "  \"zipf_exponent\": "s << config.zipf_exponent << ",\n"s;
+    os << "  \"results\": [\n"s;
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchmarkResult& result = results[i];
+        os << "    { \"name\": \""s << result.name << "\""s
+            << ", \"corpus_size\": "s << result.corpus_size
+            << ", \"operations\": "s << result.operations
+            << ", \"ns_per_op_min\": "s << static_cast<int64_t>(result.ns_per_op_min)
+            << ", \"ns_per_op_median\": "s << static_cast<int64_t>(result.ns_per_op_median)
+            << ", \"checksum\": "s << result.checksum << " }"s
+            << (i + 1 < results.size() ? ","s : ""s) << '\n';
+    }
+    os << "  ]\n"s;
+    os << "}"s << endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    try {
+        const BenchmarkConfig config = ParseArguments(argc, argv);
+        if (config.calibration_size > 0) {
+            PrintCostModelJson(cout, config, CalibrateQueryCostModel(config));
+            return 0;
+        }
+        vector<BenchmarkResult> results;
+        for (const int corpus_size : config.corpus_sizes) {
+            for (auto& result : RunCorpusBenchmarks(config, corpus_size)) {
+                results.push_back(move(result));
+            }
+        }
+        PrintJson(cout, config, results);
+    } catch (const exception& e) {
+        cerr << "search_benchmark: "s << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
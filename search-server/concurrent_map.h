@@ -1,61 +1,219 @@
 #pragma once
 
 #include <algorithm>
-#include <cstdlib>
-#include <future>
+#include <cstddef>
+#include <cstdint>
+#include <execution>
 #include <map>
+#include <memory_resource>
+#include <mutex>
 #include <numeric>
-#include <random>
 #include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
-#include <mutex>
-#include <cmath>
 
 using namespace std::string_literals;
 
+// Hash map with integer keys for many concurrent writers. Keys are spread over independently
+// locked stripes; every stripe is an open-addressing table with linear probing and starts on
+// its own cache line, so threads working on different stripes do not share lines.
 template <typename Key, typename Value>
 class ConcurrentMap {
 public:
     static_assert(std::is_integral_v<Key>, "ConcurrentMap supports only integer keys"s);
 
+    // Keeps the stripe of the key locked while the reference is in use
     struct Access {
         std::lock_guard<std::mutex> guard;
         Value& ref_to_value;
     };
 
-    explicit ConcurrentMap(size_t bucket_count) : maps_(bucket_count), mutexes_(bucket_count) {
+    // bucket_count is the number of stripes, that is of independent locks
+    explicit ConcurrentMap(size_t bucket_count,
+        std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : stripes_(std::max<size_t>(bucket_count, 1), resource) {
     }
 
+    // Inserts a value-initialized entry for a missing key
     Access operator[](const Key& key) {
-        //uint64_t key_unsigned = static_cast<uint64_t>(key);
-        int map_index = (key >= 0 ? key : -key) % maps_.size();
+        const uint64_t hash = Hash(key);
+        Stripe& stripe = GetStripe(hash);
+        // Braced initializers are evaluated in order, so the lock is taken before the lookup
+        return { std::lock_guard(stripe.mutex), stripe.FindOrInsert(key, hash) };
+    }
 
-        return { std::lock_guard(mutexes_[map_index]), maps_[map_index][key] };
+    // Returns the number of erased entries, 0 or 1
+    size_t Erase(const Key& key) {
+        const uint64_t hash = Hash(key);
+        Stripe& stripe = GetStripe(hash);
+        std::lock_guard guard(stripe.mutex);
+        return stripe.Erase(key, hash);
     }
 
-    void Erase(const Key& key) {
-        int map_index = (key >= 0 ? key : -key) % maps_.size();
+    // Visits every entry stripe by stripe, so keys are not in global order
+    template <typename Function>
+    void ForEach(Function function) {
+        for (Stripe& stripe : stripes_) {
+            std::lock_guard guard(stripe.mutex);
+            for (const Slot& slot : stripe.slots) {
+                if (slot.occupied) {
+                    function(slot.key, slot.value);
+                }
+            }
+        }
+    }
+
+    // All entries sorted by key. Every stripe is locked for the duration, so the result is a
+    // consistent snapshot; stripes are copied and the result is sorted under the given policy.
+    template <typename ExecutionPolicy>
+    std::vector<std::pair<Key, Value>> BuildFlatVector(const ExecutionPolicy& policy) {
+        std::vector<std::unique_lock<std::mutex>> locks;
+        locks.reserve(stripes_.size());
+        // Single-stripe operations hold one lock, so taking them all in order cannot deadlock
+        for (Stripe& stripe : stripes_) {
+            locks.emplace_back(stripe.mutex);
+        }
+
+        std::vector<size_t> offsets(stripes_.size() + 1, 0);
+        for (size_t i = 0; i < stripes_.size(); ++i) {
+            offsets[i + 1] = offsets[i] + stripes_[i].size;
+        }
+        std::vector<std::pair<Key, Value>> entries(offsets.back());
+        std::vector<size_t> stripe_indexes(stripes_.size());
+        std::iota(stripe_indexes.begin(), stripe_indexes.end(), size_t{ 0 });
+        std::for_each(policy, stripe_indexes.begin(), stripe_indexes.end(), [&](size_t stripe_index) {
+            auto output = entries.begin() + offsets[stripe_index];
+            for (const Slot& slot : stripes_[stripe_index].slots) {
+                if (slot.occupied) {
+                    *output++ = { slot.key, slot.value };
+                }
+            }
+        });
+        locks.clear();
 
-        maps_[map_index].erase(key);
+        std::sort(policy, entries.begin(), entries.end(), [](const auto& lhs, const auto& rhs) {
+            return lhs.first < rhs.first;
+        });
+        return entries;
     }
 
     std::map<Key, Value> BuildOrdinaryMap() {
-
+        auto entries = BuildFlatVector(std::execution::par);
         std::map<Key, Value> result_map;
+        // Keys are sorted and unique, so every insertion is amortized O(1) at the end
+        for (auto& entry : entries) {
+            result_map.emplace_hint(result_map.end(), std::move(entry));
+        }
+        return result_map;
+    }
+
+private:
+    static constexpr size_t CACHE_LINE_SIZE = 64;
+    static constexpr size_t MIN_STRIPE_CAPACITY = 16;
+
+    struct Slot {
+        Key key{};
+        bool occupied = false;
+        Value value{};
+    };
+
+    struct alignas(CACHE_LINE_SIZE) Stripe {
+        using allocator_type = std::pmr::polymorphic_allocator<Slot>;
+
+        // Picked up by uses-allocator construction, so the tables share the map's resource
+        explicit Stripe(const allocator_type& allocator)
+            : slots(allocator) {
+        }
 
-        for (unsigned int i = 0; i < maps_.size(); ++i) {
-            std::lock_guard<std::mutex> guard(mutexes_[i]);
-            for (const auto& [key, val] : maps_[i]) {
-                result_map[key] += val;
+        std::mutex mutex;
+        // Capacity is zero or a power of two; the load factor stays at or below 3/4
+        std::pmr::vector<Slot> slots;
+        size_t size = 0;
+
+        size_t GetHome(uint64_t hash) const {
+            return static_cast<size_t>(hash >> 32) & (slots.size() - 1);
+        }
+
+        size_t GetNext(size_t index) const {
+            return (index + 1) & (slots.size() - 1);
+        }
+
+        // Index of the key, or of the empty slot ending its probe sequence
+        size_t Probe(Key key, uint64_t hash) const {
+            size_t index = GetHome(hash);
+            while (slots[index].occupied && slots[index].key != key) {
+                index = GetNext(index);
             }
-            //result_map.merge(map);
+            return index;
         }
 
-        return result_map;
+        Value& FindOrInsert(Key key, uint64_t hash) {
+            if (slots.empty()) {
+                Rehash(MIN_STRIPE_CAPACITY);
+            }
+            size_t index = Probe(key, hash);
+            if (slots[index].occupied) {
+                return slots[index].value;
+            }
+            if ((size + 1) * 4 > slots.size() * 3) {
+                Rehash(slots.size() * 2);
+                index = Probe(key, hash);
+            }
+            slots[index].key = key;
+            slots[index].occupied = true;
+            ++size;
+            return slots[index].value;
+        }
+
+        // Backward-shift deletion: later entries of the cluster move up, so no tombstones
+        // are left behind to lengthen probes
+        size_t Erase(Key key, uint64_t hash) {
+            if (slots.empty()) {
+                return 0;
+            }
+            size_t hole = Probe(key, hash);
+            if (!slots[hole].occupied) {
+                return 0;
+            }
+            for (size_t index = GetNext(hole); slots[index].occupied; index = GetNext(index)) {
+                const size_t home = GetHome(Hash(slots[index].key));
+                // The entry may fill the hole unless its home lies cyclically in (hole, index]
+                const bool home_after_hole = hole < index
+                    ? home > hole && home <= index
+                    : home > hole || home <= index;
+                if (!home_after_hole) {
+                    slots[hole] = std::move(slots[index]);
+                    hole = index;
+                }
+            }
+            slots[hole] = Slot{};
+            --size;
+            return 1;
+        }
 
+        void Rehash(size_t capacity) {
+            std::pmr::vector<Slot> old_slots(capacity, slots.get_allocator());
+            old_slots.swap(slots);
+            for (Slot& slot : old_slots) {
+                if (slot.occupied) {
+                    slots[Probe(slot.key, Hash(slot.key))] = std::move(slot);
+                }
+            }
+        }
+    };
+
+    std::pmr::vector<Stripe> stripes_;
+
+    // splitmix64 finalizer: the low bits pick the stripe, the high bits the home slot
+    static uint64_t Hash(Key key) {
+        uint64_t hash = static_cast<uint64_t>(key);
+        hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ull;
+        hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebull;
+        return hash ^ (hash >> 31);
     }
 
-private:
-    std::vector<std::map<Key, Value>> maps_;
-    std::vector<std::mutex> mutexes_;
-};
\ No newline at end of file
+    Stripe& GetStripe(uint64_t hash) {
+        return stripes_[static_cast<size_t>(hash % stripes_.size())];
+    }
+};
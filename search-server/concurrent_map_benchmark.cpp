@@ -0,0 +1,265 @@
+// Contention benchmark of ConcurrentMap against a single mutex around std::unordered_map.
+// Usage: concurrent_map_benchmark [--seed N] [--threads 1,2,4,8] [--stripes 8,64]
+//                                 [--operations N] [--repetitions N]
+// Every thread runs a fixed number of operations over a shared key range; narrow ranges put
+// all threads on a few keys, wide ones spread them over the whole table.
+// Results are printed to stdout as JSON so that two runs can be diffed.
+
+#include "concurrent_map.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <execution>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+struct BenchmarkConfig {
+    uint32_t seed = 42;
+    vector<int> thread_counts = { 1, 2, 4, 8 };
+    vector<int> stripe_counts = { 8, 64 };
+    vector<int> key_ranges = { 64, 65'536, 1 << 20 };
+    int operations_per_thread = 200'000;
+    int repetitions = 5;
+    // Share of operations that erase a key instead of updating it
+    double erase_share = 0.1;
+};
+
+struct BenchmarkResult {
+    string name;
+    int threads = 0;
+    int stripes = 0;
+    int key_range = 0;
+    int64_t operations = 0;
+    double ns_per_op_min = 0;
+    double ns_per_op_median = 0;
+};
+
+// The layout ConcurrentMap replaces as a baseline: every operation takes the same lock
+class GlobalLockMap {
+public:
+    struct Access {
+        lock_guard<mutex> guard;
+        int64_t& ref_to_value;
+    };
+
+    explicit GlobalLockMap(size_t) {
+    }
+
+    Access operator[](int64_t key) {
+        return { lock_guard(mutex_), map_[key] };
+    }
+
+    size_t Erase(int64_t key) {
+        lock_guard guard(mutex_);
+        return map_.erase(key);
+    }
+
+private:
+    mutex mutex_;
+    unordered_map<int64_t, int64_t> map_;
+};
+
+vector<int> ParseList(const string& text) {
+    vector<int> values;
+    stringstream stream(text);
+    string item;
+    while (getline(stream, item, ',')) {
+        values.push_back(stoi(item));
+    }
+    return values;
+}
+
+BenchmarkConfig ParseArguments(int argc, char* argv[]) {
+    BenchmarkConfig config;
+    for (int i = 1; i < argc; ++i) {
+        const string_view arg = argv[i];
+        if (i + 1 >= argc) {
+            throw invalid_argument("Missing value for "s + string(arg));
+        }
+        const string value = argv[++i];
+        if (arg == "--seed"sv) {
+            config.seed = static_cast<uint32_t>(stoul(value));
+        } else if (arg == "--threads"sv) {
+            config.thread_counts = ParseList(value);
+        } else if (arg == "--stripes"sv) {
+            config.stripe_counts = ParseList(value);
+        } else if (arg == "--operations"sv) {
+            config.operations_per_thread = stoi(value);
+        } else if (arg == "--repetitions"sv) {
+            config.repetitions = max(1, stoi(value));
+        } else {
+            throw invalid_argument("Unknown argument "s + string(arg));
+        }
+    }
+    return config;
+}
+
+// A negative key means "erase the key with the opposite sign"
+vector<vector<int64_t>> GenerateOperations(const BenchmarkConfig& config, int thread_count, int key_range) {
+    vector<vector<int64_t>> operations(thread_count);
+    for (int thread_index = 0; thread_index < thread_count; ++thread_index) {
+        mt19937 generator(config.seed + static_cast<uint32_t>(thread_index));
+        uniform_int_distribution<int64_t> key_distribution(1, key_range);
+        bernoulli_distribution erase_distribution(config.erase_share);
+        operations[thread_index].reserve(config.operations_per_thread);
+        for (int i = 0; i < config.operations_per_thread; ++i) {
+            const int64_t key = key_distribution(generator);
+            operations[thread_index].push_back(erase_distribution(generator) ? -key : key);
+        }
+    }
+    return operations;
+}
+
+template <typename Map>
+void RunOperations(Map& map, const vector<int64_t>& operations) {
+    for (const int64_t operation : operations) {
+        if (operation < 0) {
+            map.Erase(-operation);
+        } else {
+            map[operation].ref_to_value += 1;
+        }
+    }
+}
+
+// Threads are started before the clock and released together, so thread creation is not timed
+template <typename Map>
+BenchmarkResult MeasureContention(const string& name, const BenchmarkConfig& config,
+    int thread_count, int stripe_count, int key_range) {
+    using Clock = chrono::steady_clock;
+    const auto operations = GenerateOperations(config, thread_count, key_range);
+
+    BenchmarkResult result;
+    result.name = name;
+    result.threads = thread_count;
+    result.stripes = stripe_count;
+    result.key_range = key_range;
+    result.operations = static_cast<int64_t>(thread_count) * config.operations_per_thread;
+
+    vector<double> ns_per_op;
+    for (int repetition = 0; repetition < config.repetitions; ++repetition) {
+        Map map(stripe_count);
+        atomic<int> ready_count = 0;
+        atomic<bool> start = false;
+        vector<thread> threads;
+        for (int thread_index = 0; thread_index < thread_count; ++thread_index) {
+            threads.emplace_back([&, thread_index] {
+                ready_count.fetch_add(1);
+                while (!start.load()) {
+                    this_thread::yield();
+                }
+                RunOperations(map, operations[thread_index]);
+            });
+        }
+        while (ready_count.load() < thread_count) {
+            this_thread::yield();
+        }
+        const auto start_time = Clock::now();
+        start.store(true);
+        for (thread& worker : threads) {
+            worker.join();
+        }
+        const auto duration = chrono::duration_cast<chrono::nanoseconds>(Clock::now() - start_time).count();
+        ns_per_op.push_back(static_cast<double>(duration) / max<int64_t>(result.operations, 1));
+    }
+    sort(ns_per_op.begin(), ns_per_op.end());
+    result.ns_per_op_min = ns_per_op.front();
+    result.ns_per_op_median = ns_per_op[ns_per_op.size() / 2];
+    return result;
+}
+
+template <typename ExecutionPolicy>
+BenchmarkResult MeasureFlatten(const string& name, const BenchmarkConfig& config,
+    const ExecutionPolicy& policy, int stripe_count, int key_range) {
+    using Clock = chrono::steady_clock;
+    ConcurrentMap<int64_t, int64_t> map(stripe_count);
+    mt19937 generator(config.seed);
+    for (int i = 0; i < key_range; ++i) {
+        map[static_cast<int64_t>(generator())].ref_to_value += 1;
+    }
+
+    BenchmarkResult result;
+    result.name = name;
+    result.threads = 0;
+    result.stripes = stripe_count;
+    result.key_range = key_range;
+    vector<double> ns_per_op;
+    for (int repetition = 0; repetition < config.repetitions; ++repetition) {
+        const auto start_time = Clock::now();
+        const auto entries = map.BuildFlatVector(policy);
+        const auto duration = chrono::duration_cast<chrono::nanoseconds>(Clock::now() - start_time).count();
+        result.operations = static_cast<int64_t>(entries.size());
+        ns_per_op.push_back(static_cast<double>(duration) / max<int64_t>(result.operations, 1));
+    }
+    sort(ns_per_op.begin(), ns_per_op.end());
+    result.ns_per_op_min = ns_per_op.front();
+    result.ns_per_op_median = ns_per_op[ns_per_op.size() / 2];
+    return result;
+}
+
+vector<BenchmarkResult> RunBenchmarks(const BenchmarkConfig& config) {
+    vector<BenchmarkResult> results;
+    for (const int key_range : config.key_ranges) {
+        for (const int thread_count : config.thread_counts) {
+            results.push_back(MeasureContention<GlobalLockMap>("GlobalLock"s, config, thread_count, 1, key_range));
+            for (const int stripe_count : config.stripe_counts) {
+                results.push_back(MeasureContention<ConcurrentMap<int64_t, int64_t>>(
+                    "ConcurrentMap"s, config, thread_count, stripe_count, key_range));
+            }
+        }
+    }
+    const int stripe_count = config.stripe_counts.back();
+    const int key_range = config.key_ranges.back();
+    results.push_back(MeasureFlatten("BuildFlatVector/seq"s, config, execution::seq, stripe_count, key_range));
+    results.push_back(MeasureFlatten("BuildFlatVector/par"s, config, execution::par, stripe_count, key_range));
+    return results;
+}
+
+void PrintJson(ostream& os, const BenchmarkConfig& config, const vector<BenchmarkResult>& results) {
+    os << "{\n"s;
+    os << "  \"seed\": "s << config.seed << ",\n"s;
+    os << "  \"operations_per_thread\": "s << config.operations_per_thread << ",\n"s;
+    os << "  \"repetitions\": "s << config.repetitions << ",\n"s;
+    os << "  \"erase_share\": "s << config.erase_share << ",\n"s;
+    os << "  \"hardware_threads\": "s << thread::hardware_concurrency() << ",\n"s;
+    os << "  \"results\": [\n"s;
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchmarkResult& result = results[i];
+        os << "    { \"name\": \""s << result.name << "\""s
+            << ", \"threads\": "s << result.threads
+            << ", \"stripes\": "s << result.stripes
+            << ", \"key_range\": "s << result.key_range
+            << ", \"operations\": "s << result.operations
+            << ", \"ns_per_op_min\": "s << static_cast<int64_t>(result.ns_per_op_min)
+            << ", \"ns_per_op_median\": "s << static_cast<int64_t>(result.ns_per_op_median) << " }"s
+            << (i + 1 < results.size() ? ","s : ""s) << '\n';
+    }
+    os << "  ]\n"s;
+    os << "}"s << endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    try {
+        const BenchmarkConfig config = ParseArguments(argc, argv);
+        PrintJson(cout, config, RunBenchmarks(config));
+    } catch (const exception& e) {
+        cerr << "concurrent_map_benchmark: "s << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,371 @@
+#include "corpus_loader.h"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <charconv>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <fcntl.h>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+
+using namespace std;
+
+namespace {
+
+const array<string_view, DOCUMENT_STATUS_COUNT> STATUS_NAMES = {
+    "ACTUAL"sv, "IRRELEVANT"sv, "BANNED"sv, "REMOVED"sv,
+};
+
+string DescribeError(const string& action) {
+    return action + ": "s + strerror(errno);
+}
+
+string DescribeLine(size_t line_number, const string& message) {
+    return "Line "s + to_string(line_number) + ": "s + message;
+}
+
+// Read-only mapping of a whole file, unmapped by the destructor
+class MappedFile {
+public:
+    explicit MappedFile(const string& path) {
+        const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            throw runtime_error(DescribeError("open "s + path));
+        }
+        struct stat file_stat {};
+        if (fstat(fd, &file_stat) < 0) {
+            const string message = DescribeError("stat "s + path);
+            close(fd);
+            throw runtime_error(message);
+        }
+        size_ = static_cast<size_t>(file_stat.st_size);
+        // mmap rejects an empty length, and an empty file is simply an empty corpus
+        if (size_ > 0) {
+            void* const data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED) {
+                const string message = DescribeError("mmap "s + path);
+                close(fd);
+                throw runtime_error(message);
+            }
+            data_ = static_cast<char*>(data);
+        }
+        close(fd);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+        if (data_ != nullptr) {
+            munmap(data_, size_);
+        }
+    }
+
+    string_view GetBytes() const {
+        return { data_, size_ };
+    }
+
+    void Advise(int advice) const {
+        if (data_ != nullptr) {
+            madvise(data_, size_, advice);
+        }
+    }
+
+private:
+    char* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// Blocking FIFO of limited capacity. Close() wakes everybody up: Push fails from then on,
+// Pop drains the remaining items and then reports the end.
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity)
+        : capacity_(max<size_t>(capacity, 1)) {
+    }
+
+    // false when the queue is closed, the item is dropped then
+    bool Push(T item) {
+        unique_lock lock(mutex_);
+        not_full_.wait(lock, [&] {
+            return closed_ || items_.size() < capacity_;
+        });
+        if (closed_) {
+            return false;
+        }
+        items_.push_back(move(item));
+        not_empty_.notify_one();
+        return true;
+    }
+
+    optional<T> Pop() {
+        unique_lock lock(mutex_);
+        not_empty_.wait(lock, [&] {
+            return closed_ || !items_.empty();
+        });
+        if (items_.empty()) {
+            return nullopt;
+        }
+        T item = move(items_.front());
+        items_.pop_front();
+        not_full_.notify_one();
+        return item;
+    }
+
+    void Close() {
+        lock_guard guard(mutex_);
+        closed_ = true;
+        not_full_.notify_all();
+        not_empty_.notify_all();
+    }
+
+private:
+    const size_t capacity_;
+    mutex mutex_;
+    condition_variable not_full_;
+    condition_variable not_empty_;
+    deque<T> items_;
+    bool closed_ = false;
+};
+
+struct ParsedDocument {
+    size_t line_number = 0;
+    int id = 0;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    vector<int> ratings;
+    string_view text;
+    // Filled by the tokenizing stage
+    vector<string_view> words;
+};
+
+using DocumentBatch = vector<ParsedDocument>;
+
+// The first error by line number. Stages run ahead of each other, so a later line may fail first.
+class StageError {
+public:
+    void Record(size_t line_number, exception_ptr error) {
+        lock_guard guard(mutex_);
+        if (!error_ || line_number < line_number_) {
+            line_number_ = line_number;
+            error_ = move(error);
+        }
+    }
+
+    void RethrowIfAny() const {
+        if (error_) {
+            rethrow_exception(error_);
+        }
+    }
+
+private:
+    mutex mutex_;
+    size_t line_number_ = 0;
+    exception_ptr error_;
+};
+
+// Splits off the text up to the next tab; false when there is none
+bool TakeField(string_view& line, string_view& field) {
+    const size_t tab = line.find('\t');
+    if (tab == string_view::npos) {
+        return false;
+    }
+    field = line.substr(0, tab);
+    line.remove_prefix(tab + 1);
+    return true;
+}
+
+bool ParseInt(string_view text, int& value) {
+    const char* const end = text.data() + text.size();
+    const auto [parsed_end, error] = from_chars(text.data(), end, value);
+    return error == errc() && parsed_end == end;
+}
+
+ParsedDocument ParseLine(string_view line, size_t line_number) {
+    ParsedDocument document;
+    document.line_number = line_number;
+    string_view id_field;
+    string_view status_field;
+    string_view ratings_field;
+    if (!TakeField(line, id_field) || !TakeField(line, status_field) || !TakeField(line, ratings_field)) {
+        throw invalid_argument(DescribeLine(line_number, "expected id, status, ratings and text separated by tabs"s));
+    }
+    if (!ParseInt(id_field, document.id)) {
+        throw invalid_argument(DescribeLine(line_number, "invalid document id "s + string(id_field)));
+    }
+    const auto status_it = find(STATUS_NAMES.begin(), STATUS_NAMES.end(), status_field);
+    if (status_it == STATUS_NAMES.end()) {
+        throw invalid_argument(DescribeLine(line_number, "unknown status "s + string(status_field)));
+    }
+    document.status = static_cast<DocumentStatus>(status_it - STATUS_NAMES.begin());
+    while (!ratings_field.empty()) {
+        const size_t comma = ratings_field.find(',');
+        int rating = 0;
+        if (!ParseInt(ratings_field.substr(0, comma), rating)) {
+            throw invalid_argument(DescribeLine(line_number, "invalid ratings "s + string(ratings_field)));
+        }
+        document.ratings.push_back(rating);
+        if (comma == string_view::npos) {
+            break;
+        }
+        ratings_field.remove_prefix(comma + 1);
+        if (ratings_field.empty()) {
+            throw invalid_argument(DescribeLine(line_number, "trailing comma in ratings"s));
+        }
+    }
+    document.text = line;
+    return document;
+}
+
+} // namespace
+
+CorpusLoader::CorpusLoader(SearchServer& search_server, CorpusLoadOptions options)
+    : search_server_(search_server)
+    , options_(options) {
+    options_.batch_size = max<size_t>(options_.batch_size, 1);
+}
+
+CorpusLoadStats CorpusLoader::Load(const string& path) {
+    const auto file = make_shared<const MappedFile>(path);
+    const string_view bytes = file->GetBytes();
+    file->Advise(MADV_SEQUENTIAL);
+
+    BoundedQueue<DocumentBatch> parsed_batches(options_.queue_capacity);
+    BoundedQueue<DocumentBatch> tokenized_batches(options_.queue_capacity);
+    StageError stage_error;
+
+    // Every stage passes on the documents before its first failure, so the indexer stops
+    // exactly at the offending line
+    thread parser([&] {
+        DocumentBatch batch;
+        size_t line_number = 0;
+        try {
+            string_view rest = bytes;
+            while (!rest.empty()) {
+                const size_t line_end = rest.find('\n');
+                string_view line = rest.substr(0, line_end);
+                rest.remove_prefix(line_end == string_view::npos ? rest.size() : line_end + 1);
+                ++line_number;
+                if (!line.empty() && line.back() == '\r') {
+                    line.remove_suffix(1);
+                }
+                if (line.empty()) {
+                    continue;
+                }
+                batch.push_back(ParseLine(line, line_number));
+                if (batch.size() == options_.batch_size) {
+                    if (!parsed_batches.Push(move(batch))) {
+                        return;
+                    }
+                    batch = DocumentBatch();
+                }
+            }
+        } catch (...) {
+            stage_error.Record(line_number, current_exception());
+        }
+        if (!batch.empty()) {
+            parsed_batches.Push(move(batch));
+        }
+        parsed_batches.Close();
+    });
+
+    thread tokenizer([&] {
+        while (optional<DocumentBatch> batch = parsed_batches.Pop()) {
+            size_t tokenized_count = 0;
+            exception_ptr error;
+            try {
+                for (ParsedDocument& document : *batch) {
+                    // Reads only the stop words, which never change, so it may run next to the indexer
+                    document.words = search_server_.SplitIntoWordsNoStop(document.text);
+                    ++tokenized_count;
+                }
+            } catch (const invalid_argument& e) {
+                error = make_exception_ptr(invalid_argument(
+                    DescribeLine((*batch)[tokenized_count].line_number, e.what())));
+            } catch (...) {
+                // bad_alloc and the like go to the caller of Load as they are
+                error = current_exception();
+            }
+            if (error) {
+                stage_error.Record((*batch)[tokenized_count].line_number, error);
+                batch->resize(tokenized_count);
+                tokenized_batches.Push(move(*batch));
+                parsed_batches.Close();
+                break;
+            }
+            if (!tokenized_batches.Push(move(*batch))) {
+                parsed_batches.Close();
+                break;
+            }
+        }
+        tokenized_batches.Close();
+    });
+
+    CorpusLoadStats stats;
+    stats.byte_count = bytes.size();
+    // Loaded texts point into the mapping, so the server owns it from the start; a compaction
+    // during the load must also see which texts are mapped
+    search_server_.external_storage_.push_back({ file, bytes });
+    const auto detach_unused_file = [&] {
+        if (stats.document_count == 0) {
+            auto& storages = search_server_.external_storage_;
+            storages.erase(remove_if(storages.begin(), storages.end(), [&](const SearchServer::ExternalStorage& storage) {
+                return storage.owner == file;
+            }), storages.end());
+        }
+    };
+    try {
+        while (optional<DocumentBatch> batch = tokenized_batches.Pop()) {
+            for (const ParsedDocument& document : *batch) {
+                try {
+                    search_server_.ReserveDocumentMemory(0, document.words);
+                    search_server_.AddTokenizedDocument(document.id, document.text, document.status,
+                        document.ratings, document.words);
+                } catch (const invalid_argument& e) {
+                    throw invalid_argument(DescribeLine(document.line_number, e.what()));
+                }
+                ++stats.document_count;
+            }
+        }
+    } catch (...) {
+        tokenized_batches.Close();
+        parsed_batches.Close();
+        parser.join();
+        tokenizer.join();
+        detach_unused_file();
+        throw;
+    }
+    parser.join();
+    tokenizer.join();
+    detach_unused_file();
+    file->Advise(MADV_NORMAL);
+    stage_error.RethrowIfAny();
+    return stats;
+}
+
+void WriteCorpusDocument(ostream& output, int document_id, DocumentStatus status,
+    const vector<int>& ratings, string_view text) {
+    // The rule of AddDocument, which also keeps tabs and line breaks out of the line
+    if (!SearchServer::IsValidWord(text)) {
+        throw invalid_argument("Document text must not contain characters with codes 0 to 31"s);
+    }
+    output << document_id << '\t' << STATUS_NAMES[static_cast<int>(status)] << '\t';
+    for (size_t i = 0; i < ratings.size(); ++i) {
+        if (i > 0) {
+            output << ',';
+        }
+        output << ratings[i];
+    }
+    output << '\t' << text << '\n';
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "document.h"
+#include "search_server.h"
+
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Corpus file format, one document per line, fields separated by tabs:
+//     id <TAB> status <TAB> ratings <TAB> text
+// status is ACTUAL, IRRELEVANT, BANNED or REMOVED, ratings are comma-separated integers
+// (the field may be empty). Empty lines are skipped.
+
+struct CorpusLoadOptions {
+    // Documents handed between pipeline stages at once
+    size_t batch_size = 512;
+    // Batches waiting between two stages; bounds the memory of a load
+    size_t queue_capacity = 8;
+};
+
+struct CorpusLoadStats {
+    size_t document_count = 0;
+    size_t byte_count = 0;
+};
+
+// Bulk loader that maps a corpus file into memory and indexes the mapped bytes in place:
+// the texts are not copied, the server keeps the mapping alive instead. Parsing, tokenizing
+// and indexing run as a pipeline on three threads connected by bounded queues.
+class CorpusLoader {
+public:
+    explicit CorpusLoader(SearchServer& search_server, CorpusLoadOptions options = {});
+
+    // Throws std::invalid_argument with the line number on a malformed line, an invalid word
+    // or a duplicate id, MemoryBudgetExceeded when the server's memory budget runs out and
+    // std::runtime_error when the file cannot be mapped. Other failures of the pipeline threads,
+    // such as std::bad_alloc, are rethrown here as they are. Documents before the offending line
+    // stay indexed, as with a sequence of AddDocument calls.
+    CorpusLoadStats Load(const std::string& path);
+
+private:
+    SearchServer& search_server_;
+    CorpusLoadOptions options_;
+};
+
+// Writes one line in the format read by CorpusLoader. Throws std::invalid_argument for a
+// text AddDocument would reject for its characters, tabs and line breaks included.
+void WriteCorpusDocument(std::ostream& output, int document_id, DocumentStatus status,
+    const std::vector<int>& ratings, std::string_view text);
@@ -7,6 +7,8 @@ enum class DocumentStatus {
     REMOVED,
 };
 
+const int DOCUMENT_STATUS_COUNT = 4;
+
 struct Document {
     Document() = default;
 
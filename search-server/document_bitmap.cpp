@@ -0,0 +1,151 @@
+#include "document_bitmap.h"
+
+#include <algorithm>
+
+using namespace std;
+
+void DocumentBitmap::Insert(int document_id) {
+    const uint32_t id = static_cast<uint32_t>(document_id);
+    Chunk& chunk = chunks_[id >> 16];
+    const uint16_t low = static_cast<uint16_t>(id & 0xFFFF);
+    if (chunk.IsBitset()) {
+        uint64_t& word = chunk.bits[low / 64];
+        const uint64_t mask = uint64_t{ 1 } << (low % 64);
+        if (word & mask) {
+            return;
+        }
+        word |= mask;
+    } else {
+        const auto it = lower_bound(chunk.array.begin(), chunk.array.end(), low);
+        if (it != chunk.array.end() && *it == low) {
+            return;
+        }
+        chunk.array.insert(it, low);
+        if (chunk.array.size() > ARRAY_LIMIT) {
+            ConvertToBitset(chunk);
+        }
+    }
+    ++chunk.count;
+    ++count_;
+}
+
+void DocumentBitmap::Erase(int document_id) {
+    const uint32_t id = static_cast<uint32_t>(document_id);
+    const auto chunk_it = chunks_.find(id >> 16);
+    if (chunk_it == chunks_.end()) {
+        return;
+    }
+    Chunk& chunk = chunk_it->second;
+    const uint16_t low = static_cast<uint16_t>(id & 0xFFFF);
+    if (chunk.IsBitset()) {
+        uint64_t& word = chunk.bits[low / 64];
+        const uint64_t mask = uint64_t{ 1 } << (low % 64);
+        if ((word & mask) == 0) {
+            return;
+        }
+        word &= ~mask;
+    } else {
+        const auto it = lower_bound(chunk.array.begin(), chunk.array.end(), low);
+        if (it == chunk.array.end() || *it != low) {
+            return;
+        }
+        chunk.array.erase(it);
+    }
+    --chunk.count;
+    --count_;
+    if (chunk.count == 0) {
+        chunks_.erase(chunk_it);
+    } else if (chunk.IsBitset() && chunk.count < ARRAY_LIMIT / 2) {
+        ConvertToArray(chunk);
+    }
+}
+
+bool DocumentBitmap::Contains(int document_id) const {
+    const uint32_t id = static_cast<uint32_t>(document_id);
+    const auto chunk_it = chunks_.find(id >> 16);
+    if (chunk_it == chunks_.end()) {
+        return false;
+    }
+    const Chunk& chunk = chunk_it->second;
+    const uint16_t low = static_cast<uint16_t>(id & 0xFFFF);
+    if (chunk.IsBitset()) {
+        return (chunk.bits[low / 64] >> (low % 64)) & 1;
+    }
+    return binary_search(chunk.array.begin(), chunk.array.end(), low);
+}
+
+DocumentBitmap& DocumentBitmap::operator|=(const DocumentBitmap& other) {
+    for (const auto& [high, other_chunk] : other.chunks_) {
+        const auto it = chunks_.find(high);
+        if (it == chunks_.end()) {
+            chunks_.emplace(high, other_chunk);
+            count_ += other_chunk.count;
+            continue;
+        }
+        Chunk& chunk = it->second;
+        count_ -= chunk.count;
+        if (!chunk.IsBitset()) {
+            ConvertToBitset(chunk);
+        }
+        if (other_chunk.IsBitset()) {
+            for (size_t i = 0; i < BITSET_WORDS; ++i) {
+                chunk.bits[i] |= other_chunk.bits[i];
+            }
+        } else {
+            for (const uint16_t low : other_chunk.array) {
+                chunk.bits[low / 64] |= uint64_t{ 1 } << (low % 64);
+            }
+        }
+        chunk.count = 0;
+        for (const uint64_t word : chunk.bits) {
+            for (uint64_t rest = word; rest != 0; rest &= rest - 1) {
+                ++chunk.count;
+            }
+        }
+        if (chunk.count <= ARRAY_LIMIT) {
+            ConvertToArray(chunk);
+        }
+        count_ += chunk.count;
+    }
+    return *this;
+}
+
+vector<int> DocumentBitmap::ToVector() const {
+    vector<int> result;
+    result.reserve(count_);
+    ForEach([&result](int document_id) {
+        result.push_back(document_id);
+    });
+    return result;
+}
+
+size_t DocumentBitmap::GetAllocatedSize() const {
+    size_t size = 0;
+    for (const auto& [high, chunk] : chunks_) {
+        size += chunk.array.capacity() * sizeof(uint16_t) + chunk.bits.capacity() * sizeof(uint64_t);
+    }
+    return size;
+}
+
+void DocumentBitmap::ConvertToBitset(Chunk& chunk) {
+    chunk.bits.assign(BITSET_WORDS, 0);
+    for (const uint16_t low : chunk.array) {
+        chunk.bits[low / 64] |= uint64_t{ 1 } << (low % 64);
+    }
+    chunk.array.clear();
+    chunk.array.shrink_to_fit();
+}
+
+void DocumentBitmap::ConvertToArray(Chunk& chunk) {
+    chunk.array.clear();
+    chunk.array.reserve(chunk.count);
+    for (size_t word_index = 0; word_index < BITSET_WORDS; ++word_index) {
+        for (size_t bit = 0; bit < 64; ++bit) {
+            if ((chunk.bits[word_index] >> bit) & 1) {
+                chunk.array.push_back(static_cast<uint16_t>(word_index * 64 + bit));
+            }
+        }
+    }
+    chunk.bits.clear();
+    chunk.bits.shrink_to_fit();
+}
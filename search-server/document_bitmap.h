@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+inline int CountTrailingZeros(uint64_t word) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(word);
+#else
+    int bit = 0;
+    while (((word >> bit) & 1) == 0) {
+        ++bit;
+    }
+    return bit;
+#endif
+}
+
+// Compressed set of non-negative document ids in the spirit of Roaring bitmaps: ids are split
+// into 2^16-wide chunks, a sparse chunk keeps a sorted array of its low bits and a dense one
+// a plain bitset. Iteration is in increasing id order.
+class DocumentBitmap {
+public:
+    void Insert(int document_id);
+    void Erase(int document_id);
+    bool Contains(int document_id) const;
+
+    size_t GetCount() const {
+        return count_;
+    }
+
+    bool IsEmpty() const {
+        return count_ == 0;
+    }
+
+    DocumentBitmap& operator|=(const DocumentBitmap& other);
+
+    std::vector<int> ToVector() const;
+
+    // Heap bytes of the chunk containers, without map node overhead
+    size_t GetAllocatedSize() const;
+
+    template <typename Function>
+    void ForEach(Function function) const;
+
+private:
+    // A chunk switches to the bitset above ARRAY_LIMIT ids and back below ARRAY_LIMIT / 2
+    static constexpr size_t ARRAY_LIMIT = 4096;
+    static constexpr size_t BITSET_WORDS = (1 << 16) / 64;
+
+    struct Chunk {
+        std::vector<uint16_t> array;
+        std::vector<uint64_t> bits;
+        uint32_t count = 0;
+
+        bool IsBitset() const {
+            return !bits.empty();
+        }
+    };
+
+    std::map<uint32_t, Chunk> chunks_;
+    size_t count_ = 0;
+
+    static void ConvertToBitset(Chunk& chunk);
+    static void ConvertToArray(Chunk& chunk);
+};
+
+template <typename Function>
+void DocumentBitmap::ForEach(Function function) const {
+    for (const auto& [high, chunk] : chunks_) {
+        const int base = static_cast<int>(high << 16);
+        if (!chunk.IsBitset()) {
+            for (const uint16_t low : chunk.array) {
+                function(base | low);
+            }
+            continue;
+        }
+        for (size_t word_index = 0; word_index < BITSET_WORDS; ++word_index) {
+            for (uint64_t word = chunk.bits[word_index]; word != 0; word &= word - 1) {
+                function(base | static_cast<int>(word_index * 64 + CountTrailingZeros(word)));
+            }
+        }
+    }
+}
@@ -0,0 +1,56 @@
+#include "document_filter.h"
+
+DocumentFilter::DocumentFilter(DocumentStatus status)
+    : status_mask_(0) {
+    AddStatus(status);
+}
+
+DocumentFilter::DocumentFilter(std::initializer_list<DocumentStatus> statuses)
+    : status_mask_(0) {
+    for (const DocumentStatus status : statuses) {
+        AddStatus(status);
+    }
+}
+
+DocumentFilter& DocumentFilter::AddStatus(DocumentStatus status) {
+    status_mask_ |= 1u << static_cast<int>(status);
+    return *this;
+}
+
+DocumentFilter& DocumentFilter::SetRatingRange(int min_rating, int max_rating) {
+    min_rating_ = min_rating;
+    max_rating_ = max_rating;
+    return *this;
+}
+
+bool DocumentFilter::HasStatusFilter() const {
+    return status_mask_ != ALL_STATUSES;
+}
+
+bool DocumentFilter::HasRatingFilter() const {
+    return min_rating_ != INT_MIN || max_rating_ != INT_MAX;
+}
+
+bool DocumentFilter::AcceptsStatus(DocumentStatus status) const {
+    return (status_mask_ >> static_cast<int>(status)) & 1;
+}
+
+int DocumentFilter::GetMinRating() const {
+    return min_rating_;
+}
+
+int DocumentFilter::GetMaxRating() const {
+    return max_rating_;
+}
+
+bool DocumentFilter::operator()(int, DocumentStatus status, int rating) const {
+    return AcceptsStatus(status) && rating >= min_rating_ && rating <= max_rating_;
+}
+
+bool DocumentFilter::operator==(const DocumentFilter& other) const {
+    return status_mask_ == other.status_mask_ && min_rating_ == other.min_rating_ && max_rating_ == other.max_rating_;
+}
+
+bool DocumentFilter::operator!=(const DocumentFilter& other) const {
+    return !(*this == other);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "document.h"
+
+#include <climits>
+#include <cstdint>
+#include <initializer_list>
+
+// Filter the search engine understands, unlike an arbitrary predicate: the index keeps
+// per-status bitmaps and a rating-ordered index, so the matching documents are known
+// before any posting is scored. It can still be called as a DocumentPredicate.
+class DocumentFilter {
+public:
+    // Accepts every document
+    DocumentFilter() = default;
+
+    explicit DocumentFilter(DocumentStatus status);
+    DocumentFilter(std::initializer_list<DocumentStatus> statuses);
+
+    DocumentFilter& AddStatus(DocumentStatus status);
+    // Inclusive on both ends
+    DocumentFilter& SetRatingRange(int min_rating, int max_rating);
+
+    bool HasStatusFilter() const;
+    bool HasRatingFilter() const;
+    bool AcceptsStatus(DocumentStatus status) const;
+    int GetMinRating() const;
+    int GetMaxRating() const;
+
+    bool operator()(int document_id, DocumentStatus status, int rating) const;
+
+    bool operator==(const DocumentFilter& other) const;
+    bool operator!=(const DocumentFilter& other) const;
+
+private:
+    static constexpr uint32_t ALL_STATUSES = (1u << DOCUMENT_STATUS_COUNT) - 1;
+
+    uint32_t status_mask_ = ALL_STATUSES;
+    int min_rating_ = INT_MIN;
+    int max_rating_ = INT_MAX;
+};
@@ -0,0 +1,187 @@
+#include "impact_index.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace std;
+
+ImpactIndex::ImpactIndex(const SearchServer& search_server)
+    : search_server_(search_server) {
+    double max_impact = 0;
+    for (const auto& [word, postings] : search_server_.word_to_document_freqs_) {
+        const double inverse_document_freq = search_server_.ComputeWordInverseDocumentFreq(word);
+        for (const auto& [document_id, term_freq] : postings) {
+            max_impact = max(max_impact, term_freq * inverse_document_freq);
+        }
+    }
+    quantum_ = max_impact > 0 ? max_impact / IMPACT_LEVELS : 1.0;
+
+    for (const auto& [word, postings] : search_server_.word_to_document_freqs_) {
+        const double inverse_document_freq = search_server_.ComputeWordInverseDocumentFreq(word);
+        map<uint8_t, vector<int>, greater<>> impact_to_documents;
+        for (const auto& [document_id, term_freq] : postings) {
+            const double impact = round(term_freq * inverse_document_freq / quantum_);
+            impact_to_documents[static_cast<uint8_t>(min<double>(impact, IMPACT_LEVELS))].push_back(document_id);
+        }
+        auto& segments = word_to_segments_[string(word)];
+        segments.reserve(impact_to_documents.size());
+        for (auto& [impact, document_ids] : impact_to_documents) {
+            segments.push_back({ impact, move(document_ids) });
+        }
+        posting_count_ += postings.size();
+    }
+}
+
+vector<Document> ImpactIndex::FindTopDocuments(string_view raw_query, const DocumentFilter& filter,
+    size_t max_postings, ImpactSearchStats* stats) const {
+    using namespace std::string_literals;
+
+    const auto query = search_server_.ParseQuery(raw_query);
+    if (!query.positional_constraints.empty() || !query.plus_wildcards.empty() || !query.fuzzy_words.empty()
+        || !query.required_words.empty()) {
+        throw invalid_argument("Phrase, NEAR, wildcard, fuzzy and required plus words are not supported by the impact index"s);
+    }
+
+    unordered_set<int> excluded_documents;
+    vector<string_view> minus_words(query.minus_words.begin(), query.minus_words.end());
+    for (const string_view pattern : query.minus_wildcards) {
+        const auto expansion = search_server_.ExpandWildcard(pattern);
+        minus_words.insert(minus_words.end(), expansion.begin(), expansion.end());
+    }
+    for (const string_view word : minus_words) {
+        const auto it = search_server_.word_to_document_freqs_.find(word);
+        if (it != search_server_.word_to_document_freqs_.end()) {
+            for (const auto& [document_id, _] : it->second) {
+                excluded_documents.insert(document_id);
+            }
+        }
+    }
+    const auto candidates = search_server_.SelectCandidates(filter);
+
+    // Segments of all query words in one impact-ordered schedule
+    struct ScheduledSegment {
+        const vector<Segment>* word_segments;
+        size_t index;
+        size_t word_index;
+
+        uint8_t GetImpact() const {
+            return (*word_segments)[index].impact;
+        }
+    };
+    vector<ScheduledSegment> schedule;
+    // Impact of the next unread segment of every query word: the most it can still add to a score
+    vector<uint32_t> word_bounds;
+    for (const string_view word : query.plus_words) {
+        const auto it = word_to_segments_.find(word);
+        if (it == word_to_segments_.end()) {
+            continue;
+        }
+        for (size_t i = 0; i < it->second.size(); ++i) {
+            schedule.push_back({ &it->second, i, word_bounds.size() });
+        }
+        word_bounds.push_back(it->second.front().impact);
+    }
+    // Stable, so the segments of one word keep their decreasing order
+    stable_sort(schedule.begin(), schedule.end(), [](const ScheduledSegment& lhs, const ScheduledSegment& rhs) {
+        return lhs.GetImpact() > rhs.GetImpact();
+    });
+    uint32_t remaining_bound = accumulate(word_bounds.begin(), word_bounds.end(), uint32_t{ 0 });
+
+    unordered_map<int, uint32_t> document_to_score;
+    vector<uint32_t> scores;
+    // The top set is settled when the K-th score is ahead of the (K+1)-th, or of an unseen
+    // document, by more than any document can still gain
+    const auto is_top_settled = [&] {
+        if (document_to_score.size() < static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT)) {
+            return false;
+        }
+        scores.clear();
+        for (const auto& [document_id, score] : document_to_score) {
+            scores.push_back(score);
+        }
+        const auto kth = scores.begin() + (MAX_RESULT_DOCUMENT_COUNT - 1);
+        nth_element(scores.begin(), kth, scores.end(), greater<>());
+        const uint32_t runner_up = kth + 1 == scores.end() ? 0 : *max_element(kth + 1, scores.end());
+        return *kth > runner_up + remaining_bound;
+    };
+
+    ImpactSearchStats local_stats;
+    size_t unread_from = schedule.size();
+    for (size_t i = 0; i < schedule.size(); ++i) {
+        if (local_stats.postings_processed >= max_postings) {
+            local_stats.stopped_early = true;
+            local_stats.exact_relevance = false;
+            break;
+        }
+        const ScheduledSegment& scheduled = schedule[i];
+        const Segment& segment = (*scheduled.word_segments)[scheduled.index];
+        for (const int document_id : segment.document_ids) {
+            if ((candidates.accepts_all || candidates.GetBitmap().Contains(document_id))
+                && excluded_documents.count(document_id) == 0) {
+                document_to_score[document_id] += segment.impact;
+            }
+        }
+        local_stats.postings_processed += segment.document_ids.size();
+        ++local_stats.segments_processed;
+
+        const uint32_t next_bound = scheduled.index + 1 < scheduled.word_segments->size()
+            ? (*scheduled.word_segments)[scheduled.index + 1].impact : 0;
+        remaining_bound -= word_bounds[scheduled.word_index] - next_bound;
+        word_bounds[scheduled.word_index] = next_bound;
+
+        // Checking costs a pass over the accumulators, so it is done once per impact level
+        const bool level_done = i + 1 == schedule.size() || schedule[i + 1].GetImpact() < segment.impact;
+        if (level_done && i + 1 < schedule.size() && is_top_settled()) {
+            local_stats.stopped_early = true;
+            unread_from = i + 1;
+            break;
+        }
+    }
+    SEARCH_METRICS_COUNT(POSTINGS_SCANNED, local_stats.postings_processed);
+    if (stats != nullptr) {
+        *stats = local_stats;
+    }
+
+    if (unread_from < schedule.size()) {
+        // Only the set is settled: the top scores still lack the impacts of unread segments
+        scores.clear();
+        for (const auto& [document_id, score] : document_to_score) {
+            scores.push_back(score);
+        }
+        const auto kth = scores.begin() + (MAX_RESULT_DOCUMENT_COUNT - 1);
+        nth_element(scores.begin(), kth, scores.end(), greater<>());
+        const uint32_t min_top_score = *kth;
+        for (auto& [document_id, score] : document_to_score) {
+            if (score < min_top_score) {
+                continue;
+            }
+            for (size_t i = unread_from; i < schedule.size(); ++i) {
+                const Segment& segment = (*schedule[i].word_segments)[schedule[i].index];
+                if (binary_search(segment.document_ids.begin(), segment.document_ids.end(), document_id)) {
+                    score += segment.impact;
+                }
+            }
+        }
+    }
+
+    vector<Document> matched_documents;
+    matched_documents.reserve(document_to_score.size());
+    for (const auto& [document_id, score] : document_to_score) {
+        // The server may have dropped the document since the snapshot was taken
+        const auto it = search_server_.documents_.find(document_id);
+        if (it != search_server_.documents_.end()) {
+            matched_documents.push_back({ document_id, score * quantum_, it->second.rating });
+        }
+    }
+    const size_t result_size = min(matched_documents.size(), static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT));
+    partial_sort(matched_documents.begin(), matched_documents.begin() + result_size, matched_documents.end(), IsMoreRelevant);
+    matched_documents.resize(result_size);
+    return matched_documents;
+}
+
+size_t ImpactIndex::GetPostingCount() const {
+    return posting_count_;
+}
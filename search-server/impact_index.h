@@ -0,0 +1,63 @@
+#pragma once
+
+#include "document_filter.h"
+#include "search_server.h"
+
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct ImpactSearchStats {
+    size_t postings_processed = 0;
+    size_t segments_processed = 0;
+    // The top documents were settled or the budget ran out before all segments were read
+    bool stopped_early = false;
+    // Settled top documents get the impacts of their unread segments added; when the budget
+    // runs out, relevance counts only the segments read and may be too low
+    bool exact_relevance = true;
+};
+
+// Read-only, impact-ordered copy of a SearchServer's postings for tight latency budgets.
+// Every posting carries its term_freq * IDF quantized to IMPACT_LEVELS levels, and the postings
+// of a word are grouped into segments of equal impact. A query reads the segments of all its
+// words from the highest impact down (score-at-a-time) and stops when the set of top documents
+// can no longer change or the posting budget is spent. Relevance is the sum of quantized
+// impacts, so it differs from SearchServer's by at most one quantum per query word.
+// An early stop leaves the top documents partly scored, so their remaining impacts are then
+// looked up in the unread segments, which keeps their order exact.
+//
+// The index is a snapshot: rebuild it after the server changes. It refers to the server,
+// which must outlive it.
+class ImpactIndex {
+public:
+    static constexpr int IMPACT_LEVELS = 255;
+
+    explicit ImpactIndex(const SearchServer& search_server);
+
+    // Plus words, minus words and minus wildcards; phrase, NEAR, plus wildcard, fuzzy-expanded
+    // and required-word queries throw invalid_argument.
+    // Reading stops after the segment that reaches max_postings.
+    std::vector<Document> FindTopDocuments(std::string_view raw_query,
+        const DocumentFilter& filter = DocumentFilter(DocumentStatus::ACTUAL),
+        size_t max_postings = std::numeric_limits<size_t>::max(),
+        ImpactSearchStats* stats = nullptr) const;
+
+    size_t GetPostingCount() const;
+
+private:
+    struct Segment {
+        uint8_t impact;
+        std::vector<int> document_ids;
+    };
+
+    const SearchServer& search_server_;
+    // Relevance of one impact quantum
+    double quantum_ = 0;
+    size_t posting_count_ = 0;
+    // Segments of every word in decreasing impact order, document ids ascending in each.
+    // Owns its words: the server's may move when it compacts its text storage
+    std::map<std::string, std::vector<Segment>, std::less<>> word_to_segments_;
+};
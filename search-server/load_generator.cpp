@@ -0,0 +1,406 @@
+// Closed-loop load generator: every worker thread sends its next request as soon as the previous
+// one is answered, against one SearchServer guarded by a readers-writer lock, the way a service
+// would share it. Reads are FindTopDocuments calls, writes are AddDocument and RemoveDocument in
+// equal shares, so the corpus size stays about the same. Terms and queries are Zipf-distributed.
+// Usage: search_load_generator [--seed N] [--documents N] [--concurrency 1,2,4,8]
+//                              [--duration-ms N] [--write-ratio X] [--query-pool N] [--zipf X]
+//                              [--batch-clients N] [--admission-target-us N] [--deadline-ms N]
+// Batch clients are extra workers that only read, as fast as they can, next to the workers of
+// every level. A positive --admission-target-us sends reads through an AdmissionController with
+// that latency target, batch reads at batch priority and the others with the given deadline.
+// Prints throughput and latency percentiles in microseconds for every concurrency level as
+// JSON, and the lowest level that reaches 95% of the best throughput. Reads rejected by
+// admission control are reported on their own and left out of the throughput.
+
+#include "admission_control.h"
+#include "search_metrics.h"
+#include "search_server.h"
+#include "synthetic_data.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using search_metrics::LatencyHistogram;
+
+namespace {
+
+struct LoadConfig {
+    uint32_t seed = 42;
+    int document_count = 10'000;
+    int dictionary_size = 20'000;
+    int max_document_words = 60;
+    int max_query_words = 4;
+    double zipf_exponent = 1.0;
+    double minus_prob = 0.1;
+    int query_pool_size = 10'000;
+    vector<int> concurrency_levels = { 1, 2, 4, 8, 16 };
+    int warmup_ms = 200;
+    int duration_ms = 2'000;
+    // Share of requests that modify the index
+    double write_ratio = 0.05;
+    int batch_clients = 0;
+    // 0 runs reads directly on the server
+    int admission_target_us = 0;
+    // Deadline of interactive reads under admission control, 0 for none
+    int deadline_ms = 0;
+};
+
+struct Workload {
+    vector<string> stop_words;
+    vector<string> documents;
+    // Texts of documents added during the run, used round robin
+    vector<string> new_documents;
+    vector<string> queries;
+};
+
+// The index as a service would hold it: queries share the lock, modifications take it alone
+struct SharedIndex {
+    explicit SharedIndex(const vector<string>& stop_words)
+        : search_server(stop_words) {
+    }
+
+    shared_mutex mutex;
+    // shared_mutex may let new readers in while a writer waits (glibc does), so back-to-back
+    // reads would starve the writers. A writer holds the turnstile while it waits, and readers
+    // pass through it before taking the lock.
+    std::mutex turnstile;
+    SearchServer search_server;
+    vector<int> live_document_ids;
+    int next_document_id = 0;
+};
+
+struct LevelResult {
+    int concurrency = 0;
+    double elapsed_seconds = 0;
+    LatencyHistogram reads;
+    LatencyHistogram writes;
+    LatencyHistogram batch_reads;
+    // Reads shed by admission control, with the time it took to shed them; not in reads
+    LatencyHistogram rejected_reads;
+    uint64_t rejected_batch_reads = 0;
+    // Reads answered with fewer results by admission control, counted in reads
+    uint64_t degraded_reads = 0;
+    uint64_t checksum = 0;
+
+    double GetThroughput() const {
+        return (reads.GetCount() + writes.GetCount()) / max(elapsed_seconds, 1e-9);
+    }
+};
+
+vector<int> ParseList(const string& text) {
+    vector<int> values;
+    stringstream stream(text);
+    string item;
+    while (getline(stream, item, ',')) {
+        values.push_back(stoi(item));
+    }
+    return values;
+}
+
+LoadConfig ParseArguments(int argc, char* argv[]) {
+    LoadConfig config;
+    for (int i = 1; i < argc; ++i) {
+        const string_view arg = argv[i];
+        if (i + 1 >= argc) {
+            throw invalid_argument("Missing value for "s + string(arg));
+        }
+        const string value = argv[++i];
+        if (arg == "--seed"sv) {
+            config.seed = static_cast<uint32_t>(stoul(value));
+        } else if (arg == "--documents"sv) {
+            config.document_count = stoi(value);
+        } else if (arg == "--concurrency"sv) {
+            config.concurrency_levels = ParseList(value);
+        } else if (arg == "--duration-ms"sv) {
+            config.duration_ms = max(1, stoi(value));
+        } else if (arg == "--write-ratio"sv) {
+            config.write_ratio = clamp(stod(value), 0.0, 1.0);
+        } else if (arg == "--query-pool"sv) {
+            config.query_pool_size = max(1, stoi(value));
+        } else if (arg == "--zipf"sv) {
+            config.zipf_exponent = stod(value);
+        } else if (arg == "--batch-clients"sv) {
+            config.batch_clients = max(0, stoi(value));
+        } else if (arg == "--admission-target-us"sv) {
+            config.admission_target_us = max(0, stoi(value));
+        } else if (arg == "--deadline-ms"sv) {
+            config.deadline_ms = max(0, stoi(value));
+        } else {
+            throw invalid_argument("Unknown argument "s + string(arg));
+        }
+    }
+    return config;
+}
+
+Workload GenerateWorkload(const LoadConfig& config) {
+    mt19937 generator(config.seed);
+    const auto dictionary = GenerateDictionary(generator, config.dictionary_size, 10);
+    const ZipfDistribution term_distribution(dictionary.size(), config.zipf_exponent);
+
+    Workload workload;
+    workload.stop_words.assign(dictionary.begin(), dictionary.begin() + 3);
+    workload.documents = GenerateZipfCorpus(generator, dictionary, term_distribution,
+        config.document_count, config.max_document_words);
+    workload.new_documents = GenerateZipfCorpus(generator, dictionary, term_distribution,
+        max(1, config.document_count / 10), config.max_document_words);
+    for (int i = 0; i < config.query_pool_size; ++i) {
+        const int word_count = 1 + static_cast<int>(generator() % config.max_query_words);
+        workload.queries.push_back(GenerateZipfText(generator, dictionary, term_distribution,
+            word_count, config.minus_prob));
+    }
+    return workload;
+}
+
+void FillIndex(SharedIndex& index, const Workload& workload) {
+    for (const string& document : workload.documents) {
+        const int document_id = index.next_document_id++;
+        index.search_server.AddDocument(document_id, document, DocumentStatus::ACTUAL, { document_id % 10 });
+        index.live_document_ids.push_back(document_id);
+    }
+}
+
+shared_lock<shared_mutex> LockForRead(SharedIndex& index) {
+    lock_guard pass(index.turnstile);
+    return shared_lock(index.mutex);
+}
+
+bool IsRejected(AdmissionOutcome outcome) {
+    return outcome == AdmissionOutcome::REJECTED_QUEUE_FULL || outcome == AdmissionOutcome::REJECTED_DEADLINE;
+}
+
+// Goes through admission control unless admission is nullptr, which then takes the index lock
+// only once the read has a slot (see MakeAdmission)
+SearchResponse RunRead(SharedIndex& index, AdmissionController* admission, const string& query,
+    RequestPriority priority, int deadline_ms) {
+    if (admission == nullptr) {
+        const auto lock = LockForRead(index);
+        SearchResponse response;
+        response.documents = index.search_server.FindTopDocuments(query);
+        return response;
+    }
+    SearchRequest request;
+    request.raw_query = query;
+    request.priority = priority;
+    if (deadline_ms > 0) {
+        request.deadline = chrono::steady_clock::now() + chrono::milliseconds(deadline_ms);
+    }
+    return admission->FindTopDocuments(request);
+}
+
+unique_ptr<AdmissionController> MakeAdmission(const LoadConfig& config, SharedIndex& index) {
+    if (config.admission_target_us == 0) {
+        return nullptr;
+    }
+    AdmissionOptions options;
+    options.target_latency = chrono::microseconds(config.admission_target_us);
+    // Reads waiting for a slot hold no lock, so writers never queue behind them
+    return make_unique<AdmissionController>(index.search_server, options, [&index](const function<void()>& run_query) {
+        const auto lock = LockForRead(index);
+        run_query();
+    });
+}
+
+// Returns the number of documents changed, which goes into the checksum
+size_t RunWrite(SharedIndex& index, const Workload& workload, mt19937& generator) {
+    lock_guard turnstile(index.turnstile);
+    unique_lock lock(index.mutex);
+    if (generator() % 2 == 0 || index.live_document_ids.empty()) {
+        const int document_id = index.next_document_id++;
+        const string& document = workload.new_documents[document_id % workload.new_documents.size()];
+        index.search_server.AddDocument(document_id, document, DocumentStatus::ACTUAL, { document_id % 10 });
+        index.live_document_ids.push_back(document_id);
+    } else {
+        const size_t position = generator() % index.live_document_ids.size();
+        index.search_server.RemoveDocument(index.live_document_ids[position]);
+        swap(index.live_document_ids[position], index.live_document_ids.back());
+        index.live_document_ids.pop_back();
+    }
+    return 1;
+}
+
+// Every level starts from a freshly built index, so earlier writes do not skew later levels
+LevelResult RunLevel(const LoadConfig& config, const Workload& workload, int concurrency) {
+    using Clock = chrono::steady_clock;
+    SharedIndex index(workload.stop_words);
+    FillIndex(index, workload);
+    const ZipfDistribution query_popularity(workload.queries.size(), config.zipf_exponent);
+    const unique_ptr<AdmissionController> admission = MakeAdmission(config, index);
+
+    atomic<bool> measuring = false;
+    atomic<bool> stopped = false;
+    vector<LatencyHistogram> reads(concurrency);
+    vector<LatencyHistogram> writes(concurrency);
+    vector<LatencyHistogram> batch_reads(config.batch_clients);
+    vector<LatencyHistogram> rejected_reads(concurrency);
+    vector<uint64_t> rejected_batch_reads(config.batch_clients, 0);
+    vector<uint64_t> degraded_reads(concurrency, 0);
+    vector<uint64_t> checksums(concurrency, 0);
+    vector<thread> workers;
+    for (int worker_index = 0; worker_index < concurrency; ++worker_index) {
+        workers.emplace_back([&, worker_index] {
+            mt19937 generator(config.seed + static_cast<uint32_t>(concurrency * 1'000 + worker_index));
+            while (!stopped.load(memory_order_relaxed)) {
+                const bool is_write = GenerateUnitDouble(generator) < config.write_ratio;
+                const auto start = Clock::now();
+                size_t result = 0;
+                AdmissionOutcome outcome = AdmissionOutcome::SERVED;
+                if (is_write) {
+                    result = RunWrite(index, workload, generator);
+                } else {
+                    const string& query = workload.queries[query_popularity(generator)];
+                    const SearchResponse response = RunRead(index, admission.get(), query,
+                        RequestPriority::INTERACTIVE, config.deadline_ms);
+                    result = response.documents.size();
+                    outcome = response.outcome;
+                }
+                const auto latency = chrono::duration_cast<chrono::nanoseconds>(Clock::now() - start).count();
+                if (measuring.load(memory_order_relaxed)) {
+                    auto& histograms = is_write ? writes : IsRejected(outcome) ? rejected_reads : reads;
+                    histograms[worker_index].Record(static_cast<uint64_t>(latency));
+                    checksums[worker_index] += result;
+                    degraded_reads[worker_index] += outcome == AdmissionOutcome::DEGRADED;
+                }
+            }
+        });
+    }
+    // Background load: reads back to back, without deadline, not part of the level's throughput
+    for (int client_index = 0; client_index < config.batch_clients; ++client_index) {
+        workers.emplace_back([&, client_index] {
+            mt19937 generator(config.seed + static_cast<uint32_t>(1'000'000 + client_index));
+            while (!stopped.load(memory_order_relaxed)) {
+                const string& query = workload.queries[query_popularity(generator)];
+                const auto start = Clock::now();
+                const SearchResponse response = RunRead(index, admission.get(), query, RequestPriority::BATCH, 0);
+                const auto latency = chrono::duration_cast<chrono::nanoseconds>(Clock::now() - start).count();
+                if (!measuring.load(memory_order_relaxed)) {
+                    continue;
+                }
+                if (IsRejected(response.outcome)) {
+                    ++rejected_batch_reads[client_index];
+                } else {
+                    batch_reads[client_index].Record(static_cast<uint64_t>(latency));
+                }
+            }
+        });
+    }
+
+    this_thread::sleep_for(chrono::milliseconds(config.warmup_ms));
+    const auto measure_start = Clock::now();
+    measuring.store(true);
+    this_thread::sleep_for(chrono::milliseconds(config.duration_ms));
+    measuring.store(false);
+    const auto measure_end = Clock::now();
+    stopped.store(true);
+    for (thread& worker : workers) {
+        worker.join();
+    }
+
+    LevelResult result;
+    result.concurrency = concurrency;
+    result.elapsed_seconds = chrono::duration<double>(measure_end - measure_start).count();
+    for (int worker_index = 0; worker_index < concurrency; ++worker_index) {
+        result.reads.Merge(reads[worker_index]);
+        result.writes.Merge(writes[worker_index]);
+        result.rejected_reads.Merge(rejected_reads[worker_index]);
+        result.degraded_reads += degraded_reads[worker_index];
+        result.checksum += checksums[worker_index];
+    }
+    for (int client_index = 0; client_index < config.batch_clients; ++client_index) {
+        result.batch_reads.Merge(batch_reads[client_index]);
+        result.rejected_batch_reads += rejected_batch_reads[client_index];
+    }
+    return result;
+}
+
+// Lowest concurrency that reaches 95% of the best throughput; more clients only add queueing
+int FindSaturationConcurrency(const vector<LevelResult>& results) {
+    double best_throughput = 0;
+    for (const LevelResult& result : results) {
+        best_throughput = max(best_throughput, result.GetThroughput());
+    }
+    for (const LevelResult& result : results) {
+        if (result.GetThroughput() >= 0.95 * best_throughput) {
+            return result.concurrency;
+        }
+    }
+    return 0;
+}
+
+void PrintLatencies(ostream& os, const string& prefix, const LatencyHistogram& histogram) {
+    os << ", \""s << prefix << "_count\": "s << histogram.GetCount()
+        << ", \""s << prefix << "_p50_us\": "s << histogram.GetValueAtPercentile(50) / 1000.0
+        << ", \""s << prefix << "_p99_us\": "s << histogram.GetValueAtPercentile(99) / 1000.0
+        << ", \""s << prefix << "_p999_us\": "s << histogram.GetValueAtPercentile(99.9) / 1000.0
+        << ", \""s << prefix << "_max_us\": "s << histogram.GetMax() / 1000.0;
+}
+
+void PrintJson(ostream& os, const LoadConfig& config, const vector<LevelResult>& results) {
+    os << "{\n"s;
+    os << "  \"seed\": "s << config.seed << ",\n"s;
+    os << "  \"documents\": "s << config.document_count << ",\n"s;
+    os << "  \"query_pool\": "s << config.query_pool_size << ",\n"s;
+    os << "  \"zipf_exponent\": "s << config.zipf_exponent << ",\n"s;
+    os << "  \"write_ratio\": "s << config.write_ratio << ",\n"s;
+    os << "  \"duration_ms\": "s << config.duration_ms << ",\n"s;
+    os << "  \"batch_clients\": "s << config.batch_clients << ",\n"s;
+    os << "  \"admission_target_us\": "s << config.admission_target_us << ",\n"s;
+    os << "  \"deadline_ms\": "s << config.deadline_ms << ",\n"s;
+    os << "  \"hardware_threads\": "s << thread::hardware_concurrency() << ",\n"s;
+    os << "  \"levels\": [\n"s;
+    os << fixed << setprecision(1);
+    for (size_t i = 0; i < results.size(); ++i) {
+        const LevelResult& result = results[i];
+        os << "    { \"concurrency\": "s << result.concurrency
+            << ", \"throughput_ops\": "s << result.GetThroughput();
+        PrintLatencies(os, "read"s, result.reads);
+        PrintLatencies(os, "write"s, result.writes);
+        if (config.batch_clients > 0) {
+            PrintLatencies(os, "batch_read"s, result.batch_reads);
+        }
+        if (config.admission_target_us > 0) {
+            PrintLatencies(os, "rejected_read"s, result.rejected_reads);
+            os << ", \"degraded_reads\": "s << result.degraded_reads;
+            if (config.batch_clients > 0) {
+                os << ", \"rejected_batch_reads\": "s << result.rejected_batch_reads;
+            }
+        }
+        os << ", \"checksum\": "s << result.checksum << " }"s
+            << (i + 1 < results.size() ? ","s : ""s) << '\n';
+    }
+    os << defaultfloat;
+    os << "  ],\n"s;
+    os << "  \"saturation_concurrency\": "s << FindSaturationConcurrency(results) << '\n';
+    os << "}"s << endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    try {
+        const LoadConfig config = ParseArguments(argc, argv);
+        const Workload workload = GenerateWorkload(config);
+        vector<LevelResult> results;
+        for (const int concurrency : config.concurrency_levels) {
+            results.push_back(RunLevel(config, workload, max(1, concurrency)));
+        }
+        PrintJson(cout, config, results);
+    } catch (const exception& e) {
+        cerr << "search_load_generator: "s << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
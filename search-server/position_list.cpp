@@ -0,0 +1,87 @@
+#include "position_list.h"
+
+#include <algorithm>
+
+using namespace std;
+
+void PositionList::Append(uint32_t position) {
+    uint32_t delta = count_ == 0 ? position : position - last_;
+    while (delta >= 0x80) {
+        bytes_.push_back(static_cast<uint8_t>(delta | 0x80));
+        delta >>= 7;
+    }
+    bytes_.push_back(static_cast<uint8_t>(delta));
+    last_ = position;
+    ++count_;
+}
+
+vector<uint32_t> PositionList::Decode() const {
+    vector<uint32_t> positions;
+    positions.reserve(count_);
+    uint32_t position = 0;
+    uint32_t delta = 0;
+    int shift = 0;
+    for (const uint8_t byte : bytes_) {
+        delta |= static_cast<uint32_t>(byte & 0x7F) << shift;
+        if (byte & 0x80) {
+            shift += 7;
+            continue;
+        }
+        position += delta;
+        positions.push_back(position);
+        delta = 0;
+        shift = 0;
+    }
+    return positions;
+}
+
+bool ContainsPhrase(const vector<const PositionList*>& lists) {
+    if (lists.empty()) {
+        return false;
+    }
+    vector<vector<uint32_t>> positions;
+    positions.reserve(lists.size());
+    for (const PositionList* list : lists) {
+        positions.push_back(list->Decode());
+    }
+    // Every candidate start only grows, so each list is walked once
+    vector<size_t> cursors(positions.size(), 0);
+    for (const uint32_t start : positions[0]) {
+        bool found = true;
+        for (size_t i = 1; i < positions.size() && found; ++i) {
+            const uint32_t target = start + static_cast<uint32_t>(i);
+            auto& cursor = cursors[i];
+            while (cursor < positions[i].size() && positions[i][cursor] < target) {
+                ++cursor;
+            }
+            if (cursor == positions[i].size()) {
+                return false;
+            }
+            found = positions[i][cursor] == target;
+        }
+        if (found) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ContainsNear(const PositionList& lhs, const PositionList& rhs, uint32_t max_distance) {
+    const auto lhs_positions = lhs.Decode();
+    const auto rhs_positions = rhs.Decode();
+    size_t i = 0;
+    size_t j = 0;
+    while (i < lhs_positions.size() && j < rhs_positions.size()) {
+        const uint32_t a = lhs_positions[i];
+        const uint32_t b = rhs_positions[j];
+        if ((a > b ? a - b : b - a) <= max_distance) {
+            return true;
+        }
+        if (a < b) {
+            ++i;
+        } else {
+            ++j;
+        }
+    }
+    return false;
+}
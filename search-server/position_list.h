@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Word positions of one posting, stored as LEB128 varints of the gaps between
+// consecutive positions: positions in ordinary text mostly take one byte each.
+class PositionList {
+public:
+    // Positions must be appended in increasing order
+    void Append(uint32_t position);
+
+    std::vector<uint32_t> Decode() const;
+
+    uint32_t GetCount() const {
+        return count_;
+    }
+
+    size_t GetEncodedSize() const {
+        return bytes_.size();
+    }
+
+    // Heap bytes held by the list, including unused capacity
+    size_t GetAllocatedSize() const {
+        return bytes_.capacity();
+    }
+
+    void ShrinkToFit() {
+        bytes_.shrink_to_fit();
+    }
+
+private:
+    std::vector<uint8_t> bytes_;
+    uint32_t last_ = 0;
+    uint32_t count_ = 0;
+};
+
+// True if the lists contain positions p, p + 1, ..., p + n - 1 respectively
+bool ContainsPhrase(const std::vector<const PositionList*>& lists);
+
+// True if some positions of the two lists are at most max_distance apart
+bool ContainsNear(const PositionList& lhs, const PositionList& rhs, uint32_t max_distance);
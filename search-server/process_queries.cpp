@@ -1,8 +1,40 @@
 #include "process_queries.h"
 
+#include <numeric>
+
+namespace {
+
+// Queries per parallel task in the shared traversal mode
+const size_t SHARED_TRAVERSAL_BLOCK_SIZE = 256;
+
+std::vector<std::vector<Document>> ProcessQueriesShared(
+    const SearchServer& search_server,
+    const std::vector<std::string_view>& queries) {
+
+    std::vector<std::vector<Document>> documents_lists(queries.size());
+    std::vector<size_t> blocks((queries.size() + SHARED_TRAVERSAL_BLOCK_SIZE - 1) / SHARED_TRAVERSAL_BLOCK_SIZE);
+    std::iota(blocks.begin(), blocks.end(), 0);
+    std::for_each(std::execution::par, blocks.cbegin(), blocks.cend(), [&](size_t block)
+        {
+            const size_t begin = block * SHARED_TRAVERSAL_BLOCK_SIZE;
+            const size_t end = std::min(queries.size(), begin + SHARED_TRAVERSAL_BLOCK_SIZE);
+            auto block_lists = search_server.FindTopDocumentsBatch({ queries.begin() + begin, queries.begin() + end });
+            std::move(block_lists.begin(), block_lists.end(), documents_lists.begin() + begin);
+        });
+
+    return documents_lists;
+}
+
+} // namespace
+
 std::vector<std::vector<Document>> ProcessQueries(
     const SearchServer& search_server,
-    const std::vector<std::string>& queries) {
+    const std::vector<std::string>& queries,
+    QueryBatchMode mode) {
+
+    if (mode == QueryBatchMode::SHARED_TRAVERSAL) {
+        return ProcessQueriesShared(search_server, { queries.begin(), queries.end() });
+    }
 
     std::vector<std::vector<Document>> documents_lists(queries.size());
     std::transform(std::execution::par, queries.cbegin(), queries.cend(), documents_lists.begin(), [&](const std::string_view query)
@@ -15,11 +47,12 @@ std::vector<std::vector<Document>> ProcessQueries(
 
 std::list<Document> ProcessQueriesJoined(
     const SearchServer& search_server,
-    const std::vector<std::string>& queries) {
+    const std::vector<std::string>& queries,
+    QueryBatchMode mode) {
 
     std::list<Document> result;
 
-    std::vector<std::vector<Document>> documents_lists = ProcessQueries(search_server, queries);
+    std::vector<std::vector<Document>> documents_lists = ProcessQueries(search_server, queries, mode);
 
     for (const auto& doc_list : documents_lists) {
 
@@ -31,7 +64,12 @@ std::list<Document> ProcessQueriesJoined(
 
 std::vector<std::vector<Document>> ProcessQueries(
     const SearchServer& search_server,
-    std::vector<std::string_view> queries) {
+    std::vector<std::string_view> queries,
+    QueryBatchMode mode) {
+
+    if (mode == QueryBatchMode::SHARED_TRAVERSAL) {
+        return ProcessQueriesShared(search_server, queries);
+    }
 
     std::vector<std::vector<Document>> documents_lists(queries.size());
     std::transform(std::execution::par, queries.cbegin(), queries.cend(), documents_lists.begin(), [&](auto query)
@@ -44,11 +82,12 @@ std::vector<std::vector<Document>> ProcessQueries(
 
 std::list<Document> ProcessQueriesJoined(
     const SearchServer& search_server,
-    std::vector<std::string_view> queries) {
+    std::vector<std::string_view> queries,
+    QueryBatchMode mode) {
 
     std::list<Document> result;
 
-    std::vector<std::vector<Document>> documents_lists = ProcessQueries(search_server, queries);
+    std::vector<std::vector<Document>> documents_lists = ProcessQueries(search_server, queries, mode);
 
     for (const auto& doc_list : documents_lists) {
 
@@ -1,18 +1,30 @@
 #pragma once
 #include "search_server.h"
 
+enum class QueryBatchMode {
+    // Every query runs on its own, queries in parallel
+    INDEPENDENT,
+    // Groups of queries share the traversal of their posting lists (SearchServer::FindTopDocumentsBatch),
+    // groups in parallel; results are identical, memory traffic is lower for overlapping queries
+    SHARED_TRAVERSAL,
+};
+
 std::vector<std::vector<Document>> ProcessQueries(
     const SearchServer& search_server,
-    const std::vector<std::string>& queries);
+    const std::vector<std::string>& queries,
+    QueryBatchMode mode = QueryBatchMode::INDEPENDENT);
 
 std::list<Document> ProcessQueriesJoined(
     const SearchServer& search_server,
-    const std::vector<std::string>& queries);
+    const std::vector<std::string>& queries,
+    QueryBatchMode mode = QueryBatchMode::INDEPENDENT);
 
 std::vector<std::vector<Document>> ProcessQueries(
     const SearchServer& search_server,
-    std::vector<std::string_view> queries);
+    std::vector<std::string_view> queries,
+    QueryBatchMode mode = QueryBatchMode::INDEPENDENT);
 
 std::list<Document> ProcessQueriesJoined(
     const SearchServer& search_server,
-    std::vector<std::string_view> queries);
\ No newline at end of file
+    std::vector<std::string_view> queries,
+    QueryBatchMode mode = QueryBatchMode::INDEPENDENT);
\ No newline at end of file
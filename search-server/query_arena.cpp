@@ -0,0 +1,99 @@
+#include "query_arena.h"
+
+#include <algorithm>
+#include <new>
+
+using namespace std;
+
+namespace {
+
+thread_local int arena_scope_depth = 0;
+
+} // namespace
+
+QueryArena::QueryArena(size_t initial_capacity)
+    : block_(make_unique<byte[]>(initial_capacity))
+    , capacity_(initial_capacity) {
+}
+
+QueryArena::~QueryArena() {
+    ReleaseSpills();
+}
+
+void QueryArena::Reset() {
+    high_water_mark_ = max(high_water_mark_, requested_);
+    if (!spills_.empty()) {
+        ReleaseSpills();
+        // Half again as much as the mark, so small fluctuations do not spill again
+        capacity_ = high_water_mark_ + high_water_mark_ / 2;
+        block_ = make_unique<byte[]>(capacity_);
+    }
+    used_ = 0;
+    requested_ = 0;
+}
+
+size_t QueryArena::GetCapacity() const {
+    return capacity_;
+}
+
+size_t QueryArena::GetHighWaterMark() const {
+    return max(high_water_mark_, requested_);
+}
+
+size_t QueryArena::GetSpillCount() const {
+    return spill_count_;
+}
+
+void QueryArena::ReleaseSpills() {
+    for (const Spill& spill : spills_) {
+        ::operator delete(spill.data, spill.bytes, align_val_t(spill.alignment));
+    }
+    spills_.clear();
+}
+
+void* QueryArena::do_allocate(size_t bytes, size_t alignment) {
+    // make_unique<byte[]> guarantees the default new alignment for the block start
+    const size_t offset = (used_ + alignment - 1) / alignment * alignment;
+    if (alignment <= __STDCPP_DEFAULT_NEW_ALIGNMENT__ && offset + bytes <= capacity_) {
+        requested_ += offset + bytes - used_;
+        used_ = offset + bytes;
+        return block_.get() + offset;
+    }
+    requested_ += bytes + alignment;
+    void* const data = ::operator new(bytes, align_val_t(alignment));
+    spills_.push_back({ data, bytes, alignment });
+    ++spill_count_;
+    return data;
+}
+
+void QueryArena::do_deallocate(void*, size_t, size_t) {
+}
+
+bool QueryArena::do_is_equal(const pmr::memory_resource& other) const noexcept {
+    return this == &other;
+}
+
+QueryArenaScope::QueryArenaScope()
+    : arena_(GetThreadQueryArena()) {
+    ++arena_scope_depth;
+}
+
+QueryArenaScope::~QueryArenaScope() {
+    if (--arena_scope_depth == 0) {
+        arena_.Reset();
+    }
+}
+
+QueryArena& QueryArenaScope::GetArena() const {
+    return arena_;
+}
+
+QueryArena& GetThreadQueryArena() {
+    thread_local QueryArena arena;
+    return arena;
+}
+
+pmr::memory_resource* GetThreadParallelQueryResource() {
+    thread_local pmr::synchronized_pool_resource resource;
+    return &resource;
+}
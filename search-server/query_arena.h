@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+// Bump allocator for the temporaries of one query. Memory is never reused within a query
+// and is rewound all at once by Reset(). A query that outgrows the block spills to the
+// global heap, and the next Reset() enlarges the block to the high-water mark, so a
+// steady workload stops allocating after warm-up.
+// Not thread-safe: every thread has its own arena, see QueryArenaScope.
+class QueryArena : public std::pmr::memory_resource {
+public:
+    static constexpr size_t DEFAULT_CAPACITY = 64 << 10;
+
+    explicit QueryArena(size_t initial_capacity = DEFAULT_CAPACITY);
+    QueryArena(const QueryArena&) = delete;
+    QueryArena& operator=(const QueryArena&) = delete;
+    ~QueryArena() override;
+
+    void Reset();
+
+    size_t GetCapacity() const;
+    // Largest number of bytes requested between two resets
+    size_t GetHighWaterMark() const;
+    // Allocations that did not fit into the block since construction
+    size_t GetSpillCount() const;
+
+private:
+    struct Spill {
+        void* data;
+        size_t bytes;
+        size_t alignment;
+    };
+
+    std::unique_ptr<std::byte[]> block_;
+    size_t capacity_ = 0;
+    size_t used_ = 0;
+    size_t requested_ = 0;
+    size_t high_water_mark_ = 0;
+    size_t spill_count_ = 0;
+    std::vector<Spill> spills_;
+
+    void ReleaseSpills();
+
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    // Monotonic: memory comes back only on Reset()
+    void do_deallocate(void* data, size_t bytes, size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+};
+
+// Hands the query path the calling thread's arena. Scopes nest, e.g. when a parallel
+// algorithm runs another query on the same thread; only the outermost one resets the arena.
+class QueryArenaScope {
+public:
+    QueryArenaScope();
+    QueryArenaScope(const QueryArenaScope&) = delete;
+    QueryArenaScope& operator=(const QueryArenaScope&) = delete;
+    ~QueryArenaScope();
+
+    QueryArena& GetArena() const;
+
+private:
+    QueryArena& arena_;
+};
+
+QueryArena& GetThreadQueryArena();
+
+// Resource for temporaries that parallel tasks allocate and free from several threads:
+// a synchronized pool owned by the calling thread that keeps its memory between queries
+std::pmr::memory_resource* GetThreadParallelQueryResource();
@@ -0,0 +1,59 @@
+#include "query_plan.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <thread>
+
+using namespace std;
+
+double QueryCostModel::EstimateSequential(size_t posting_count, size_t slot_count) const {
+    return sequential_ns_per_posting * posting_count
+        + min(sequential_ns_per_slot * slot_count, sequential_ns_per_touched_slot * posting_count);
+}
+
+bool QueryCostModel::IsSparseCheaper(size_t posting_count, size_t slot_count) const {
+    return sequential_ns_per_touched_slot * posting_count < sequential_ns_per_slot * slot_count;
+}
+
+void QueryCostModel::ParallelTasks::Add(size_t task_posting_count) {
+    posting_count += task_posting_count;
+    ++task_count;
+    max_task_posting_count = max(max_task_posting_count, task_posting_count);
+}
+
+double QueryCostModel::EstimateParallel(const ParallelTasks& terms, const ParallelTasks& wildcards) const {
+    const size_t threads = thread_count > 0 ? thread_count : max(1u, thread::hardware_concurrency());
+    const auto estimate_loop = [threads](const ParallelTasks& tasks) {
+        if (tasks.task_count == 0) {
+            return 0.0;
+        }
+        const double even_share = static_cast<double>(tasks.posting_count) / min(threads, tasks.task_count);
+        return max(static_cast<double>(tasks.max_task_posting_count), even_share);
+    };
+    return parallel_overhead_ns + parallel_ns_per_posting * (estimate_loop(terms) + estimate_loop(wildcards));
+}
+
+ostream& operator<<(ostream& os, const QueryPlan& plan) {
+    for (const QueryPlan::Term& term : plan.terms) {
+        os << "term "s << term.word << ": postings = "s << term.posting_count
+            << ", weight = "s << term.weight << '\n';
+    }
+    for (const QueryPlan::Term& wildcard : plan.wildcards) {
+        os << "wildcard "s << wildcard.word << ": postings = "s << wildcard.posting_count << '\n';
+    }
+    for (const QueryPlan::Term& required_word : plan.required_words) {
+        os << "required "s << required_word.word << ": postings = "s << required_word.posting_count << '\n';
+    }
+    os << "excluded documents: "s << plan.excluded_document_count << '\n';
+    const ios_base::fmtflags flags = os.flags();
+    const streamsize precision = os.precision();
+    os << fixed << setprecision(1)
+        << "cost: sequential = "s << plan.sequential_cost_ns / 1000.0 << " us"s
+        << ", parallel = "s << plan.parallel_cost_ns / 1000.0 << " us"s << '\n';
+    os.flags(flags);
+    os.precision(precision);
+    const string execution = !plan.required_words.empty() ? "conjunctive"s
+        : plan.parallel ? "parallel"s : plan.sparse ? "sequential (sparse)"s : "sequential"s;
+    os << "execution: "s << execution << '\n';
+    return os;
+}
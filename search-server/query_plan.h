@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Linear cost model of the two ways to score a query, in nanoseconds. The defaults were
+// measured on a synthetic 20 000-document corpus; call SearchServer::SetQueryCostModel
+// with figures measured on the target machine, e.g. by search_benchmark --calibrate.
+struct QueryCostModel {
+    // Sequential path: reading a posting and collecting its document
+    double sequential_ns_per_posting = 450.0;
+    // Sequential path: clearing and scanning one slot of the dense score buffer
+    double sequential_ns_per_slot = 1.5;
+    // Sequential path with few postings for the slot count: sorting the touched slots and
+    // resetting only them, per posting, instead of the whole buffer
+    double sequential_ns_per_touched_slot = 10.0;
+    // Parallel path: the same work through a ConcurrentMap, on one thread
+    double parallel_ns_per_posting = 1'000.0;
+    // Spawning the tasks and collecting the map
+    double parallel_overhead_ns = 20'000.0;
+    // 0 means std::thread::hardware_concurrency()
+    size_t thread_count = 0;
+
+    // Tasks of one parallel loop: the parallel path runs a task per term, then one per plus wildcard
+    struct ParallelTasks {
+        size_t posting_count = 0;
+        size_t task_count = 0;
+        size_t max_task_posting_count = 0;
+
+        void Add(size_t task_posting_count);
+    };
+
+    // Of the cheaper collection, see IsSparseCheaper
+    double EstimateSequential(size_t posting_count, size_t slot_count) const;
+    // Whether the sequential path should collect the touched slots rather than scan the buffer
+    bool IsSparseCheaper(size_t posting_count, size_t slot_count) const;
+    // Each loop lasts as long as its largest task or an even share of its postings per
+    // thread, whichever is longer, so a one-term query gains nothing from the threads
+    double EstimateParallel(const ParallelTasks& terms, const ParallelTasks& wildcards) const;
+};
+
+// How SearchServer executes a query under a parallel policy, see SearchServer::ExplainQuery
+struct QueryPlan {
+    struct Term {
+        std::string word;
+        size_t posting_count = 0;
+        // 1 for a query word, 1 / (1 + edit distance) for a fuzzy expansion
+        double weight = 1.0;
+    };
+
+    // Scoring order, rarest first; words missing from the index are dropped
+    std::vector<Term> terms;
+    // Plus wildcards with the postings of all their expansions
+    std::vector<Term> wildcards;
+    // Required words, shortest posting list first. A query with any of them is answered by
+    // intersecting their postings, sequentially.
+    std::vector<Term> required_words;
+    // Documents of minus words and minus wildcards, excluded before scoring
+    size_t excluded_document_count = 0;
+    size_t posting_count = 0;
+    double sequential_cost_ns = 0;
+    double parallel_cost_ns = 0;
+    bool parallel = false;
+    // The sequential execution collects the touched slots instead of scanning every slot
+    bool sparse = false;
+};
+
+// One line per term followed by the cost estimates and the chosen execution
+std::ostream& operator<<(std::ostream& os, const QueryPlan& plan);
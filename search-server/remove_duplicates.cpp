@@ -3,21 +3,17 @@
 // O(wN(logN+logW)), где w — максимальное количество слов в документе
 void RemoveDuplicates(SearchServer &search_server)
 {
-    std::set<std::set<std::string>> words_to_docs;
+    std::set<std::set<std::string_view>> words_to_docs;
     std::set<int> docs_to_del;
 
     for (int doc_id : search_server)
     {                                                                     // N
         const auto &word_freq = search_server.GetWordFrequencies(doc_id); // N*logN
-        std::vector<std::string> just_words;
-        std::vector<int> temp_;
-        temp_.reserve(word_freq.size());
-        std::transform(word_freq.begin(), word_freq.end(), temp_.begin(), [&just_words](const auto &map_elem)
-                           {
-                                just_words.push_back(map_elem.first);
-                                return 0;
-                            });
-        std::set set_key(just_words.begin(), just_words.end());
+        std::set<std::string_view> set_key;
+        for (const auto &[word, freq] : word_freq)
+        {
+            set_key.insert(word);
+        }
 
         if (words_to_docs.count(set_key))
         {
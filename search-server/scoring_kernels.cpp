@@ -0,0 +1,210 @@
+#include "scoring_kernels.h"
+
+#include <algorithm>
+#include <vector>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define SCORING_KERNELS_AVX2
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+#ifdef SCORING_KERNELS_AVX2
+// AVX2 has a gather but no scatter: four scores are gathered and updated with one FMA,
+// then stored back one by one, which is safe because the slots are distinct
+__attribute__((target("avx2,fma")))
+void AccumulateScoresAvx2(const int* slots, const float* term_freqs, size_t count,
+    double inverse_document_freq, double* scores) {
+    const __m256d idf = _mm256_set1_pd(inverse_document_freq);
+    alignas(32) double updated[4];
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i index = _mm_loadu_si128(reinterpret_cast<const __m128i*>(slots + i));
+        const __m256d term_freq = _mm256_cvtps_pd(_mm_loadu_ps(term_freqs + i));
+        // The masked form with a zeroed source: the plain one reads its undefined source register
+        const __m256d score = _mm256_mask_i32gather_pd(_mm256_setzero_pd(), scores, index,
+            _mm256_castsi256_pd(_mm256_set1_epi64x(-1)), sizeof(double));
+        _mm256_store_pd(updated, _mm256_fmadd_pd(term_freq, idf, score));
+        scores[slots[i]] = updated[0];
+        scores[slots[i + 1]] = updated[1];
+        scores[slots[i + 2]] = updated[2];
+        scores[slots[i + 3]] = updated[3];
+    }
+    AccumulateScoresScalar(slots + i, term_freqs + i, count - i, inverse_document_freq, scores);
+}
+#endif
+
+void AccumulateBatchScoresScalar(const int* slots, const float* term_freqs, size_t count,
+    const size_t* columns, const double* inverse_document_freqs, size_t column_count,
+    size_t stride, double* scores) {
+    for (size_t i = 0; i < count; ++i) {
+        double* const slot_scores = scores + static_cast<size_t>(slots[i]) * stride;
+        for (size_t j = 0; j < column_count; ++j) {
+            slot_scores[columns[j]] += term_freqs[i] * inverse_document_freqs[j];
+        }
+    }
+}
+
+#ifdef SCORING_KERNELS_AVX2
+// Mirrors AccumulateScoresAvx2: fused multiply-add for whole groups of four postings and
+// the separately rounded scalar loop for the tail
+__attribute__((target("avx2,fma")))
+void AccumulateBatchScoresFma(const int* slots, const float* term_freqs, size_t count,
+    const size_t* columns, const double* inverse_document_freqs, size_t column_count,
+    size_t stride, double* scores) {
+    const size_t vector_count = count & ~size_t{ 3 };
+    for (size_t i = 0; i < vector_count; ++i) {
+        double* const slot_scores = scores + static_cast<size_t>(slots[i]) * stride;
+        const double term_freq = term_freqs[i];
+        for (size_t j = 0; j < column_count; ++j) {
+            slot_scores[columns[j]] = __builtin_fma(term_freq, inverse_document_freqs[j], slot_scores[columns[j]]);
+        }
+    }
+    AccumulateBatchScoresScalar(slots + vector_count, term_freqs + vector_count, count - vector_count,
+        columns, inverse_document_freqs, column_count, stride, scores);
+}
+#endif
+
+using AccumulateScoresFunction = void (*)(const int*, const float*, size_t, double, double*);
+
+AccumulateScoresFunction SelectKernel() {
+#ifdef SCORING_KERNELS_AVX2
+    // Runs during static initialization, possibly before the CPU model is set up
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return AccumulateScoresAvx2;
+    }
+#endif
+    return AccumulateScoresScalar;
+}
+
+// Chosen once at startup
+const AccumulateScoresFunction accumulate_scores = SelectKernel();
+
+struct ScoreBuffer {
+    vector<double> scores;
+    // Every score is -0.0
+    bool is_clean = true;
+};
+
+ScoreBuffer& GetScoreBuffer() {
+    thread_local ScoreBuffer buffer;
+    return buffer;
+}
+
+} // namespace
+
+void AccumulateScoresScalar(const int* slots, const float* term_freqs, size_t count,
+    double inverse_document_freq, double* scores) {
+    for (size_t i = 0; i < count; ++i) {
+        scores[slots[i]] += term_freqs[i] * inverse_document_freq;
+    }
+}
+
+void AccumulateScores(const int* slots, const float* term_freqs, size_t count,
+    double inverse_document_freq, double* scores) {
+    accumulate_scores(slots, term_freqs, count, inverse_document_freq, scores);
+}
+
+bool HasVectorScoring() {
+    return accumulate_scores != AccumulateScoresScalar;
+}
+
+void AccumulateBatchScores(const int* slots, const float* term_freqs, size_t count,
+    const size_t* columns, const double* inverse_document_freqs, size_t column_count,
+    size_t stride, double* scores) {
+#ifdef SCORING_KERNELS_AVX2
+    if (HasVectorScoring()) {
+        AccumulateBatchScoresFma(slots, term_freqs, count, columns, inverse_document_freqs, column_count,
+            stride, scores);
+        return;
+    }
+#endif
+    AccumulateBatchScoresScalar(slots, term_freqs, count, columns, inverse_document_freqs, column_count,
+        stride, scores);
+}
+
+size_t GallopToSlot(const int* slots, size_t begin, size_t count, int slot) {
+    if (begin >= count || slots[begin] >= slot) {
+        return begin;
+    }
+    // slots[low] < slot holds throughout
+    size_t low = begin;
+    size_t step = 1;
+    while (low + step < count && slots[low + step] < slot) {
+        low += step;
+        step *= 2;
+    }
+    const size_t high = min(low + step, count);
+    return static_cast<size_t>(lower_bound(slots + low + 1, slots + high, slot) - slots);
+}
+
+size_t IntersectSlots(const int* lhs, size_t lhs_count, const int* rhs, size_t rhs_count, int* output) {
+    size_t output_count = 0;
+    size_t position = 0;
+    for (size_t i = 0; i < lhs_count; ++i) {
+        position = GallopToSlot(rhs, position, rhs_count, lhs[i]);
+        if (position == rhs_count) {
+            break;
+        }
+        if (rhs[position] == lhs[i]) {
+            output[output_count++] = lhs[i];
+        }
+    }
+    return output_count;
+}
+
+size_t SubtractSlots(const int* lhs, size_t lhs_count, const int* rhs, size_t rhs_count, int* output) {
+    size_t output_count = 0;
+    size_t position = 0;
+    for (size_t i = 0; i < lhs_count; ++i) {
+        position = GallopToSlot(rhs, position, rhs_count, lhs[i]);
+        if (position == rhs_count || rhs[position] != lhs[i]) {
+            output[output_count++] = lhs[i];
+        }
+    }
+    return output_count;
+}
+
+void AccumulateMatchedScores(const int* slots, size_t count, const int* posting_slots, const float* term_freqs,
+    size_t posting_count, double inverse_document_freq, double* scores) {
+    size_t position = 0;
+    for (size_t i = 0; i < count; ++i) {
+        position = GallopToSlot(posting_slots, position, posting_count, slots[i]);
+        if (position == posting_count) {
+            return;
+        }
+        if (posting_slots[position] == slots[i]) {
+            scores[i] += term_freqs[position] * inverse_document_freq;
+        }
+    }
+}
+
+double* TakeScoreBuffer(size_t slot_count) {
+    ScoreBuffer& buffer = GetScoreBuffer();
+    if (!buffer.is_clean) {
+        fill(buffer.scores.begin(), buffer.scores.end(), -0.0);
+    }
+    if (buffer.scores.size() < slot_count) {
+        buffer.scores.resize(slot_count, -0.0);
+    }
+    buffer.is_clean = false;
+    return buffer.scores.data();
+}
+
+void ReleaseScoreBuffer(const int* slots, size_t count) {
+    ScoreBuffer& buffer = GetScoreBuffer();
+    for (size_t i = 0; i < count; ++i) {
+        buffer.scores[slots[i]] = -0.0;
+    }
+    buffer.is_clean = true;
+}
+
+void ReleaseScoreBuffer(size_t slot_count) {
+    ScoreBuffer& buffer = GetScoreBuffer();
+    fill(buffer.scores.begin(), buffer.scores.begin() + min(slot_count, buffer.scores.size()), -0.0);
+    buffer.is_clean = true;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+
+// Innermost scoring loop of sequential queries. Scores are kept in a dense buffer indexed
+// by document slot; every slot starts at -0.0, and adding a non-negative contribution
+// clears the sign bit, so the touched slots are exactly those with a clear sign bit.
+
+// scores[slots[i]] += term_freqs[i] * inverse_document_freq for every i.
+// Slots must be distinct within one call, as they are in the postings of one word.
+// Uses the AVX2 gather kernel when the CPU supports it and the scalar loop otherwise.
+void AccumulateScores(const int* slots, const float* term_freqs, size_t count,
+    double inverse_document_freq, double* scores);
+void AccumulateScoresScalar(const int* slots, const float* term_freqs, size_t count,
+    double inverse_document_freq, double* scores);
+bool HasVectorScoring();
+
+// Shared traversal of one posting list for several queries of a batch. The scores of a
+// batch are interleaved: the score of column c for a slot is scores[slot * stride + c].
+// For every i and j: scores[slots[i] * stride + columns[j]] += term_freqs[i] * inverse_document_freqs[j],
+// rounded exactly as AccumulateScores would round it in a buffer of its own.
+void AccumulateBatchScores(const int* slots, const float* term_freqs, size_t count,
+    const size_t* columns, const double* inverse_document_freqs, size_t column_count,
+    size_t stride, double* scores);
+
+// Sorted slot lists of very different lengths are combined by galloping: from the current
+// position the step doubles until it passes the target and a binary search finishes, so
+// a probe costs O(log distance) instead of a scan of everything in between.
+
+// Index of the first slots[i] >= slot with begin <= i < count, or count
+size_t GallopToSlot(const int* slots, size_t begin, size_t count, int slot);
+// Writes the slots present in both ascending lists to output and returns their number.
+// lhs drives, so it should be the shorter list; output may be lhs itself.
+size_t IntersectSlots(const int* lhs, size_t lhs_count, const int* rhs, size_t rhs_count, int* output);
+// Same, but keeps the slots of lhs that are absent from rhs
+size_t SubtractSlots(const int* lhs, size_t lhs_count, const int* rhs, size_t rhs_count, int* output);
+// scores[i] += term_freqs[j] * inverse_document_freq for every slots[i] == posting_slots[j];
+// both slot lists are ascending, the postings are galloped through
+void AccumulateMatchedScores(const int* slots, size_t count, const int* posting_slots, const float* term_freqs,
+    size_t posting_count, double inverse_document_freq, double* scores);
+
+// Thread-local buffer of at least slot_count untouched (-0.0) scores, reused between queries.
+// The query hands it back with ReleaseScoreBuffer, which resets only what it names; a buffer
+// taken again without that, e.g. after an exception, is cleared in full.
+double* TakeScoreBuffer(size_t slot_count);
+// Resets the listed slots, or the first slot_count, to -0.0
+void ReleaseScoreBuffer(const int* slots, size_t count);
+void ReleaseScoreBuffer(size_t slot_count);
@@ -0,0 +1,226 @@
+#include "search_metrics.h"
+
+#include <iomanip>
+
+using namespace std;
+
+namespace search_metrics {
+
+namespace {
+
+int GetHighestBit(uint64_t value) {
+    int bit = 0;
+    for (int step = 32; step > 0; step /= 2) {
+        if (value >> step) {
+            value >>= step;
+            bit += step;
+        }
+    }
+    return bit;
+}
+
+double ToMicroseconds(uint64_t nanoseconds) {
+    return nanoseconds / 1000.0;
+}
+
+} // namespace
+
+const char* GetStageName(Stage stage) {
+    switch (stage) {
+    case Stage::PARSE:
+        return "parse";
+    case Stage::IDF:
+        return "idf";
+    case Stage::POSTINGS:
+        return "postings";
+    case Stage::MINUS_WORDS:
+        return "minus_words";
+    case Stage::SORT_TOP_K:
+        return "sort_top_k";
+    default:
+        return "unknown";
+    }
+}
+
+const char* GetCounterName(Counter counter) {
+    switch (counter) {
+    case Counter::QUERIES:
+        return "queries";
+    case Counter::POSTINGS_SCANNED:
+        return "postings_scanned";
+    default:
+        return "unknown";
+    }
+}
+
+size_t LatencyHistogram::GetBucketIndex(uint64_t value) {
+    if (value < SUB_BUCKET_COUNT) {
+        return value;
+    }
+    const int shift = GetHighestBit(value) - SUB_BUCKET_BITS;
+    return (shift + 1) * SUB_BUCKET_COUNT + ((value >> shift) - SUB_BUCKET_COUNT);
+}
+
+uint64_t LatencyHistogram::GetBucketUpperBound(size_t index) {
+    if (index < SUB_BUCKET_COUNT) {
+        return index;
+    }
+    const int shift = static_cast<int>(index / SUB_BUCKET_COUNT) - 1;
+    const uint64_t lower = (index % SUB_BUCKET_COUNT + SUB_BUCKET_COUNT) << shift;
+    return lower + ((uint64_t{ 1 } << shift) - 1);
+}
+
+void LatencyHistogram::Record(uint64_t value) {
+    ++counts_[GetBucketIndex(value)];
+    ++count_;
+    sum_ += value;
+    max_ = max(max_, value);
+}
+
+void LatencyHistogram::AddToBucket(size_t index, uint64_t count) {
+    counts_[index] += count;
+    count_ += count;
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other) {
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+        counts_[i] += other.counts_[i];
+    }
+    count_ += other.count_;
+    sum_ += other.sum_;
+    max_ = max(max_, other.max_);
+}
+
+uint64_t LatencyHistogram::GetCount() const {
+    return count_;
+}
+
+uint64_t LatencyHistogram::GetMax() const {
+    return max_;
+}
+
+double LatencyHistogram::GetMean() const {
+    return count_ == 0 ? 0.0 : static_cast<double>(sum_) / count_;
+}
+
+uint64_t LatencyHistogram::GetValueAtPercentile(double percentile) const {
+    if (count_ == 0) {
+        return 0;
+    }
+    const double clamped = min(max(percentile, 0.0), 100.0);
+    const uint64_t rank = max<uint64_t>(1, static_cast<uint64_t>(clamped / 100.0 * count_ + 0.5));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+        seen += counts_[i];
+        if (seen >= rank) {
+            return min(GetBucketUpperBound(i), max_);
+        }
+    }
+    return max_;
+}
+
+void LatencyHistogram::SetSum(uint64_t sum) {
+    sum_ = sum;
+}
+
+void LatencyHistogram::SetMax(uint64_t max) {
+    max_ = max;
+}
+
+ostream& operator<<(ostream& os, const MetricsSnapshot& snapshot) {
+    os << fixed << setprecision(3);
+    for (size_t i = 0; i < STAGE_COUNT; ++i) {
+        const LatencyHistogram& histogram = snapshot.stages[i];
+        os << GetStageName(static_cast<Stage>(i))
+            << ": count = "s << histogram.GetCount()
+            << ", mean = "s << ToMicroseconds(static_cast<uint64_t>(histogram.GetMean())) << " us"s
+            << ", p50 = "s << ToMicroseconds(histogram.GetValueAtPercentile(50.0)) << " us"s
+            << ", p90 = "s << ToMicroseconds(histogram.GetValueAtPercentile(90.0)) << " us"s
+            << ", p99 = "s << ToMicroseconds(histogram.GetValueAtPercentile(99.0)) << " us"s
+            << ", p999 = "s << ToMicroseconds(histogram.GetValueAtPercentile(99.9)) << " us"s
+            << ", max = "s << ToMicroseconds(histogram.GetMax()) << " us"s << '\n';
+    }
+    for (size_t i = 0; i < COUNTER_COUNT; ++i) {
+        os << GetCounterName(static_cast<Counter>(i)) << ": "s << snapshot.counters[i] << '\n';
+    }
+    os << defaultfloat;
+    return os;
+}
+
+MetricsRegistry& MetricsRegistry::Instance() {
+    static MetricsRegistry registry;
+    return registry;
+}
+
+MetricsRegistry::ThreadSlot& MetricsRegistry::GetLocalSlot() {
+    // Slots are owned by the registry and outlive their threads, so the data of
+    // finished worker threads still shows up in snapshots
+    thread_local ThreadSlot* slot = [this] {
+        lock_guard guard(mutex_);
+        slots_.push_back(make_unique<ThreadSlot>());
+        return slots_.back().get();
+    }();
+    return *slot;
+}
+
+void MetricsRegistry::Record(Stage stage, uint64_t nanoseconds) {
+    StageSlot& stage_slot = GetLocalSlot().stages[static_cast<size_t>(stage)];
+    auto& bucket = stage_slot.buckets[LatencyHistogram::GetBucketIndex(nanoseconds)];
+    bucket.store(bucket.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    stage_slot.sum.store(stage_slot.sum.load(memory_order_relaxed) + nanoseconds, memory_order_relaxed);
+    if (stage_slot.max.load(memory_order_relaxed) < nanoseconds) {
+        stage_slot.max.store(nanoseconds, memory_order_relaxed);
+    }
+}
+
+void MetricsRegistry::Add(Counter counter, uint64_t value) {
+    auto& slot_counter = GetLocalSlot().counters[static_cast<size_t>(counter)];
+    slot_counter.store(slot_counter.load(memory_order_relaxed) + value, memory_order_relaxed);
+}
+
+MetricsSnapshot MetricsRegistry::Snapshot() const {
+    MetricsSnapshot snapshot;
+    lock_guard guard(mutex_);
+    for (const auto& slot : slots_) {
+        for (size_t stage = 0; stage < STAGE_COUNT; ++stage) {
+            const StageSlot& stage_slot = slot->stages[stage];
+            LatencyHistogram histogram;
+            for (size_t i = 0; i < LatencyHistogram::BUCKET_COUNT; ++i) {
+                const uint64_t count = stage_slot.buckets[i].load(memory_order_relaxed);
+                if (count > 0) {
+                    histogram.AddToBucket(i, count);
+                }
+            }
+            histogram.SetSum(stage_slot.sum.load(memory_order_relaxed));
+            histogram.SetMax(stage_slot.max.load(memory_order_relaxed));
+            snapshot.stages[stage].Merge(histogram);
+        }
+        for (size_t i = 0; i < COUNTER_COUNT; ++i) {
+            snapshot.counters[i] += slot->counters[i].load(memory_order_relaxed);
+        }
+    }
+    return snapshot;
+}
+
+void MetricsRegistry::Dump(ostream& os) const {
+    os << Snapshot();
+}
+
+// Not synchronized with concurrent recording: a value recorded while resetting may be lost
+void MetricsRegistry::Reset() {
+    lock_guard guard(mutex_);
+    for (const auto& slot : slots_) {
+        for (StageSlot& stage_slot : slot->stages) {
+            for (auto& bucket : stage_slot.buckets) {
+                bucket.store(0, memory_order_relaxed);
+            }
+            stage_slot.sum.store(0, memory_order_relaxed);
+            stage_slot.max.store(0, memory_order_relaxed);
+        }
+        for (auto& counter : slot->counters) {
+            counter.store(0, memory_order_relaxed);
+        }
+    }
+}
+
+} // namespace search_metrics
@@ -0,0 +1,155 @@
+#pragma once
+
+#include "log_duration.h"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Per-stage query latency metrics.
+// Recording is compiled in only when SEARCH_SERVER_METRICS is defined; otherwise
+// the SEARCH_METRICS_* macros expand to nothing and the query path pays nothing.
+namespace search_metrics {
+
+enum class Stage {
+    PARSE,
+    IDF,
+    POSTINGS,
+    MINUS_WORDS,
+    SORT_TOP_K,
+    COUNT,
+};
+
+enum class Counter {
+    QUERIES,
+    POSTINGS_SCANNED,
+    COUNT,
+};
+
+constexpr size_t STAGE_COUNT = static_cast<size_t>(Stage::COUNT);
+constexpr size_t COUNTER_COUNT = static_cast<size_t>(Counter::COUNT);
+
+#ifdef SEARCH_SERVER_METRICS
+constexpr bool ENABLED = true;
+#else
+constexpr bool ENABLED = false;
+#endif
+
+const char* GetStageName(Stage stage);
+const char* GetCounterName(Counter counter);
+
+// HDR-style histogram: every power of two is split into 2^SUB_BUCKET_BITS linear
+// sub-buckets, so any recorded value is reported with at most 1/16 relative error.
+class LatencyHistogram {
+public:
+    static constexpr int SUB_BUCKET_BITS = 4;
+    static constexpr uint64_t SUB_BUCKET_COUNT = uint64_t{ 1 } << SUB_BUCKET_BITS;
+    static constexpr size_t BUCKET_COUNT = (65 - SUB_BUCKET_BITS) * SUB_BUCKET_COUNT;
+
+    static size_t GetBucketIndex(uint64_t value);
+    // Highest value that falls into the bucket
+    static uint64_t GetBucketUpperBound(size_t index);
+
+    void Record(uint64_t value);
+    void AddToBucket(size_t index, uint64_t count);
+    void Merge(const LatencyHistogram& other);
+
+    uint64_t GetCount() const;
+    uint64_t GetMax() const;
+    double GetMean() const;
+    // percentile is in [0, 100]
+    uint64_t GetValueAtPercentile(double percentile) const;
+
+    void SetSum(uint64_t sum);
+    void SetMax(uint64_t max);
+
+private:
+    std::array<uint64_t, BUCKET_COUNT> counts_{};
+    uint64_t count_ = 0;
+    uint64_t sum_ = 0;
+    uint64_t max_ = 0;
+};
+
+struct MetricsSnapshot {
+    // Stage latencies in nanoseconds
+    std::array<LatencyHistogram, STAGE_COUNT> stages;
+    std::array<uint64_t, COUNTER_COUNT> counters{};
+
+    const LatencyHistogram& operator[](Stage stage) const {
+        return stages[static_cast<size_t>(stage)];
+    }
+
+    uint64_t operator[](Counter counter) const {
+        return counters[static_cast<size_t>(counter)];
+    }
+};
+
+// Human-readable dump: one line per stage with count, mean, p50/p90/p99/p999 and max in microseconds
+std::ostream& operator<<(std::ostream& os, const MetricsSnapshot& snapshot);
+
+class MetricsRegistry {
+public:
+    static MetricsRegistry& Instance();
+
+    // Both are called only from the owning thread's slot, so a relaxed load/store
+    // pair is enough and no locked instruction is issued on the query path.
+    void Record(Stage stage, uint64_t nanoseconds);
+    void Add(Counter counter, uint64_t value);
+
+    // Merges all per-thread slots, including those of threads that have exited
+    MetricsSnapshot Snapshot() const;
+    void Dump(std::ostream& os) const;
+    void Reset();
+
+private:
+    struct StageSlot {
+        std::array<std::atomic<uint64_t>, LatencyHistogram::BUCKET_COUNT> buckets{};
+        std::atomic<uint64_t> sum{ 0 };
+        std::atomic<uint64_t> max{ 0 };
+    };
+
+    struct ThreadSlot {
+        std::array<StageSlot, STAGE_COUNT> stages;
+        std::array<std::atomic<uint64_t>, COUNTER_COUNT> counters{};
+    };
+
+    MetricsRegistry() = default;
+
+    ThreadSlot& GetLocalSlot();
+
+    mutable std::mutex mutex_;
+    std::vector<std::unique_ptr<ThreadSlot>> slots_;
+};
+
+// Same idea as LogDuration, but the elapsed time goes to the registry instead of a stream
+class StageTimer {
+public:
+    explicit StageTimer(Stage stage) : stage_(stage) {
+    }
+
+    ~StageTimer() {
+        const auto duration = LogDuration::Clock::now() - start_time_;
+        MetricsRegistry::Instance().Record(stage_,
+            std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+    }
+
+private:
+    const Stage stage_;
+    const LogDuration::Clock::time_point start_time_ = LogDuration::Clock::now();
+};
+
+} // namespace search_metrics
+
+#ifdef SEARCH_SERVER_METRICS
+#define SEARCH_METRICS_STAGE(stage) \
+    search_metrics::StageTimer PROFILE_CONCAT(metricsGuard, __LINE__)(search_metrics::Stage::stage)
+#define SEARCH_METRICS_COUNT(counter, value) \
+    search_metrics::MetricsRegistry::Instance().Add(search_metrics::Counter::counter, (value))
+#else
+#define SEARCH_METRICS_STAGE(stage) ((void)0)
+#define SEARCH_METRICS_COUNT(counter, value) ((void)0)
+#endif
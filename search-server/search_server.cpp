@@ -1,7 +1,44 @@
 #include "search_server.h"
 
+#include <limits>
+
 using namespace std;
 
+namespace {
+
+// libstdc++ and MSVC red-black tree nodes carry a color and three pointers
+const size_t TREE_NODE_OVERHEAD = 4 * sizeof(void*);
+
+// Block size of a malloc-style allocator for a request of size bytes: glibc adds a size
+// header and rounds up to two pointers, with a minimum of four
+size_t GetHeapBlockBytes(size_t size) {
+	if (size == 0) {
+		return 0;
+	}
+	const size_t granularity = 2 * sizeof(void*);
+	return max((size + sizeof(void*) + granularity - 1) / granularity * granularity, 2 * granularity);
+}
+
+template <typename Tree>
+size_t GetTreeNodeBytes(const Tree& tree) {
+	return tree.size() * GetHeapBlockBytes(TREE_NODE_OVERHEAD + sizeof(typename Tree::value_type));
+}
+
+template <typename T>
+size_t GetVectorBytes(const vector<T>& items) {
+	return GetHeapBlockBytes(items.capacity() * sizeof(T));
+}
+
+// Short strings live inside the object and take no heap
+size_t GetStringHeapBytes(const string& text) {
+	const char* const object = reinterpret_cast<const char*>(&text);
+	const bool is_inline = !less<const char*>()(text.data(), object)
+		&& less<const char*>()(text.data(), object + sizeof(text));
+	return is_inline ? 0 : GetHeapBlockBytes(text.capacity() + 1);
+}
+
+} // namespace
+
 SearchServer::SearchServer(std::string_view stop_words_text)
 	: SearchServer(SplitIntoWords(stop_words_text))  // Invoke delegating constructor from string container
 {
@@ -17,21 +54,38 @@ void SearchServer::AddDocument(int document_id, std::string_view document, Docum
 	if ((document_id < 0) || (documents_.count(document_id) > 0)) {
 		throw invalid_argument("Invalid document_id"s);
 	}
-	string_storage.push_back(string(document));
-	const auto words = SplitIntoWordsNoStop(string_storage.back());
-    
+	const auto words = StoreDocumentText(document);
+	AddTokenizedDocument(document_id, string_storage.back(), status, ratings, words);
+}
+
+void SearchServer::AddTokenizedDocument(int document_id, string_view document, DocumentStatus status,
+	const vector<int>& ratings, const vector<string_view>& words) {
+	if ((document_id < 0) || (documents_.count(document_id) > 0)) {
+		throw invalid_argument("Invalid document_id"s);
+	}
     std::map<std::string_view, double> words_freq;
 	const double inv_word_count = 1.0 / words.size();
 	for (std::string_view word : words) {
-        
+		if (fuzzy_max_edit_distance_ > 0 && word_to_document_freqs_.count(word) == 0) {
+			AddFuzzyWord(word);
+		}
         word_to_document_freqs_[word][document_id] += inv_word_count;
 		words_freq[word] = word_to_document_freqs_[word][document_id];
 
 		document_to_word_freqs_[document_id][word] += inv_word_count;
 	}
 
-	documents_.emplace(document_id, DocumentData{ ComputeAverageRating(ratings), status, words_freq });
+	const int rating = ComputeAverageRating(ratings);
+	const int slot = AcquireSlot(document_id);
+	IndexSlotPostings(slot, words_freq);
+	documents_.emplace(document_id, DocumentData{ rating, status, words_freq, document, slot });
 	document_ids_.insert(document_id);
+	IndexDocumentAttributes(document_id, status, rating);
+
+	if (positional_index_enabled_) {
+		IndexDocumentPositions(document_id, words);
+	}
+	++generation_;
 }
 
 vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentStatus status) const {
@@ -42,10 +96,249 @@ vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query) cons
 	return FindTopDocuments(std::execution::seq, raw_query);
 }
 
+vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, const DocumentFilter& filter) const {
+	return FindTopDocuments(std::execution::seq, raw_query, filter);
+}
+
+vector<Document> SearchServer::FindTopDocuments(string_view raw_query, const DocumentFilter& filter,
+	pmr::memory_resource* resource) const {
+	return FindTopDocumentsImpl(execution::seq, raw_query, SelectCandidates(filter), LocalInverseDocumentFreq{ this },
+		resource);
+}
+
+SearchPage SearchServer::FindTopDocumentsPage(string_view raw_query, const DocumentFilter& filter,
+	const SearchCursor& cursor, size_t page_size) const {
+	const size_t query_hash = hash<string_view>{}(raw_query);
+	if (cursor.has_position_ && (cursor.generation_ != generation_ || cursor.query_hash_ != query_hash
+		|| cursor.filter_ != filter)) {
+		throw invalid_argument("Search cursor belongs to another query, filter or index state"s);
+	}
+	SearchPage page;
+	page.next_cursor = cursor;
+	if (cursor.at_end_) {
+		return page;
+	}
+
+	SEARCH_METRICS_COUNT(QUERIES, 1);
+	const QueryArenaScope arena_scope;
+	const auto query = ParseQuery(raw_query, &arena_scope.GetArena());
+
+	// The heap front is the last document of the page so far
+	const Document last_document(cursor.document_id_, cursor.relevance_, cursor.rating_);
+	vector<Document>& heap = page.documents;
+	heap.reserve(page_size);
+	size_t following_count = 0;
+	CollectMatchedDocuments(execution::seq, query, SelectCandidates(filter), LocalInverseDocumentFreq{ this },
+		&arena_scope.GetArena(), [&](const Document& document) {
+			if (cursor.has_position_ && !IsRankedBefore(last_document, document)) {
+				return;
+			}
+			++following_count;
+			if (heap.size() < page_size) {
+				heap.push_back(document);
+				push_heap(heap.begin(), heap.end(), IsRankedBefore);
+			}
+			else if (page_size > 0 && IsRankedBefore(document, heap.front())) {
+				pop_heap(heap.begin(), heap.end(), IsRankedBefore);
+				heap.back() = document;
+				push_heap(heap.begin(), heap.end(), IsRankedBefore);
+			}
+		});
+	{
+		SEARCH_METRICS_STAGE(SORT_TOP_K);
+		sort_heap(heap.begin(), heap.end(), IsRankedBefore);
+	}
+
+	SearchCursor& next_cursor = page.next_cursor;
+	next_cursor.generation_ = generation_;
+	next_cursor.query_hash_ = query_hash;
+	next_cursor.filter_ = filter;
+	next_cursor.at_end_ = following_count <= page_size;
+	if (!page.documents.empty()) {
+		const Document& page_end = page.documents.back();
+		next_cursor.has_position_ = true;
+		next_cursor.relevance_ = page_end.relevance;
+		next_cursor.rating_ = page_end.rating;
+		next_cursor.document_id_ = page_end.id;
+	}
+	return page;
+}
+
+vector<vector<Document>> SearchServer::FindTopDocumentsBatch(const vector<string_view>& raw_queries,
+	const DocumentFilter& filter) const {
+	vector<vector<Document>> results(raw_queries.size());
+	const DocumentCandidates candidates = SelectCandidates(filter);
+	const QueryArenaScope arena_scope;
+	pmr::memory_resource* const resource = &arena_scope.GetArena();
+
+	vector<Query> queries;
+	queries.reserve(raw_queries.size());
+	vector<size_t> query_indexes;
+	for (size_t i = 0; i < raw_queries.size(); ++i) {
+		Query query = ParseQuery(raw_queries[i], resource);
+		if (!query.plus_wildcards.empty() || !query.positional_constraints.empty() || !query.required_words.empty()) {
+			results[i] = FindTopDocuments(execution::seq, raw_queries[i], filter);
+			continue;
+		}
+		SEARCH_METRICS_COUNT(QUERIES, 1);
+		queries.push_back(move(query));
+		query_indexes.push_back(i);
+	}
+
+	const size_t column_bytes = max<size_t>(1, slot_to_document_.size()) * sizeof(double);
+	const size_t group_size = clamp<size_t>(BATCH_SCORE_BUFFER_BYTES / column_bytes, 1, MAX_BATCH_COLUMNS);
+	vector<const Query*> group;
+	vector<vector<Document>*> group_results;
+	for (size_t begin = 0; begin < queries.size(); begin += group_size) {
+		group.clear();
+		group_results.clear();
+		for (size_t i = begin; i < min(queries.size(), begin + group_size); ++i) {
+			group.push_back(&queries[i]);
+			group_results.push_back(&results[query_indexes[i]]);
+		}
+		FindTopDocumentsBatchGroup(group, candidates, group_results, resource);
+	}
+	return results;
+}
+
+void SearchServer::FindTopDocumentsBatchGroup(const vector<const Query*>& queries, const DocumentCandidates& candidates,
+	vector<vector<Document>*>& results, pmr::memory_resource* resource) const {
+	const size_t stride = queries.size();
+	double* const scores = TakeScoreBuffer(slot_to_document_.size() * stride);
+
+	struct ColumnTerm {
+		const SlotPostings* postings;
+		string_view word;
+		size_t column;
+		double inverse_document_freq;
+	};
+	pmr::vector<ColumnTerm> column_terms(resource);
+	for (size_t column = 0; column < stride; ++column) {
+		for (const PlannedTerm& term : PlanQuery(*queries[column], false, resource).terms) {
+			column_terms.push_back({ term.postings, term.word, column,
+				term.weight * ComputeWordInverseDocumentFreq(term.word) });
+		}
+	}
+	// Words in the planner's order, so every column adds its terms in the same order as
+	// CollectMatchedDocumentsDense does and gets bit-identical scores
+	sort(column_terms.begin(), column_terms.end(), [](const ColumnTerm& lhs, const ColumnTerm& rhs) {
+		return make_tuple(lhs.postings->slots.size(), lhs.word, lhs.column)
+			< make_tuple(rhs.postings->slots.size(), rhs.word, rhs.column);
+		});
+
+	{
+		SEARCH_METRICS_STAGE(POSTINGS);
+		pmr::vector<size_t> columns(resource);
+		pmr::vector<double> inverse_document_freqs(resource);
+		for (auto word_begin = column_terms.begin(); word_begin != column_terms.end();) {
+			const auto word_end = find_if(word_begin, column_terms.end(), [word = word_begin->word](const ColumnTerm& term) {
+				return term.word != word;
+				});
+			columns.clear();
+			inverse_document_freqs.clear();
+			for (auto term = word_begin; term != word_end; ++term) {
+				columns.push_back(term->column);
+				inverse_document_freqs.push_back(term->inverse_document_freq);
+			}
+			const SlotPostings& postings = *word_begin->postings;
+			SEARCH_METRICS_COUNT(POSTINGS_SCANNED, postings.slots.size());
+			AccumulateBatchScores(postings.slots.data(), postings.term_freqs.data(), postings.slots.size(),
+				columns.data(), inverse_document_freqs.data(), columns.size(), stride, scores);
+			word_begin = word_end;
+		}
+	}
+
+	{
+		SEARCH_METRICS_STAGE(MINUS_WORDS);
+		for (size_t column = 0; column < stride; ++column) {
+			for (const string_view word : queries[column]->minus_words) {
+				if (const auto it = word_to_slot_postings_.find(word); it != word_to_slot_postings_.end()) {
+					for (const int slot : it->second.slots) {
+						scores[slot * stride + column] = -0.0;
+					}
+				}
+			}
+			for (const string_view pattern : queries[column]->minus_wildcards) {
+				for (const auto [document_id, _] : MergeWildcardPostings(pattern, resource)) {
+					scores[documents_.at(document_id).slot * stride + column] = -0.0;
+				}
+			}
+		}
+	}
+
+	// Same visiting order as CollectMatchedDocumentsDense, so the sort below sees the same input
+	pmr::vector<pmr::vector<Document>> matched_documents(stride, resource);
+	const auto add_if_matched = [&](int document_id, int slot) {
+		const double* const slot_scores = scores + slot * stride;
+		bool is_accepted = false;
+		int rating = 0;
+		for (size_t column = 0; column < stride; ++column) {
+			if (signbit(slot_scores[column])) {
+				continue;
+			}
+			if (!is_accepted) {
+				if (!IsAcceptedDocument(candidates, document_id)) {
+					return;
+				}
+				is_accepted = true;
+				rating = documents_.at(document_id).rating;
+			}
+			matched_documents[column].push_back({ document_id, slot_scores[column], rating });
+		}
+	};
+	if (!candidates.accepts_all && candidates.GetBitmap().GetCount() < slot_to_document_.size()) {
+		candidates.GetBitmap().ForEach([&](int document_id) {
+			add_if_matched(document_id, documents_.at(document_id).slot);
+			});
+	}
+	else {
+		for (size_t slot = 0; slot < slot_to_document_.size(); ++slot) {
+			add_if_matched(slot_to_document_[slot], static_cast<int>(slot));
+		}
+	}
+	ReleaseScoreBuffer(slot_to_document_.size() * stride);
+
+	for (size_t column = 0; column < stride; ++column) {
+		auto& matched = matched_documents[column];
+		{
+			SEARCH_METRICS_STAGE(SORT_TOP_K);
+			sort(matched.begin(), matched.end(), IsMoreRelevant);
+		}
+		const size_t result_size = min(matched.size(), static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT));
+		results[column]->assign(matched.begin(), matched.begin() + result_size);
+	}
+}
+
+uint64_t SearchServer::GetGeneration() const {
+	return generation_;
+}
+
 int SearchServer::GetDocumentCount() const {
 	return documents_.size();
 }
 
+int SearchServer::GetWordDocumentCount(std::string_view word) const {
+	const auto it = word_to_document_freqs_.find(word);
+	return it == word_to_document_freqs_.end() ? 0 : static_cast<int>(it->second.size());
+}
+
+map<string_view, int> SearchServer::GetQueryTermDocumentCounts(string_view raw_query) const {
+	const QueryArenaScope arena_scope;
+	const auto query = ParseQuery(raw_query, &arena_scope.GetArena());
+	map<string_view, int> term_document_counts;
+	for (const string_view word : query.plus_words) {
+		term_document_counts.emplace(word, GetWordDocumentCount(word));
+	}
+	for (const auto& [word, _] : query.fuzzy_words) {
+		term_document_counts.emplace(word, GetWordDocumentCount(word));
+	}
+	for (const string_view pattern : query.plus_wildcards) {
+		term_document_counts.emplace(pattern,
+			static_cast<int>(MergeWildcardPostings(pattern, &arena_scope.GetArena()).size()));
+	}
+	return term_document_counts;
+}
+
 std::set<int>::iterator SearchServer::begin() {
 	return document_ids_.begin();
 }
@@ -58,7 +351,7 @@ std::set<int>::iterator SearchServer::end() {
 const std::map<std::string_view, double>& SearchServer::GetWordFrequencies(int document_id) const
 {
 	// O(logN)
-	if (document_ids_.find(document_id) != document_ids_.end()) {
+	if (document_ids_.find(document_id) == document_ids_.end()) {
 		static const map<string_view, double> result;
 		return result;
 	}
@@ -83,15 +376,237 @@ void SearchServer::RemoveDocument(int document_id)
 		word_to_document_freqs_[word].erase(document_id);
 		if (word_to_document_freqs_[word].empty()) {
 			word_to_document_freqs_.erase(word);
+			RemoveFuzzyWord(word);
 		}
 	}
 
+	RemoveDocumentPositions(document_id, doc_data.words_freq);
+	RemoveDocumentAttributes(document_id, doc_data.status, doc_data.rating);
+	RemoveSlotPostings(doc_data.slot, doc_data.words_freq);
+	ReleaseSlot(doc_data.slot);
+
 	// O(N)
 	documents_.erase(document_id);
 	// O(N)
 	//const auto it = find(document_ids_.begin(), document_ids_.end(), document_id);
 	//document_ids_.erase(it);
     document_ids_.erase(document_id);
+	ReclaimFreeSlots();
+	++generation_;
+}
+
+void SearchServer::RemoveDocuments(const vector<int>& document_ids) {
+	RemoveDocuments(execution::seq, document_ids);
+}
+
+vector<SearchServer::WordRemoval> SearchServer::PrepareWordRemovals(vector<int>& document_ids) {
+	sort(document_ids.begin(), document_ids.end());
+	document_ids.erase(unique(document_ids.begin(), document_ids.end()), document_ids.end());
+
+	vector<pair<string_view, int>> word_documents;
+	for (const int document_id : document_ids) {
+		const auto it = documents_.find(document_id);
+		if (it == documents_.end()) {
+			throw out_of_range("Invalid document_id"s);
+		}
+		for (const auto& [word, _] : it->second.words_freq) {
+			word_documents.emplace_back(word, document_id);
+		}
+	}
+	sort(word_documents.begin(), word_documents.end());
+
+	vector<WordRemoval> removals;
+	for (size_t begin = 0; begin < word_documents.size();) {
+		const string_view word = word_documents[begin].first;
+		const auto positions_it = word_to_document_positions_.find(word);
+		WordRemoval removal{ word, &word_to_document_freqs_.find(word)->second, &word_to_slot_postings_.find(word)->second,
+			positions_it == word_to_document_positions_.end() ? nullptr : &positions_it->second, {}, {} };
+		for (; begin < word_documents.size() && word_documents[begin].first == word; ++begin) {
+			const int document_id = word_documents[begin].second;
+			removal.document_ids.push_back(document_id);
+			removal.slots.push_back(documents_.at(document_id).slot);
+		}
+		sort(removal.slots.begin(), removal.slots.end());
+		removals.push_back(move(removal));
+	}
+	return removals;
+}
+
+void SearchServer::ApplyWordRemoval(WordRemoval& removal) {
+	for (const int document_id : removal.document_ids) {
+		removal.postings->erase(document_id);
+		if (removal.positions != nullptr) {
+			removal.positions->erase(document_id);
+		}
+	}
+
+	// A few documents are tombstoned in place. More of them are dropped in one compaction pass
+	// over the contiguous postings instead, which drops the older tombstones too.
+	SlotPostings& postings = *removal.slot_postings;
+	if (removal.slots.size() * SLOT_COMPACTION_RATIO < postings.slots.size()) {
+		size_t position = 0;
+		for (const int slot : removal.slots) {
+			position = GallopToSlot(postings.slots.data(), position, postings.slots.size(), slot);
+			postings.term_freqs[position] = -0.0f;
+		}
+		return;
+	}
+	size_t kept = 0;
+	auto removed = removal.slots.begin();
+	for (size_t i = 0; i < postings.slots.size(); ++i) {
+		removed = lower_bound(removed, removal.slots.end(), postings.slots[i]);
+		if ((removed != removal.slots.end() && *removed == postings.slots[i]) || signbit(postings.term_freqs[i])) {
+			continue;
+		}
+		postings.slots[kept] = postings.slots[i];
+		postings.term_freqs[kept] = postings.term_freqs[i];
+		++kept;
+	}
+	postings.slots.resize(kept);
+	postings.term_freqs.resize(kept);
+}
+
+void SearchServer::FinishDocumentRemovals(const vector<int>& document_ids, const vector<WordRemoval>& removals) {
+	for (const WordRemoval& removal : removals) {
+		if (removal.postings->empty()) {
+			word_to_document_freqs_.erase(removal.word);
+			RemoveFuzzyWord(removal.word);
+			word_to_slot_postings_.erase(removal.word);
+		}
+		if (removal.positions != nullptr && removal.positions->empty()) {
+			word_to_document_positions_.erase(removal.word);
+		}
+	}
+
+	for (const int document_id : document_ids) {
+		const auto document_it = documents_.find(document_id);
+		const DocumentData& document_data = document_it->second;
+		RemoveDocumentAttributes(document_id, document_data.status, document_data.rating);
+		ReleaseSlot(document_data.slot);
+		documents_.erase(document_it);
+		document_to_word_freqs_.erase(document_id);
+		document_ids_.erase(document_id);
+	}
+	ReclaimFreeSlots();
+	++generation_;
+}
+
+void SearchServer::UpdateDocumentStatus(int document_id, DocumentStatus status) {
+	if (SetDocumentStatus(document_id, status)) {
+		++generation_;
+	}
+}
+
+void SearchServer::UpdateDocumentRatings(int document_id, const vector<int>& ratings) {
+	if (SetDocumentRating(document_id, ComputeAverageRating(ratings))) {
+		++generation_;
+	}
+}
+
+void SearchServer::UpdateDocumentText(int document_id, string_view document) {
+	// Throws out_of_range before the text is stored
+	documents_.at(document_id);
+	// Throws on an invalid word or an exceeded memory budget before the index is touched
+	SetDocumentText(document_id, StoreDocumentText(document));
+	++generation_;
+}
+
+void SearchServer::UpdateDocument(int document_id, string_view document, DocumentStatus status,
+	const vector<int>& ratings) {
+	// Every check comes before the first change, so a rejected update changes nothing, and
+	// readers of the generation see one change
+	documents_.at(document_id);
+	const auto stored_words = StoreDocumentText(document);
+	SetDocumentText(document_id, stored_words);
+	SetDocumentStatus(document_id, status);
+	SetDocumentRating(document_id, ComputeAverageRating(ratings));
+	++generation_;
+}
+
+bool SearchServer::SetDocumentStatus(int document_id, DocumentStatus status) {
+	DocumentData& document_data = documents_.at(document_id);
+	if (document_data.status == status) {
+		return false;
+	}
+	status_to_documents_[static_cast<int>(document_data.status)].Erase(document_id);
+	status_to_documents_[static_cast<int>(status)].Insert(document_id);
+	document_data.status = status;
+	return true;
+}
+
+bool SearchServer::SetDocumentRating(int document_id, int rating) {
+	DocumentData& document_data = documents_.at(document_id);
+	if (document_data.rating == rating) {
+		return false;
+	}
+	rating_to_documents_.erase({ document_data.rating, document_id });
+	rating_to_documents_.emplace(rating, document_id);
+	document_data.rating = rating;
+	return true;
+}
+
+void SearchServer::SetDocumentText(int document_id, const vector<string_view>& stored_words) {
+	DocumentData& document_data = documents_.at(document_id);
+
+	map<string_view, double> words_freq;
+	const double inv_word_count = 1.0 / stored_words.size();
+	for (const string_view word : stored_words) {
+		words_freq[word] += inv_word_count;
+	}
+
+	// Both maps are ordered by word, so one merge pass classifies every word
+	map<string_view, double> removed_words;
+	map<string_view, double> added_words;
+	vector<pair<string_view, double>> reweighted_words;
+	auto old_it = document_data.words_freq.begin();
+	auto new_it = words_freq.begin();
+	while (old_it != document_data.words_freq.end() || new_it != words_freq.end()) {
+		if (new_it == words_freq.end() || (old_it != document_data.words_freq.end() && old_it->first < new_it->first)) {
+			removed_words.insert(*old_it++);
+		}
+		else if (old_it == document_data.words_freq.end() || new_it->first < old_it->first) {
+			added_words.insert(*new_it++);
+		}
+		else {
+			if (old_it->second != new_it->second) {
+				reweighted_words.push_back(*new_it);
+			}
+			++old_it;
+			++new_it;
+		}
+	}
+
+	for (const auto& [word, _] : removed_words) {
+		const auto it = word_to_document_freqs_.find(word);
+		it->second.erase(document_id);
+		if (it->second.empty()) {
+			word_to_document_freqs_.erase(it);
+			RemoveFuzzyWord(word);
+		}
+	}
+	for (const auto& [word, term_freq] : added_words) {
+		if (fuzzy_max_edit_distance_ > 0 && word_to_document_freqs_.count(word) == 0) {
+			AddFuzzyWord(word);
+		}
+		word_to_document_freqs_[word][document_id] = term_freq;
+	}
+	for (const auto& [word, term_freq] : reweighted_words) {
+		word_to_document_freqs_.find(word)->second[document_id] = term_freq;
+	}
+	// The document moves to a new slot, so its postings are appended instead of inserted in the middle
+	RemoveSlotPostings(document_data.slot, document_data.words_freq);
+	ReleaseSlot(document_data.slot);
+	document_data.slot = AcquireSlot(document_id);
+	IndexSlotPostings(document_data.slot, words_freq);
+
+	if (positional_index_enabled_) {
+		RemoveDocumentPositions(document_id, document_data.words_freq);
+		IndexDocumentPositions(document_id, stored_words);
+	}
+	document_to_word_freqs_[document_id] = words_freq;
+	document_data.words_freq = move(words_freq);
+	document_data.text = string_storage.back();
+	ReclaimFreeSlots();
 }
 
 bool SearchServer::IsStopWord(std::string_view word) const {
@@ -136,38 +651,143 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(std::string_view text) cons
 		throw invalid_argument("Query word is empty"s);
 	}
 	string_view word = text;
-	bool is_minus = false;
-	if (word[0] == '-') {
-		is_minus = true;
+	const bool is_minus = word[0] == '-';
+	const bool is_required = word[0] == '+';
+	if (is_minus || is_required) {
 		word = word.substr(1);
 	}
-	if (word.empty() || word[0] == '-' || !IsValidWord(word)) {
+	if (word.empty() || word[0] == '-' || word[0] == '+' || !IsValidWord(word)) {
 		throw invalid_argument("Query word "s + string(text) + " is invalid");
 	}
+	const bool is_wildcard = word.find('*') != string_view::npos;
+	if (is_wildcard && word[0] == '*') {
+		throw invalid_argument("Wildcard "s + string(text) + " must start with a literal prefix"s);
+	}
+	if (is_wildcard && is_required) {
+		throw invalid_argument("Wildcard "s + string(text) + " cannot be required"s);
+	}
 
-	return { word, is_minus, IsStopWord(word) };
+	return { word, is_minus, is_required, IsStopWord(word), is_wildcard };
+}
+
+namespace {
+
+// NEAR/k between two query words; returns k or 0 for any other token.
+// Throws for NEAR/0 and for a distance that does not fit into 9 digits.
+uint32_t ParseNearOperator(string_view token) {
+	const string_view prefix = "NEAR/"sv;
+	if (token.size() <= prefix.size() || token.substr(0, prefix.size()) != prefix) {
+		return 0;
+	}
+	const string_view digits = token.substr(prefix.size());
+	uint32_t distance = 0;
+	for (const char c : digits) {
+		if (c < '0' || c > '9') {
+			return 0;
+		}
+		distance = distance * 10 + (c - '0');
+	}
+	if (distance == 0 || digits.size() > 9) {
+		throw invalid_argument("NEAR distance must be from 1 to 999999999: "s + string(token));
+	}
+	return distance;
 }
 
-SearchServer::Query SearchServer::ParseQueryCore(string_view text) const {
-	Query result;
-	for (string_view word : SplitIntoWords(text)) {
+} // namespace
+
+SearchServer::Query SearchServer::ParseQueryCore(string_view text, pmr::memory_resource* resource) const {
+	Query result(resource);
+	// An open "phrase", collected until the token with the closing quote
+	bool in_phrase = false;
+	PositionalConstraint phrase{ pmr::vector<string_view>(resource) };
+	// The last plain plus word, a possible left operand of NEAR/k
+	string_view near_operand;
+	uint32_t near_distance = 0;
+
+	for (string_view word : SplitIntoWords(text, resource)) {
+		if (!in_phrase) {
+			if (const uint32_t distance = ParseNearOperator(word); distance > 0) {
+				if (near_operand.empty() || near_distance > 0) {
+					throw invalid_argument("NEAR operator needs a word on both sides"s);
+				}
+				near_distance = distance;
+				continue;
+			}
+			if (word[0] == '"') {
+				in_phrase = true;
+				phrase.words.clear();
+				word.remove_prefix(1);
+			}
+		}
+		if (in_phrase) {
+			const bool closes_phrase = !word.empty() && word.back() == '"';
+			if (closes_phrase) {
+				word.remove_suffix(1);
+			}
+			if (!word.empty()) {
+				const auto query_word = ParseQueryWord(word);
+				if (query_word.is_minus || query_word.is_required || query_word.is_wildcard) {
+					throw invalid_argument("Minus, required or wildcard word inside a phrase: "s + string(word));
+				}
+				if (!query_word.is_stop) {
+					phrase.words.push_back(query_word.data);
+					result.plus_words.push_back(query_word.data);
+				}
+			}
+			if (closes_phrase) {
+				in_phrase = false;
+				// A one-word phrase is just a plus word
+				if (phrase.words.size() > 1) {
+					result.positional_constraints.push_back(move(phrase));
+				}
+			}
+			near_operand = {};
+			continue;
+		}
+
 		const auto query_word = ParseQueryWord(word);
-		if (!query_word.is_stop) {
+		const bool is_plain_plus = !query_word.is_stop && !query_word.is_minus && !query_word.is_wildcard;
+		if (near_distance > 0) {
+			if (!is_plain_plus) {
+				throw invalid_argument("NEAR operator needs a word on both sides"s);
+			}
+			result.positional_constraints.push_back(
+				{ pmr::vector<string_view>({ near_operand, query_word.data }, resource), near_distance, false });
+			near_distance = 0;
+		}
+		near_operand = is_plain_plus ? query_word.data : string_view{};
+		if (query_word.is_wildcard) {
+			(query_word.is_minus ? result.minus_wildcards : result.plus_wildcards).push_back(query_word.data);
+		}
+		else if (!query_word.is_stop) {
 			if (query_word.is_minus) {
 				result.minus_words.push_back(query_word.data);
 			}
 			else {
 				result.plus_words.push_back(query_word.data);
+				if (query_word.is_required) {
+					result.required_words.push_back(query_word.data);
+				}
 			}
 		}
 	}
+	if (in_phrase) {
+		throw invalid_argument("Unterminated phrase in query "s + string(text));
+	}
+	if (near_distance > 0) {
+		throw invalid_argument("NEAR operator needs a word on both sides"s);
+	}
+	if (!result.positional_constraints.empty() && !positional_index_enabled_) {
+		throw invalid_argument("Phrase and NEAR queries need the positional index"s);
+	}
 
 	return result;
 }
 
-SearchServer::Query SearchServer::ParseQuery(string_view text) const {
+SearchServer::Query SearchServer::ParseQuery(string_view text, pmr::memory_resource* resource) const {
+	SEARCH_METRICS_STAGE(PARSE);
 
-	Query result = ParseQueryCore(text);
+	Query result = ParseQueryCore(text, resource);
 
 	std::sort(result.minus_words.begin(), result.minus_words.end());
 	auto new_end_minus = std::unique(result.minus_words.begin(), result.minus_words.end());
@@ -177,17 +797,187 @@ SearchServer::Query SearchServer::ParseQuery(string_view text) const {
 	auto new_end_plus = std::unique(result.plus_words.begin(), result.plus_words.end());
 	result.plus_words.erase(new_end_plus, result.plus_words.end());
 
+	std::sort(result.required_words.begin(), result.required_words.end());
+	result.required_words.erase(std::unique(result.required_words.begin(), result.required_words.end()),
+		result.required_words.end());
+
+	for (auto* wildcards : { &result.plus_wildcards, &result.minus_wildcards }) {
+		std::sort(wildcards->begin(), wildcards->end());
+		wildcards->erase(std::unique(wildcards->begin(), wildcards->end()), wildcards->end());
+	}
+	ExpandFuzzyWords(result);
+
 	return result;
 }
 
 // Existence required
 double SearchServer::ComputeWordInverseDocumentFreq(string_view word) const {
+	SEARCH_METRICS_STAGE(IDF);
 	return log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
 }
 
+SearchServer::ExecutionPlan SearchServer::PlanQuery(const Query& query, bool parallel_allowed,
+	pmr::memory_resource* resource) const {
+	ExecutionPlan plan(resource);
+	plan.terms.reserve(query.plus_words.size() + query.fuzzy_words.size());
+	for (const string_view word : query.plus_words) {
+		if (const auto it = word_to_slot_postings_.find(word); it != word_to_slot_postings_.end()) {
+			plan.terms.push_back({ word, 1.0, &it->second });
+		}
+	}
+	for (const auto [word, weight] : query.fuzzy_words) {
+		plan.terms.push_back({ word, weight, &word_to_slot_postings_.at(word) });
+	}
+	// Rarest first, ties by word, so equal queries always sum their scores in the same order
+	sort(plan.terms.begin(), plan.terms.end(), [](const PlannedTerm& lhs, const PlannedTerm& rhs) {
+		return std::make_pair(lhs.postings->slots.size(), lhs.word) < std::make_pair(rhs.postings->slots.size(), rhs.word);
+		});
+	for (const PlannedTerm& term : plan.terms) {
+		plan.posting_count += term.postings->slots.size();
+		plan.term_tasks.Add(term.postings->slots.size());
+	}
+	// The intersection leaves too few documents for the parallel overhead to pay off
+	if (!query.required_words.empty()) {
+		return plan;
+	}
+
+	for (const string_view pattern : query.plus_wildcards) {
+		size_t pattern_posting_count = 0;
+		for (const string_view word : ExpandWildcard(pattern, resource)) {
+			pattern_posting_count += word_to_document_freqs_.at(word).size();
+		}
+		plan.posting_count += pattern_posting_count;
+		plan.wildcard_tasks.Add(pattern_posting_count);
+	}
+	plan.sparse = query_cost_model_.IsSparseCheaper(plan.posting_count, slot_to_document_.size());
+	if (!parallel_allowed) {
+		return plan;
+	}
+	plan.parallel = query_cost_model_.EstimateParallel(plan.term_tasks, plan.wildcard_tasks)
+		< query_cost_model_.EstimateSequential(plan.posting_count, slot_to_document_.size());
+	return plan;
+}
+
+DocumentBitmap SearchServer::CollectExcludedDocuments(const Query& query, pmr::memory_resource* resource) const {
+	DocumentBitmap excluded_documents;
+	for (const string_view word : query.minus_words) {
+		if (const auto it = word_to_document_freqs_.find(word); it != word_to_document_freqs_.end()) {
+			for (const auto [document_id, _] : it->second) {
+				excluded_documents.Insert(document_id);
+			}
+		}
+	}
+	for (const string_view pattern : query.minus_wildcards) {
+		for (const auto [document_id, _] : MergeWildcardPostings(pattern, resource)) {
+			excluded_documents.Insert(document_id);
+		}
+	}
+	return excluded_documents;
+}
+
+pmr::vector<int> SearchServer::IntersectRequiredWords(const Query& query, pmr::memory_resource* resource) const {
+	pmr::vector<const SlotPostings*> required_postings(resource);
+	for (const string_view word : query.required_words) {
+		const auto it = word_to_slot_postings_.find(word);
+		if (it == word_to_slot_postings_.end()) {
+			return pmr::vector<int>(resource);
+		}
+		required_postings.push_back(&it->second);
+	}
+	sort(required_postings.begin(), required_postings.end(), [](const SlotPostings* lhs, const SlotPostings* rhs) {
+		return lhs->slots.size() < rhs->slots.size();
+		});
+
+	// The shortest list drives; each longer one is only probed for the surviving slots
+	const auto& shortest = required_postings.front()->slots;
+	pmr::vector<int> slots(shortest.begin(), shortest.end(), resource);
+	SEARCH_METRICS_COUNT(POSTINGS_SCANNED, slots.size());
+	for (size_t i = 1; i < required_postings.size() && !slots.empty(); ++i) {
+		const auto& postings = required_postings[i]->slots;
+		SEARCH_METRICS_COUNT(POSTINGS_SCANNED, slots.size());
+		slots.resize(IntersectSlots(slots.data(), slots.size(), postings.data(), postings.size(), slots.data()));
+	}
+
+	for (const string_view word : query.minus_words) {
+		if (const auto it = word_to_slot_postings_.find(word); it != word_to_slot_postings_.end() && !slots.empty()) {
+			const auto& postings = it->second.slots;
+			slots.resize(SubtractSlots(slots.data(), slots.size(), postings.data(), postings.size(), slots.data()));
+		}
+	}
+	pmr::vector<int> excluded_slots(resource);
+	for (const string_view pattern : query.minus_wildcards) {
+		if (slots.empty()) {
+			break;
+		}
+		excluded_slots.clear();
+		for (const auto [document_id, _] : MergeWildcardPostings(pattern, resource)) {
+			excluded_slots.push_back(documents_.at(document_id).slot);
+		}
+		sort(excluded_slots.begin(), excluded_slots.end());
+		slots.resize(SubtractSlots(slots.data(), slots.size(), excluded_slots.data(), excluded_slots.size(), slots.data()));
+	}
+	return slots;
+}
+
+QueryPlan SearchServer::ExplainQuery(string_view raw_query) const {
+	const QueryArenaScope arena_scope;
+	const auto query = ParseQuery(raw_query, &arena_scope.GetArena());
+	const ExecutionPlan plan = PlanQuery(query, true, &arena_scope.GetArena());
+
+	QueryPlan result;
+	for (const PlannedTerm& term : plan.terms) {
+		result.terms.push_back({ string(term.word), term.postings->slots.size(), term.weight });
+	}
+	for (const string_view pattern : query.plus_wildcards) {
+		QueryPlan::Term wildcard{ string(pattern) };
+		for (const string_view word : ExpandWildcard(pattern, &arena_scope.GetArena())) {
+			wildcard.posting_count += word_to_document_freqs_.at(word).size();
+		}
+		result.wildcards.push_back(move(wildcard));
+	}
+	for (const string_view word : query.required_words) {
+		const auto it = word_to_slot_postings_.find(word);
+		result.required_words.push_back({ string(word), it == word_to_slot_postings_.end() ? 0 : it->second.slots.size() });
+	}
+	sort(result.required_words.begin(), result.required_words.end(), [](const QueryPlan::Term& lhs, const QueryPlan::Term& rhs) {
+		return lhs.posting_count < rhs.posting_count;
+		});
+	result.excluded_document_count = CollectExcludedDocuments(query, &arena_scope.GetArena()).GetCount();
+	result.posting_count = plan.posting_count;
+	result.sequential_cost_ns = query_cost_model_.EstimateSequential(plan.posting_count, slot_to_document_.size());
+	result.parallel_cost_ns = query_cost_model_.EstimateParallel(plan.term_tasks, plan.wildcard_tasks);
+	result.parallel = plan.parallel;
+	result.sparse = plan.sparse;
+	return result;
+}
+
+void SearchServer::SetQueryCostModel(const QueryCostModel& cost_model) {
+	query_cost_model_ = cost_model;
+}
+
+const QueryCostModel& SearchServer::GetQueryCostModel() const {
+	return query_cost_model_;
+}
+
 tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(std::string_view raw_query,
 	int document_id) const
 {
+	vector<string_view> matched_words;
+	const DocumentStatus status = MatchDocument(raw_query, document_id, matched_words);
+	return { move(matched_words), status };
+}
+
+DocumentStatus SearchServer::MatchDocument(string_view raw_query, int document_id,
+	vector<string_view>& matched_words) const
+{
+	const QueryArenaScope arena_scope;
+	return MatchDocument(raw_query, document_id, matched_words, &arena_scope.GetArena());
+}
+
+DocumentStatus SearchServer::MatchDocument(string_view raw_query, int document_id,
+	vector<string_view>& matched_words, pmr::memory_resource* resource) const
+{
+	matched_words.clear();
 	
     if (document_ids_.find(document_id) == document_ids_.end()) {
         throw out_of_range("No such document_id");
@@ -197,8 +987,7 @@ tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(std::stri
         throw out_of_range("No such document_id");
     }*/
     
-    //LOG_DURATION_STREAM("Operation time"s, std::cout);
-	const auto query = ParseQuery(raw_query);
+	const auto query = ParseQuery(raw_query, resource);
     
     for (string_view word : query.minus_words) {
 		if (word_to_document_freqs_.count(word) == 0) {
@@ -207,12 +996,23 @@ tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(std::stri
 		if (word_to_document_freqs_.at(word).count(document_id)) {
 			//matched_words.clear();
 			//break;
-			std::vector<std::string_view> matched_words(0);
-            return {matched_words, documents_.at(document_id).status};
+            return documents_.at(document_id).status;
 		}
 	}
 
-	vector<string_view> matched_words;
+	const auto lacks_word = [&](string_view word) {
+		const auto it = word_to_document_freqs_.find(word);
+		return it == word_to_document_freqs_.end() || it->second.count(document_id) == 0;
+	};
+	if (any_of(query.required_words.begin(), query.required_words.end(), lacks_word)
+		|| !MatchesPositionalConstraints(query, document_id)) {
+		return documents_.at(document_id).status;
+	}
+	for (string_view pattern : query.minus_wildcards) {
+		if (DocumentMatchesWildcard(pattern, document_id)) {
+			return documents_.at(document_id).status;
+		}
+	}
 
 	for (string_view word : query.plus_words) {
 		if (word_to_document_freqs_.count(word) == 0) {
@@ -222,8 +1022,27 @@ tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(std::stri
 			matched_words.push_back(word);
 		}
 	}
+	for (const auto [word, _] : query.fuzzy_words) {
+		if (word_to_document_freqs_.at(word).count(document_id)) {
+			matched_words.push_back(word);
+		}
+	}
+
+	if (!query.plus_wildcards.empty()) {
+		for (const auto& [word, freq] : documents_.at(document_id).words_freq) {
+			if (any_of(query.plus_wildcards.begin(), query.plus_wildcards.end(), [word = word](string_view pattern) {
+				return MatchesWildcard(pattern, word);
+				})) {
+				matched_words.push_back(word);
+			}
+		}
+	}
+	if (!query.plus_wildcards.empty() || !query.fuzzy_words.empty()) {
+		sort(matched_words.begin(), matched_words.end());
+		matched_words.erase(unique(matched_words.begin(), matched_words.end()), matched_words.end());
+	}
     
-    return { matched_words, documents_.at(document_id).status };
+    return documents_.at(document_id).status;
 }
 
 std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(const std::execution::sequenced_policy& policy, std::string_view raw_query,
@@ -234,7 +1053,6 @@ std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDoc
 std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(const std::execution::parallel_policy& policy, std::string_view raw_query,
 	int document_id) const
 {
-    //LOG_DURATION_STREAM("Parse query time", std::cout);
 	/*
     if (document_to_word_freqs_.count(document_id) == 0) {
         throw out_of_range("No such document_id");
@@ -243,7 +1061,13 @@ std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDoc
         throw out_of_range("No such document_id");
     }
     
-    const auto query = ParseQueryCore(raw_query);
+    const QueryArenaScope arena_scope;
+    const auto query = [&] {
+        SEARCH_METRICS_STAGE(PARSE);
+        auto query = ParseQueryCore(raw_query, &arena_scope.GetArena());
+        ExpandFuzzyWords(query);
+        return query;
+    }();
     
 	//const auto& words_map = document_to_word_freqs_.at(document_id);
 
@@ -257,6 +1081,18 @@ std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDoc
         return {matched_words, documents_.at(document_id).status};
 	}
 
+	const auto lacks_word = [&](string_view word) {
+		const auto it = word_to_document_freqs_.find(word);
+		return it == word_to_document_freqs_.end() || it->second.count(document_id) == 0;
+	};
+	if (std::any_of(query.required_words.cbegin(), query.required_words.cend(), lacks_word)
+		|| !MatchesPositionalConstraints(query, document_id)
+		|| std::any_of(query.minus_wildcards.cbegin(), query.minus_wildcards.cend(), [&](string_view pattern) {
+			return DocumentMatchesWildcard(pattern, document_id);
+			})) {
+		return { std::vector<std::string_view>{}, documents_.at(document_id).status };
+	}
+
 	std::vector<std::string_view> matched_words(query.plus_words.size());
 
 	auto pred = [&](auto word) {
@@ -275,10 +1111,632 @@ std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDoc
 
 	auto new_end = std::copy_if(policy, query.plus_words.cbegin(), query.plus_words.cend(), matched_words.begin(), pred);
 	matched_words.erase(new_end, matched_words.end());    
+	for (const auto [word, _] : query.fuzzy_words) {
+		if (pred(word)) {
+			matched_words.push_back(word);
+		}
+	}
+
+	if (!query.plus_wildcards.empty()) {
+		for (const auto& [word, freq] : documents_.at(document_id).words_freq) {
+			if (std::any_of(query.plus_wildcards.cbegin(), query.plus_wildcards.cend(), [word = word](string_view pattern) {
+				return MatchesWildcard(pattern, word);
+				})) {
+				matched_words.push_back(word);
+			}
+		}
+	}
 
 	std::sort(policy, matched_words.begin(), matched_words.end());
 	auto new_end2 = std::unique(policy, matched_words.begin(), matched_words.end());
 	matched_words.erase(new_end2, matched_words.end());
     
     return { matched_words, documents_.at(document_id).status };
-}
\ No newline at end of file
+}
+
+void SearchServer::EnablePositionalIndex() {
+	if (positional_index_enabled_) {
+		return;
+	}
+	positional_index_enabled_ = true;
+	for (const auto& [document_id, document_data] : documents_) {
+		IndexDocumentPositions(document_id, SplitIntoWordsNoStop(document_data.text));
+	}
+}
+
+bool SearchServer::HasPositionalIndex() const {
+	return positional_index_enabled_;
+}
+
+PositionalIndexStats SearchServer::GetPositionalIndexStats() const {
+	PositionalIndexStats stats;
+	for (const auto& [word, document_positions] : word_to_document_positions_) {
+		stats.allocated_bytes += TREE_NODE_OVERHEAD + sizeof(word) + sizeof(document_positions);
+		for (const auto& [document_id, positions] : document_positions) {
+			++stats.posting_count;
+			stats.position_count += positions.GetCount();
+			stats.encoded_bytes += positions.GetEncodedSize();
+			stats.allocated_bytes += TREE_NODE_OVERHEAD + sizeof(document_id) + sizeof(positions) + positions.GetAllocatedSize();
+		}
+	}
+	return stats;
+}
+
+MemoryStats SearchServer::GetMemoryStats() const {
+	MemoryStats stats;
+
+	stats.word_to_document_freqs.allocated_bytes = GetTreeNodeBytes(word_to_document_freqs_);
+	for (const auto& [word, document_freqs] : word_to_document_freqs_) {
+		const size_t posting_count = document_freqs.size();
+		stats.word_to_document_freqs.entry_count += posting_count;
+		stats.word_to_document_freqs.allocated_bytes += GetTreeNodeBytes(document_freqs);
+
+		size_t bucket = 0;
+		while ((size_t{ 2 } << bucket) <= posting_count) {
+			++bucket;
+		}
+		if (stats.posting_size_histogram.size() <= bucket) {
+			const size_t old_size = stats.posting_size_histogram.size();
+			stats.posting_size_histogram.resize(bucket + 1);
+			for (size_t i = old_size; i <= bucket; ++i) {
+				stats.posting_size_histogram[i].min_posting_count = size_t{ 1 } << i;
+			}
+		}
+		PostingSizeBucket& histogram_bucket = stats.posting_size_histogram[bucket];
+		++histogram_bucket.term_count;
+		histogram_bucket.allocated_bytes += GetTreeNodeBytes(document_freqs);
+		if (const auto it = word_to_slot_postings_.find(word); it != word_to_slot_postings_.end()) {
+			histogram_bucket.allocated_bytes += GetVectorBytes(it->second.slots) + GetVectorBytes(it->second.term_freqs);
+		}
+	}
+
+	stats.document_to_word_freqs.allocated_bytes = GetTreeNodeBytes(document_to_word_freqs_);
+	for (const auto& [document_id, word_freqs] : document_to_word_freqs_) {
+		stats.document_to_word_freqs.entry_count += word_freqs.size();
+		stats.document_to_word_freqs.allocated_bytes += GetTreeNodeBytes(word_freqs);
+	}
+
+	stats.documents.entry_count = documents_.size();
+	stats.documents.allocated_bytes = GetTreeNodeBytes(documents_);
+	for (const auto& [document_id, document_data] : documents_) {
+		stats.documents.allocated_bytes += GetTreeNodeBytes(document_data.words_freq);
+	}
+
+	stats.document_ids.entry_count = document_ids_.size();
+	stats.document_ids.allocated_bytes = GetTreeNodeBytes(document_ids_);
+
+	stats.slot_postings.allocated_bytes = GetTreeNodeBytes(word_to_slot_postings_)
+		+ GetVectorBytes(slot_to_document_);
+	for (const auto& [word, postings] : word_to_slot_postings_) {
+		stats.slot_postings.entry_count += postings.slots.size();
+		stats.slot_postings.allocated_bytes += GetVectorBytes(postings.slots) + GetVectorBytes(postings.term_freqs);
+	}
+
+	stats.string_storage.entry_count = string_storage.size();
+	stats.string_storage.allocated_bytes = string_storage.size() * sizeof(string);
+	for (const string& text : string_storage) {
+		stats.string_storage.allocated_bytes += GetStringHeapBytes(text);
+	}
+
+	stats.document_attributes.entry_count = rating_to_documents_.size();
+	stats.document_attributes.allocated_bytes = GetTreeNodeBytes(rating_to_documents_);
+	for (const DocumentBitmap& documents : status_to_documents_) {
+		stats.document_attributes.allocated_bytes += documents.GetAllocatedSize();
+	}
+
+	const PositionalIndexStats positional_stats = GetPositionalIndexStats();
+	stats.positional_index.entry_count = positional_stats.posting_count;
+	stats.positional_index.allocated_bytes = positional_stats.allocated_bytes;
+
+	// A hash node holds the next pointer, the entry and the cached hash
+	const size_t hash_node_bytes = GetHeapBlockBytes(sizeof(void*) + sizeof(decltype(deletion_to_words_)::value_type) + sizeof(size_t));
+	stats.fuzzy_index.entry_count = deletion_to_words_.size();
+	stats.fuzzy_index.allocated_bytes = GetHeapBlockBytes(deletion_to_words_.bucket_count() * sizeof(void*));
+	for (const auto& [deletion, words] : deletion_to_words_) {
+		stats.fuzzy_index.allocated_bytes += hash_node_bytes + GetStringHeapBytes(deletion) + GetVectorBytes(words);
+	}
+
+	stats.total_bytes = stats.word_to_document_freqs.allocated_bytes + stats.document_to_word_freqs.allocated_bytes
+		+ stats.documents.allocated_bytes + stats.document_ids.allocated_bytes + stats.slot_postings.allocated_bytes
+		+ stats.string_storage.allocated_bytes + stats.document_attributes.allocated_bytes
+		+ stats.positional_index.allocated_bytes + stats.fuzzy_index.allocated_bytes;
+
+	stats.mapped_files.entry_count = external_storage_.size();
+	for (const ExternalStorage& storage : external_storage_) {
+		stats.mapped_files.allocated_bytes += storage.bytes.size();
+	}
+	return stats;
+}
+
+void SearchServer::SetMemoryBudget(size_t budget_bytes, MemoryBudgetPolicy policy) {
+	memory_budget_ = budget_bytes;
+	memory_budget_policy_ = policy;
+	memory_usage_estimate_ = budget_bytes > 0 ? GetMemoryStats().total_bytes : 0;
+}
+
+size_t SearchServer::GetMemoryBudget() const {
+	return memory_budget_;
+}
+
+void SearchServer::Compact() {
+	SearchServer compacted(stop_words_);
+	if (positional_index_enabled_) {
+		compacted.EnablePositionalIndex();
+	}
+	if (fuzzy_max_edit_distance_ > 0) {
+		compacted.EnableFuzzyMatching(fuzzy_max_edit_distance_);
+	}
+	// Mapped texts stay where they are, everything else is copied into fresh storage
+	const auto is_mapped = [this](string_view text) {
+		const less<const char*> is_before;
+		return any_of(external_storage_.begin(), external_storage_.end(), [&](const ExternalStorage& storage) {
+			return !is_before(text.data(), storage.bytes.data())
+				&& is_before(text.data(), storage.bytes.data() + storage.bytes.size());
+			});
+	};
+	for (const auto& [document_id, document_data] : documents_) {
+		// Only the average rating is kept, and it is the average of itself
+		const vector<int> ratings = { document_data.rating };
+		if (is_mapped(document_data.text)) {
+			compacted.AddTokenizedDocument(document_id, document_data.text, document_data.status, ratings,
+				compacted.SplitIntoWordsNoStop(document_data.text));
+		}
+		else {
+			compacted.AddDocument(document_id, document_data.text, document_data.status, ratings);
+		}
+	}
+
+	// Map and deque moves keep the nodes and strings in place, so the views stay valid
+	word_to_document_freqs_ = move(compacted.word_to_document_freqs_);
+	document_to_word_freqs_ = move(compacted.document_to_word_freqs_);
+	documents_ = move(compacted.documents_);
+	document_ids_ = move(compacted.document_ids_);
+	word_to_slot_postings_ = move(compacted.word_to_slot_postings_);
+	slot_to_document_ = move(compacted.slot_to_document_);
+	free_slot_count_ = compacted.free_slot_count_;
+	string_storage = move(compacted.string_storage);
+	status_to_documents_ = move(compacted.status_to_documents_);
+	rating_to_documents_ = move(compacted.rating_to_documents_);
+	word_to_document_positions_ = move(compacted.word_to_document_positions_);
+	deletion_to_words_ = move(compacted.deletion_to_words_);
+
+	++generation_;
+	compacted_generation_ = generation_;
+	memory_usage_estimate_ = GetMemoryStats().total_bytes;
+}
+
+vector<string_view> SearchServer::StoreDocumentText(string_view document) {
+	// A compaction frees every text the server owns, and the caller's text may be a view of one,
+	// e.g. a key of GetWordFrequencies, so it is copied before anything can compact
+	string document_copy;
+	if (memory_budget_ > 0 && memory_budget_policy_ == MemoryBudgetPolicy::COMPACT) {
+		document_copy = document;
+		document = document_copy;
+	}
+	// Tokenized in place first, so a rejected text leaves nothing behind
+	vector<string_view> words = SplitIntoWordsNoStop(document);
+	ReserveDocumentMemory(sizeof(string) + GetHeapBlockBytes(document.size() + 1), words);
+	const string& stored_document = string_storage.emplace_back(document);
+	for (string_view& word : words) {
+		word = string_view(stored_document.data() + (word.data() - document.data()), word.size());
+	}
+	return words;
+}
+
+size_t SearchServer::EstimateDocumentBytes(size_t text_bytes, const vector<string_view>& words) const {
+	size_t bytes = text_bytes
+		+ GetHeapBlockBytes(TREE_NODE_OVERHEAD + sizeof(decltype(documents_)::value_type))
+		+ GetHeapBlockBytes(TREE_NODE_OVERHEAD + sizeof(decltype(document_to_word_freqs_)::value_type))
+		+ GetHeapBlockBytes(TREE_NODE_OVERHEAD + sizeof(int))
+		+ GetHeapBlockBytes(TREE_NODE_OVERHEAD + sizeof(pair<int, int>))
+		+ sizeof(int);
+	if (positional_index_enabled_) {
+		// A varint position takes at most 5 bytes, and a list may double its capacity
+		bytes += words.size() * 10;
+	}
+
+	vector<string_view> distinct_words = words;
+	sort(distinct_words.begin(), distinct_words.end());
+	distinct_words.erase(unique(distinct_words.begin(), distinct_words.end()), distinct_words.end());
+	const size_t posting_bytes = GetHeapBlockBytes(TREE_NODE_OVERHEAD + sizeof(pair<const int, double>));
+	const size_t word_freq_bytes = GetHeapBlockBytes(TREE_NODE_OVERHEAD + sizeof(pair<const string_view, double>));
+	for (const string_view word : distinct_words) {
+		// The posting, the frequency in both per-document maps and a slot posting that may double its vectors
+		bytes += posting_bytes + 2 * word_freq_bytes + 2 * (sizeof(int) + sizeof(float));
+		if (positional_index_enabled_) {
+			bytes += GetHeapBlockBytes(TREE_NODE_OVERHEAD + sizeof(pair<const int, PositionList>));
+		}
+		if (word_to_document_freqs_.count(word) > 0) {
+			continue;
+		}
+		// A new word also gets its own map entries and the first blocks of its slot postings
+		bytes += GetHeapBlockBytes(TREE_NODE_OVERHEAD + sizeof(decltype(word_to_document_freqs_)::value_type))
+			+ GetHeapBlockBytes(TREE_NODE_OVERHEAD + sizeof(decltype(word_to_slot_postings_)::value_type))
+			+ 2 * GetHeapBlockBytes(sizeof(int));
+		if (positional_index_enabled_) {
+			bytes += GetHeapBlockBytes(TREE_NODE_OVERHEAD + sizeof(decltype(word_to_document_positions_)::value_type));
+		}
+		if (fuzzy_max_edit_distance_ > 0) {
+			// Deletions of up to two characters; each may need a hash node, a key, a bucket and a word list
+			const size_t length = word.size();
+			const size_t deletion_count = fuzzy_max_edit_distance_ == 1
+				? 1 + length
+				: 1 + length + length * (length - 1) / 2;
+			const size_t deletion_bytes = 2 * sizeof(void*)
+				+ GetHeapBlockBytes(sizeof(void*) + sizeof(decltype(deletion_to_words_)::value_type) + sizeof(size_t))
+				+ (length > 15 ? GetHeapBlockBytes(length + 1) : 0) + GetHeapBlockBytes(2 * sizeof(string_view));
+			bytes += deletion_count * deletion_bytes;
+		}
+	}
+	return bytes;
+}
+
+void SearchServer::ReserveDocumentMemory(size_t text_bytes, const vector<string_view>& words) {
+	if (memory_budget_ == 0) {
+		return;
+	}
+	const size_t document_bytes = EstimateDocumentBytes(text_bytes, words);
+	if (memory_usage_estimate_ + document_bytes > memory_budget_) {
+		// The estimate does not shrink on removals, so measure before refusing
+		memory_usage_estimate_ = GetMemoryStats().total_bytes;
+		if (memory_usage_estimate_ + document_bytes > memory_budget_
+			&& memory_budget_policy_ == MemoryBudgetPolicy::COMPACT && generation_ != compacted_generation_) {
+			Compact();
+		}
+		if (memory_usage_estimate_ + document_bytes > memory_budget_) {
+			throw MemoryBudgetExceeded("Document of about "s + to_string(document_bytes)
+				+ " bytes does not fit into the memory budget of "s + to_string(memory_budget_) + " bytes"s);
+		}
+	}
+	memory_usage_estimate_ += document_bytes;
+}
+
+void SearchServer::EnableFuzzyMatching(int max_edit_distance) {
+	if (max_edit_distance < 1 || max_edit_distance > 2) {
+		throw invalid_argument("Fuzzy matching supports edit distance 1 or 2"s);
+	}
+	if (fuzzy_max_edit_distance_ == max_edit_distance) {
+		return;
+	}
+	deletion_to_words_.clear();
+	fuzzy_max_edit_distance_ = max_edit_distance;
+	for (const auto& [word, _] : word_to_document_freqs_) {
+		AddFuzzyWord(word);
+	}
+}
+
+int SearchServer::GetFuzzyMaxEditDistance() const {
+	return fuzzy_max_edit_distance_;
+}
+
+void SearchServer::AddFuzzyWord(string_view word) {
+	if (fuzzy_max_edit_distance_ == 0) {
+		return;
+	}
+	for (string& deletion : GenerateDeletions(word, fuzzy_max_edit_distance_)) {
+		deletion_to_words_[move(deletion)].push_back(word);
+	}
+}
+
+void SearchServer::RemoveFuzzyWord(string_view word) {
+	if (fuzzy_max_edit_distance_ == 0) {
+		return;
+	}
+	for (const string& deletion : GenerateDeletions(word, fuzzy_max_edit_distance_)) {
+		const auto it = deletion_to_words_.find(deletion);
+		auto& words = it->second;
+		words.erase(find(words.begin(), words.end(), word));
+		if (words.empty()) {
+			deletion_to_words_.erase(it);
+		}
+	}
+}
+
+void SearchServer::ExpandFuzzyWords(Query& query) const {
+	if (fuzzy_max_edit_distance_ == 0) {
+		return;
+	}
+	pmr::memory_resource* const resource = query.fuzzy_words.get_allocator().resource();
+	pmr::vector<pair<int, string_view>> candidates(resource);
+	for (const string_view word : query.plus_words) {
+		// Short words have too many neighbours for a typo to be told from another word
+		const int max_distance = min(fuzzy_max_edit_distance_, word.size() <= 2 ? 0 : word.size() <= 5 ? 1 : 2);
+		if (max_distance == 0) {
+			continue;
+		}
+		// Two words within distance d share a variant with at most d deletions each
+		candidates.clear();
+		for (const string& deletion : GenerateDeletions(word, max_distance)) {
+			const auto it = deletion_to_words_.find(deletion);
+			if (it == deletion_to_words_.end()) {
+				continue;
+			}
+			for (const string_view candidate : it->second) {
+				const int distance = ComputeEditDistance(word, candidate, max_distance);
+				if (distance > 0 && distance <= max_distance) {
+					candidates.emplace_back(distance, candidate);
+				}
+			}
+		}
+		sort(candidates.begin(), candidates.end());
+		candidates.erase(unique(candidates.begin(), candidates.end()), candidates.end());
+		if (candidates.size() > static_cast<size_t>(MAX_FUZZY_EXPANSION)) {
+			candidates.resize(MAX_FUZZY_EXPANSION);
+		}
+		for (const auto [distance, candidate] : candidates) {
+			if (find(query.plus_words.begin(), query.plus_words.end(), candidate) == query.plus_words.end()) {
+				query.fuzzy_words.emplace_back(candidate, 1.0 / (1 + distance));
+			}
+		}
+	}
+
+	// A word close to several plus words counts once, with its best weight
+	sort(query.fuzzy_words.begin(), query.fuzzy_words.end(), [](const auto& lhs, const auto& rhs) {
+		return lhs.first < rhs.first || (lhs.first == rhs.first && lhs.second > rhs.second);
+		});
+	query.fuzzy_words.erase(unique(query.fuzzy_words.begin(), query.fuzzy_words.end(), [](const auto& lhs, const auto& rhs) {
+		return lhs.first == rhs.first;
+		}), query.fuzzy_words.end());
+}
+
+void SearchServer::IndexDocumentPositions(int document_id, const vector<string_view>& words) {
+	vector<PositionList*> touched;
+	for (size_t position = 0; position < words.size(); ++position) {
+		PositionList& positions = word_to_document_positions_[words[position]][document_id];
+		if (positions.GetCount() == 0) {
+			touched.push_back(&positions);
+		}
+		positions.Append(static_cast<uint32_t>(position));
+	}
+	for (PositionList* positions : touched) {
+		positions->ShrinkToFit();
+	}
+}
+
+void SearchServer::RemoveDocumentPositions(int document_id, const map<string_view, double>& words_freq) {
+	if (!positional_index_enabled_) {
+		return;
+	}
+	for (const auto& [word, freq] : words_freq) {
+		const auto it = word_to_document_positions_.find(word);
+		if (it == word_to_document_positions_.end()) {
+			continue;
+		}
+		it->second.erase(document_id);
+		if (it->second.empty()) {
+			word_to_document_positions_.erase(it);
+		}
+	}
+}
+
+bool SearchServer::MatchesPositionalConstraint(const PositionalConstraint& constraint, int document_id) const {
+	vector<const PositionList*> lists;
+	lists.reserve(constraint.words.size());
+	for (const string_view word : constraint.words) {
+		const auto word_it = word_to_document_positions_.find(word);
+		if (word_it == word_to_document_positions_.end()) {
+			return false;
+		}
+		const auto document_it = word_it->second.find(document_id);
+		if (document_it == word_it->second.end()) {
+			return false;
+		}
+		lists.push_back(&document_it->second);
+	}
+	if (constraint.is_phrase) {
+		return ContainsPhrase(lists);
+	}
+	return ContainsNear(*lists[0], *lists[1], constraint.max_distance);
+}
+
+bool SearchServer::MatchesPositionalConstraints(const Query& query, int document_id) const {
+	return all_of(query.positional_constraints.begin(), query.positional_constraints.end(),
+		[&](const PositionalConstraint& constraint) {
+			return MatchesPositionalConstraint(constraint, document_id);
+		});
+}
+
+pmr::vector<int> SearchServer::FindPositionalMatches(const Query& query, pmr::memory_resource* resource) const {
+	// Candidates come from the rarest word of the first constraint, the rest is checked per document
+	const PositionalConstraint& first = query.positional_constraints.front();
+	const map<int, PositionList>* candidates = nullptr;
+	for (const string_view word : first.words) {
+		const auto it = word_to_document_positions_.find(word);
+		if (it == word_to_document_positions_.end()) {
+			return pmr::vector<int>(resource);
+		}
+		if (candidates == nullptr || it->second.size() < candidates->size()) {
+			candidates = &it->second;
+		}
+	}
+
+	pmr::vector<int> result(resource);
+	for (const auto& [document_id, positions] : *candidates) {
+		if (MatchesPositionalConstraints(query, document_id)) {
+			result.push_back(document_id);
+		}
+	}
+	return result;
+}
+
+pmr::vector<string_view> SearchServer::ExpandWildcard(string_view pattern, pmr::memory_resource* resource) const {
+	const string_view prefix = pattern.substr(0, pattern.find('*'));
+	pmr::vector<string_view> words(resource);
+	for (auto it = word_to_document_freqs_.lower_bound(prefix);
+		it != word_to_document_freqs_.end() && it->first.substr(0, prefix.size()) == prefix; ++it) {
+		if (MatchesWildcard(pattern, it->first)) {
+			words.push_back(it->first);
+			if (words.size() == static_cast<size_t>(MAX_WILDCARD_EXPANSION)) {
+				break;
+			}
+		}
+	}
+	return words;
+}
+
+pmr::vector<pair<int, double>> SearchServer::MergeWildcardPostings(string_view pattern,
+	pmr::memory_resource* resource) const {
+	using PostingIterator = map<int, double>::const_iterator;
+	pmr::vector<pair<PostingIterator, PostingIterator>> ranges(resource);
+	size_t total_size = 0;
+	for (const string_view word : ExpandWildcard(pattern, resource)) {
+		const auto& postings = word_to_document_freqs_.at(word);
+		ranges.emplace_back(postings.begin(), postings.end());
+		total_size += postings.size();
+	}
+
+	// K-way merge through a min-heap on the current document id of every posting list
+	const auto greater_document = [](const auto& lhs, const auto& rhs) {
+		return lhs.first->first > rhs.first->first;
+	};
+	make_heap(ranges.begin(), ranges.end(), greater_document);
+
+	pmr::vector<pair<int, double>> merged(resource);
+	merged.reserve(total_size);
+	while (!ranges.empty()) {
+		pop_heap(ranges.begin(), ranges.end(), greater_document);
+		auto& range = ranges.back();
+		const auto [document_id, term_freq] = *range.first;
+		if (!merged.empty() && merged.back().first == document_id) {
+			merged.back().second += term_freq;
+		}
+		else {
+			merged.emplace_back(document_id, term_freq);
+		}
+		if (++range.first == range.second) {
+			ranges.pop_back();
+		}
+		else {
+			push_heap(ranges.begin(), ranges.end(), greater_document);
+		}
+	}
+	return merged;
+}
+
+bool SearchServer::DocumentMatchesWildcard(string_view pattern, int document_id) const {
+	const auto& words_freq = documents_.at(document_id).words_freq;
+	const string_view prefix = pattern.substr(0, pattern.find('*'));
+	for (auto it = words_freq.lower_bound(prefix);
+		it != words_freq.end() && it->first.substr(0, prefix.size()) == prefix; ++it) {
+		if (MatchesWildcard(pattern, it->first)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+SearchServer::DocumentCandidates SearchServer::SelectCandidates(const DocumentFilter& filter) const {
+	DocumentCandidates candidates;
+	if (!filter.HasStatusFilter() && !filter.HasRatingFilter()) {
+		candidates.accepts_all = true;
+		return candidates;
+	}
+
+	if (filter.HasRatingFilter()) {
+		// Walk the rating range and keep the ids whose status bitmap accepts them
+		for (auto it = rating_to_documents_.lower_bound({ filter.GetMinRating(), numeric_limits<int>::min() });
+			it != rating_to_documents_.end() && it->first <= filter.GetMaxRating(); ++it) {
+			const int document_id = it->second;
+			bool accepted = !filter.HasStatusFilter();
+			for (int status = 0; status < DOCUMENT_STATUS_COUNT && !accepted; ++status) {
+				accepted = filter.AcceptsStatus(static_cast<DocumentStatus>(status))
+					&& status_to_documents_[status].Contains(document_id);
+			}
+			if (accepted) {
+				candidates.bitmap.Insert(document_id);
+			}
+		}
+	}
+	else {
+		int accepted_count = 0;
+		for (int status = 0; status < DOCUMENT_STATUS_COUNT; ++status) {
+			if (filter.AcceptsStatus(static_cast<DocumentStatus>(status))) {
+				candidates.status_bitmap = &status_to_documents_[status];
+				++accepted_count;
+			}
+		}
+		if (accepted_count == 1) {
+			return candidates;
+		}
+		candidates.status_bitmap = nullptr;
+		for (int status = 0; status < DOCUMENT_STATUS_COUNT; ++status) {
+			if (filter.AcceptsStatus(static_cast<DocumentStatus>(status))) {
+				candidates.bitmap |= status_to_documents_[status];
+			}
+		}
+	}
+	return candidates;
+}
+
+void SearchServer::IndexDocumentAttributes(int document_id, DocumentStatus status, int rating) {
+	status_to_documents_[static_cast<int>(status)].Insert(document_id);
+	rating_to_documents_.emplace(rating, document_id);
+}
+
+void SearchServer::RemoveDocumentAttributes(int document_id, DocumentStatus status, int rating) {
+	status_to_documents_[static_cast<int>(status)].Erase(document_id);
+	rating_to_documents_.erase({ rating, document_id });
+}
+
+int SearchServer::AcquireSlot(int document_id) {
+	slot_to_document_.push_back(document_id);
+	return static_cast<int>(slot_to_document_.size()) - 1;
+}
+
+void SearchServer::ReleaseSlot(int slot) {
+	slot_to_document_[slot] = -1;
+	++free_slot_count_;
+}
+
+void SearchServer::IndexSlotPostings(int slot, const map<string_view, double>& words_freq) {
+	for (const auto& [word, term_freq] : words_freq) {
+		SlotPostings& postings = word_to_slot_postings_[word];
+		postings.slots.push_back(slot);
+		postings.term_freqs.push_back(static_cast<float>(term_freq));
+	}
+}
+
+void SearchServer::RemoveSlotPostings(int slot, const map<string_view, double>& words_freq) {
+	for (const auto& [word, _] : words_freq) {
+		const auto postings_it = word_to_slot_postings_.find(word);
+		if (word_to_document_freqs_.count(word) == 0) {
+			word_to_slot_postings_.erase(postings_it);
+			continue;
+		}
+		SlotPostings& postings = postings_it->second;
+		const auto it = lower_bound(postings.slots.begin(), postings.slots.end(), slot);
+		postings.term_freqs[it - postings.slots.begin()] = -0.0f;
+	}
+}
+
+void SearchServer::ReclaimFreeSlots() {
+	if (free_slot_count_ * 2 <= slot_to_document_.size()) {
+		return;
+	}
+	// The live slots keep their order, so every posting list stays sorted
+	vector<int> renumbered_slots(slot_to_document_.size(), -1);
+	size_t slot_count = 0;
+	for (size_t slot = 0; slot < slot_to_document_.size(); ++slot) {
+		if (slot_to_document_[slot] >= 0) {
+			renumbered_slots[slot] = static_cast<int>(slot_count);
+			slot_to_document_[slot_count++] = slot_to_document_[slot];
+		}
+	}
+	slot_to_document_.resize(slot_count);
+	free_slot_count_ = 0;
+	for (auto& [document_id, document_data] : documents_) {
+		document_data.slot = renumbered_slots[document_data.slot];
+	}
+	for (auto& [word, postings] : word_to_slot_postings_) {
+		size_t kept = 0;
+		for (size_t i = 0; i < postings.slots.size(); ++i) {
+			if (renumbered_slots[postings.slots[i]] >= 0) {
+				postings.slots[kept] = renumbered_slots[postings.slots[i]];
+				postings.term_freqs[kept] = postings.term_freqs[i];
+				++kept;
+			}
+		}
+		postings.slots.resize(kept);
+		postings.term_freqs.resize(kept);
+	}
+}
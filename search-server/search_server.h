@@ -3,7 +3,14 @@
 #include "string_processing.h"
 #include "document.h"
 #include "log_duration.h"
+#include "search_metrics.h"
 #include "concurrent_map.h"
+#include "position_list.h"
+#include "document_bitmap.h"
+#include "document_filter.h"
+#include "scoring_kernels.h"
+#include "query_arena.h"
+#include "query_plan.h"
 
 #include <vector>
 #include <string>
@@ -16,10 +23,122 @@
 #include <list>
 #include <execution>
 #include <deque>
+#include <array>
+#include <utility>
 #include <type_traits>
+#include <cmath>
+#include <memory>
+#include <memory_resource>
+#include <unordered_map>
 
 const int MAX_RESULT_DOCUMENT_COUNT = 5;
 const float TOLERANCE = 1e-6;
+// A wildcard query word (cat*, c*t) matches at most this many dictionary words
+const int MAX_WILDCARD_EXPANSION = 128;
+// A fuzzy-matched query word adds at most this many misspelling candidates, the closest first
+const int MAX_FUZZY_EXPANSION = 32;
+
+// Ranking order of search results: by relevance, equal relevance by rating
+inline bool IsMoreRelevant(const Document& lhs, const Document& rhs) {
+	if (std::abs(lhs.relevance - rhs.relevance) < TOLERANCE) {
+		return lhs.rating > rhs.rating;
+	}
+	return lhs.relevance > rhs.relevance;
+}
+
+// Ranking order of result pages: by exact relevance, then by rating, then by id. Unlike
+// IsMoreRelevant it is a strict total order, so a cursor marks exactly one position.
+inline bool IsRankedBefore(const Document& lhs, const Document& rhs) {
+	if (lhs.relevance != rhs.relevance) {
+		return lhs.relevance > rhs.relevance;
+	}
+	if (lhs.rating != rhs.rating) {
+		return lhs.rating > rhs.rating;
+	}
+	return lhs.id < rhs.id;
+}
+
+// Opaque position in a ranked result list. A default-constructed cursor asks for the first page.
+class SearchCursor {
+public:
+	bool IsAtEnd() const {
+		return at_end_;
+	}
+
+private:
+	friend class SearchServer;
+
+	bool has_position_ = false;
+	bool at_end_ = false;
+	// Last document of the previous page
+	double relevance_ = 0;
+	int rating_ = 0;
+	int document_id_ = 0;
+	// Index state, query and filter the position belongs to
+	uint64_t generation_ = 0;
+	size_t query_hash_ = 0;
+	DocumentFilter filter_;
+};
+
+struct SearchPage {
+	std::vector<Document> documents;
+	SearchCursor next_cursor;
+};
+
+// Size of the optional positional index, reported apart from the rest of the index
+struct PositionalIndexStats {
+	size_t posting_count = 0;
+	size_t position_count = 0;
+	// Varint payload of all position lists
+	size_t encoded_bytes = 0;
+	// Payload capacity plus an estimate of the map nodes holding the lists
+	size_t allocated_bytes = 0;
+};
+
+// Heap footprint of one index structure. As in PositionalIndexStats, the bytes are element
+// sizes and capacities plus an estimate of the container nodes.
+struct MemoryUsage {
+	size_t entry_count = 0;
+	size_t allocated_bytes = 0;
+};
+
+// Terms with at least min_posting_count and fewer than 2 * min_posting_count postings
+struct PostingSizeBucket {
+	size_t min_posting_count = 0;
+	size_t term_count = 0;
+	// Postings of these terms in word_to_document_freqs_ and in the slot postings
+	size_t allocated_bytes = 0;
+};
+
+struct MemoryStats {
+	MemoryUsage word_to_document_freqs;
+	MemoryUsage document_to_word_freqs;
+	// Including the word frequencies kept with every document
+	MemoryUsage documents;
+	MemoryUsage document_ids;
+	MemoryUsage slot_postings;
+	MemoryUsage string_storage;
+	// Status bitmaps and the rating index of DocumentFilter
+	MemoryUsage document_attributes;
+	MemoryUsage positional_index;
+	MemoryUsage fuzzy_index;
+	// Sum of the structures above, the figure the memory budget applies to
+	size_t total_bytes = 0;
+	// Mapped corpus files holding loaded texts; page cache rather than heap, not in total_bytes
+	MemoryUsage mapped_files;
+	// Power-of-two buckets by posting count, from 1 up to the largest term
+	std::vector<PostingSizeBucket> posting_size_histogram;
+};
+
+enum class MemoryBudgetPolicy {
+	REJECT,  // a document that does not fit is rejected
+	COMPACT, // Compact() runs first, and the document is rejected if it still does not fit
+};
+
+class MemoryBudgetExceeded : public std::runtime_error {
+public:
+	using std::runtime_error::runtime_error;
+};
 
 class SearchServer {
 public:
@@ -32,6 +151,11 @@ public:
 	void AddDocument(int document_id, std::string_view document, DocumentStatus status,
 		const std::vector<int>& ratings);
 
+	// False for text holding a character with a code from 0 to 31, which AddDocument rejects
+	static bool IsValidWord(std::string_view word);
+
+	// A plus word with '+' (+cat) is required: only documents containing every required word
+	// match and get scored, the other plus words only add to their relevance
 	template <typename DocumentPredicate>
 	std::vector<Document> FindTopDocuments(const std::string_view raw_query,
 		DocumentPredicate document_predicate) const;
@@ -40,6 +164,13 @@ public:
 
 	std::vector<Document> FindTopDocuments(std::string_view raw_query) const;
 
+	// The filter is applied to postings before they are scored, see DocumentFilter
+	std::vector<Document> FindTopDocuments(std::string_view raw_query, const DocumentFilter& filter) const;
+	// Same, but the temporaries of the query come from the caller's resource instead of the
+	// thread's arena, e.g. a monotonic_buffer_resource over a caller-owned buffer
+	std::vector<Document> FindTopDocuments(std::string_view raw_query, const DocumentFilter& filter,
+		std::pmr::memory_resource* resource) const;
+
 	template <typename DocumentPredicate, typename ExecutionPolicy>
 	std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, const std::string_view raw_query,
 		DocumentPredicate document_predicate) const;
@@ -48,14 +179,66 @@ public:
 	std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, DocumentStatus status) const;
 	template <typename ExecutionPolicy>
 	std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query) const;
+	template <typename ExecutionPolicy>
+	std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query,
+		const DocumentFilter& filter) const;
+
+	// Scores with an external IDF, e.g. computed over all shards of a distributed index.
+	// inverse_document_freq is called as double(std::string_view term) for indexed query words and for
+	// plus wildcards that match something, with the pattern as written in the query
+	template <typename DocumentPredicate, typename ExecutionPolicy, typename InverseDocumentFreq>
+	std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, const std::string_view raw_query,
+		DocumentPredicate document_predicate, InverseDocumentFreq inverse_document_freq) const;
+	template <typename ExecutionPolicy, typename InverseDocumentFreq>
+	std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, const std::string_view raw_query,
+		const DocumentFilter& filter, InverseDocumentFreq inverse_document_freq) const;
+
+	// Same results as FindTopDocuments(raw_query, filter) for every query, but the queries are
+	// scored in groups that read each posting list once for all queries using the word.
+	// Queries with plus wildcards, positional operators or required words are answered one by one.
+	std::vector<std::vector<Document>> FindTopDocumentsBatch(const std::vector<std::string_view>& raw_queries,
+		const DocumentFilter& filter = DocumentFilter(DocumentStatus::ACTUAL)) const;
+
+	// Streams the top documents, best first, into visitor(const Document&) instead of returning
+	// a vector; a visitor returning bool stops the stream by returning false
+	template <typename DocumentVisitor>
+	void VisitTopDocuments(std::string_view raw_query, const DocumentFilter& filter, DocumentVisitor visitor) const;
+	template <typename ExecutionPolicy, typename DocumentVisitor>
+	void VisitTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, const DocumentFilter& filter,
+		DocumentVisitor visitor) const;
+
+	// Keyset pagination: a page holds the page_size documents that follow the cursor in
+	// IsRankedBefore order. Documents up to the cursor are dropped while they are collected and
+	// the rest go through a heap of page_size entries, so a deep page costs about as much as the
+	// first one. Throws invalid_argument if the cursor comes from another query or filter, or
+	// the index has changed since it was issued. Pages are always scored sequentially: the
+	// cursor compares exact relevance, and the parallel path may sum the terms in another order.
+	SearchPage FindTopDocumentsPage(std::string_view raw_query, const DocumentFilter& filter,
+		const SearchCursor& cursor = {}, size_t page_size = MAX_RESULT_DOCUMENT_COUNT) const;
+
+	// Changes on every modification of the index
+	uint64_t GetGeneration() const;
 
 	int GetDocumentCount() const;
 
+	// Number of documents containing the word
+	int GetWordDocumentCount(std::string_view word) const;
+	// Document counts of the terms a query is scored with: its plus words, indexed or not, their
+	// fuzzy expansions and its plus wildcards, counted over their merged postings. A distributed index sums them over its shards once per query and
+	// scores with the totals through the external IDF. The views point into raw_query and the index.
+	std::map<std::string_view, int> GetQueryTermDocumentCounts(std::string_view raw_query) const;
+
 	std::set<int>::iterator begin();
 
 	std::set<int>::iterator end();
 
 	std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::string_view raw_query, int document_id) const;
+	// Same, but the words go to a caller-owned buffer, which is cleared first and can be reused between calls
+	DocumentStatus MatchDocument(std::string_view raw_query, int document_id,
+		std::vector<std::string_view>& matched_words) const;
+	// Same, with the parsed query in the caller's resource
+	DocumentStatus MatchDocument(std::string_view raw_query, int document_id,
+		std::vector<std::string_view>& matched_words, std::pmr::memory_resource* resource) const;
 
 	std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(
 		const std::execution::sequenced_policy& policy, const std::string_view raw_query, int document_id) const;
@@ -69,11 +252,82 @@ public:
 	template<typename ExecutionPolicy>
 	void RemoveDocument(ExecutionPolicy&& policy, int document_id);
 
+	// Removes a batch in one pass: the postings are grouped by word and, under par, different
+	// words are updated concurrently. Throws out_of_range and removes nothing if an id is unknown.
+	void RemoveDocuments(const std::vector<int>& document_ids);
+	template <typename ExecutionPolicy>
+	void RemoveDocuments(ExecutionPolicy&& policy, const std::vector<int>& document_ids);
+
+	// In-place updates; all of them throw out_of_range for an unknown id.
+	// Status and rating updates touch only the secondary indexes, not the postings.
+	void UpdateDocumentStatus(int document_id, DocumentStatus status);
+	void UpdateDocumentRatings(int document_id, const std::vector<int>& ratings);
+	// Only postings of added, removed or reweighted words are changed; word positions,
+	// when indexed, are rebuilt for the whole document
+	void UpdateDocumentText(int document_id, std::string_view document);
+	// All three at once: the text is checked before anything changes, and the generation
+	// advances once
+	void UpdateDocument(int document_id, std::string_view document, DocumentStatus status,
+		const std::vector<int>& ratings);
+
+	// Keeps word positions of every posting, which enables phrase ("white cat") and
+	// proximity (white NEAR/3 cat) queries. Documents added earlier are indexed right away.
+	void EnablePositionalIndex();
+	bool HasPositionalIndex() const;
+	PositionalIndexStats GetPositionalIndexStats() const;
+
+	// Typo-tolerant search: every plus word also matches dictionary words within
+	// max_edit_distance (1 or 2) edits, scored with the weight 1 / (1 + distance).
+	// Words of up to 2 characters stay exact, words of up to 5 characters allow one edit.
+	// Candidates come from a SymSpell deletion index built here and kept up to date.
+	// Single-server only: typos are expanded against this server's dictionary, so a shard
+	// would miss the words only other shards hold. ShardedSearchServer and the shard
+	// processes do not offer it.
+	void EnableFuzzyMatching(int max_edit_distance = 2);
+	int GetFuzzyMaxEditDistance() const;
+
+	// A parallel policy is only a permission: the planner runs the query sequentially
+	// when the cost model says the parallel overhead does not pay off.
+	// ExplainQuery reports the plan a parallel call would use.
+	QueryPlan ExplainQuery(std::string_view raw_query) const;
+	void SetQueryCostModel(const QueryCostModel& cost_model);
+	const QueryCostModel& GetQueryCostModel() const;
+
+	// Walks every index structure, so it costs about as much as a pass over the index
+	MemoryStats GetMemoryStats() const;
+	// Caps MemoryStats::total_bytes: AddDocument and UpdateDocumentText throw MemoryBudgetExceeded
+	// before storing a text that would not fit. Capacity doubling of the internal vectors may
+	// still overshoot it by a few percent. 0 removes the cap.
+	void SetMemoryBudget(size_t budget_bytes, MemoryBudgetPolicy policy = MemoryBudgetPolicy::REJECT);
+	size_t GetMemoryBudget() const;
+	// Rebuilds the index from the live documents, which releases the texts of removed and
+	// rewritten documents and the spare capacity of the postings. The old index is freed only
+	// at the end, so the call needs room for two. Word views handed out earlier are invalidated.
+	void Compact();
+
 private:
+	// Builds its impact-ordered postings from the index and reuses the query parser
+	friend class ImpactIndex;
+	// Tokenizes on its own thread and indexes texts that live in a mapped file
+	friend class CorpusLoader;
+	// Checks a batch of ids against its shards before removing any of them
+	friend class ShardedSearchServer;
+
+	// A batch group gets at most this many interleaved score columns, and fewer when the
+	// columns of a large index would not fit into BATCH_SCORE_BUFFER_BYTES
+	static constexpr size_t MAX_BATCH_COLUMNS = 64;
+	static constexpr size_t BATCH_SCORE_BUFFER_BYTES = 4 << 20;
+	// A batch removal tombstones the slot postings of a word when it removes fewer than one in
+	// this many of them, and compacts the word's postings otherwise
+	static constexpr size_t SLOT_COMPACTION_RATIO = 32;
+
 	struct DocumentData {
 		int rating;
 		DocumentStatus status;
 		std::map<std::string_view, double> words_freq;
+		std::string_view text;
+		// Index into the dense score buffer of the scoring kernels
+		int slot;
 	};
 	const std::set<std::string, std::less<>> stop_words_;
 	std::map<std::string_view, std::map<int, double>> word_to_document_freqs_;
@@ -81,38 +335,288 @@ private:
 	std::map<int, DocumentData> documents_;
 	std::set<int> document_ids_;
 
+	// Copy of word_to_document_freqs_ laid out for the scoring kernels:
+	// document slots in ascending order and float term frequencies.
+	// A removed document leaves tombstones: postings of its free slot with a term_freq of -0.0,
+	// which add -0.0 to the slot's untouched score and so never mark it
+	struct SlotPostings {
+		std::vector<int> slots;
+		std::vector<float> term_freqs;
+	};
+	std::map<std::string_view, SlotPostings> word_to_slot_postings_;
+	// -1 marks a free slot. Every document gets a slot past the last one, so postings are only
+	// appended; the slots are renumbered once most of them are free
+	std::vector<int> slot_to_document_;
+	size_t free_slot_count_ = 0;
+
 	std::deque<std::string> string_storage;
+	// Mapped corpus files whose bytes are the texts of loaded documents, see CorpusLoader
+	struct ExternalStorage {
+		std::shared_ptr<const void> owner;
+		std::string_view bytes;
+	};
+	std::vector<ExternalStorage> external_storage_;
 
-	bool IsStopWord(std::string_view word) const;
+	// Secondary indexes for DocumentFilter
+	std::array<DocumentBitmap, DOCUMENT_STATUS_COUNT> status_to_documents_;
+	std::set<std::pair<int, int>> rating_to_documents_;
 
-	static bool IsValidWord(std::string_view word);
+	uint64_t generation_ = 0;
+
+	bool positional_index_enabled_ = false;
+	std::map<std::string_view, std::map<int, PositionList>> word_to_document_positions_;
+
+	// 0 when fuzzy matching is off
+	int fuzzy_max_edit_distance_ = 0;
+	// Every deletion variant of every dictionary word -> dictionary words it came from
+	std::unordered_map<std::string, std::vector<std::string_view>> deletion_to_words_;
+
+	QueryCostModel query_cost_model_;
+
+	// 0 when there is no budget
+	size_t memory_budget_ = 0;
+	MemoryBudgetPolicy memory_budget_policy_ = MemoryBudgetPolicy::REJECT;
+	// Measured total_bytes plus the estimates of the documents added since, which are upper
+	// bounds; removals are not subtracted, so the estimate never falls below the real figure
+	size_t memory_usage_estimate_ = 0;
+	// Generation right after the last Compact(); compacting again before a change frees nothing
+	uint64_t compacted_generation_ = 0;
+
+	bool IsStopWord(std::string_view word) const;
 
 	std::vector<std::string_view> SplitIntoWordsNoStop(std::string_view text) const;
 
 	static int ComputeAverageRating(const std::vector<int>& ratings);
 
+	// AddDocument without the copy and the tokenization: the words must point into document,
+	// and document into storage that lives as long as the server
+	void AddTokenizedDocument(int document_id, std::string_view document, DocumentStatus status,
+		const std::vector<int>& ratings, const std::vector<std::string_view>& words);
+
+	// Tokenizes the text and checks the memory budget before copying it into string_storage;
+	// the words point into the copy
+	std::vector<std::string_view> StoreDocumentText(std::string_view document);
+	// The update steps without the generation bump; the setters return whether anything changed
+	bool SetDocumentStatus(int document_id, DocumentStatus status);
+	bool SetDocumentRating(int document_id, int rating);
+	// stored_words come from StoreDocumentText
+	void SetDocumentText(int document_id, const std::vector<std::string_view>& stored_words);
+	// Upper bound of the bytes a document adds to the index; text_bytes is 0 for a text
+	// the server does not copy
+	size_t EstimateDocumentBytes(size_t text_bytes, const std::vector<std::string_view>& words) const;
+	// Throws MemoryBudgetExceeded if the document does not fit into the budget
+	void ReserveDocumentMemory(size_t text_bytes, const std::vector<std::string_view>& words);
+
 	struct QueryWord {
 		std::string_view data;
 		bool is_minus;
+		bool is_required;
 		bool is_stop;
+		bool is_wildcard;
 	};
 
 	QueryWord ParseQueryWord(std::string_view text) const;
 
+	// Words of a phrase must follow each other; the two words of NEAR/k must be at most k apart.
+	// Positions count non-stop words only, so stop words inside a phrase are skipped.
+	struct PositionalConstraint {
+		std::pmr::vector<std::string_view> words;
+		uint32_t max_distance = 0;
+		bool is_phrase = true;
+	};
+
+	// All vectors live in one memory resource, normally the query arena
 	struct Query {
-		std::vector<std::string_view> plus_words;
-		std::vector<std::string_view> minus_words;
+		explicit Query(std::pmr::memory_resource* resource)
+			: plus_words(resource), minus_words(resource), positional_constraints(resource)
+			, plus_wildcards(resource), minus_wildcards(resource), fuzzy_words(resource), required_words(resource) {
+		}
+
+		std::pmr::vector<std::string_view> plus_words;
+		std::pmr::vector<std::string_view> minus_words;
+		std::pmr::vector<PositionalConstraint> positional_constraints;
+		// Words with '*': each is expanded over the term dictionary and scored as one term
+		std::pmr::vector<std::string_view> plus_wildcards;
+		std::pmr::vector<std::string_view> minus_wildcards;
+		// Dictionary words near a plus word with their distance weight, plus words themselves excluded
+		std::pmr::vector<std::pair<std::string_view, double>> fuzzy_words;
+		// Plus words with '+': a document must contain all of them. They are plus words as well,
+		// and are matched exactly even under fuzzy matching.
+		std::pmr::vector<std::string_view> required_words;
 	};
 
-	Query ParseQueryCore(const std::string_view text) const;
-	Query ParseQuery(const std::string_view text) const;
+	Query ParseQueryCore(const std::string_view text,
+		std::pmr::memory_resource* resource = std::pmr::get_default_resource()) const;
+	Query ParseQuery(const std::string_view text,
+		std::pmr::memory_resource* resource = std::pmr::get_default_resource()) const;
+
+	void IndexDocumentPositions(int document_id, const std::vector<std::string_view>& words);
+	void RemoveDocumentPositions(int document_id, const std::map<std::string_view, double>& words_freq);
+	bool MatchesPositionalConstraint(const PositionalConstraint& constraint, int document_id) const;
+	bool MatchesPositionalConstraints(const Query& query, int document_id) const;
+	// Sorted ids of documents satisfying every positional constraint of the query
+	std::pmr::vector<int> FindPositionalMatches(const Query& query, std::pmr::memory_resource* resource) const;
+
+	// Dictionary words matching the pattern, found in the sorted range of its literal prefix
+	std::pmr::vector<std::string_view> ExpandWildcard(std::string_view pattern,
+		std::pmr::memory_resource* resource = std::pmr::get_default_resource()) const;
+	// Postings of all expansions merged by document id, term frequencies summed
+	std::pmr::vector<std::pair<int, double>> MergeWildcardPostings(std::string_view pattern,
+		std::pmr::memory_resource* resource = std::pmr::get_default_resource()) const;
+	bool DocumentMatchesWildcard(std::string_view pattern, int document_id) const;
+
+	// A word entering or leaving the dictionary; no-ops while fuzzy matching is off
+	void AddFuzzyWord(std::string_view word);
+	void RemoveFuzzyWord(std::string_view word);
+	// Fills query.fuzzy_words from the plus words
+	void ExpandFuzzyWords(Query& query) const;
 
 	// Existence required
 	double ComputeWordInverseDocumentFreq(std::string_view word) const;
+	// The IDF the plain FindTopDocuments overloads score with
+	struct LocalInverseDocumentFreq {
+		const SearchServer* search_server;
 
-	template <typename DocumentPredicate, typename ExecutionPolicy>
-	std::vector<Document> FindAllDocuments(const ExecutionPolicy& policy, const Query& query,
-		DocumentPredicate document_predicate) const;
+		double operator()(std::string_view word) const {
+			return search_server->ComputeWordInverseDocumentFreq(word);
+		}
+	};
+	// A wildcard is scored as one term over its merged postings: locally from their count,
+	// through an external IDF by the pattern itself
+	template <typename InverseDocumentFreq>
+	double ComputePatternInverseDocumentFreq(InverseDocumentFreq& inverse_document_freq, std::string_view pattern,
+		size_t posting_count) const {
+		if constexpr (std::is_same_v<InverseDocumentFreq, LocalInverseDocumentFreq>) {
+			return std::log(GetDocumentCount() * 1.0 / posting_count);
+		}
+		else {
+			return inverse_document_freq(pattern);
+		}
+	}
+
+	// Plus words and fuzzy expansions present in the index, in scoring order
+	struct PlannedTerm {
+		std::string_view word;
+		double weight;
+		const SlotPostings* postings;
+	};
+
+	struct ExecutionPlan {
+		explicit ExecutionPlan(std::pmr::memory_resource* resource) : terms(resource) {
+		}
+
+		std::pmr::vector<PlannedTerm> terms;
+		// With the plus wildcards, except for queries with required words
+		size_t posting_count = 0;
+		QueryCostModel::ParallelTasks term_tasks;
+		QueryCostModel::ParallelTasks wildcard_tasks;
+		bool parallel = false;
+		// A sequential execution collects the touched slots instead of scanning the score buffer
+		bool sparse = false;
+	};
+
+	// Orders the terms rarest first and, if parallel_allowed, picks the cheaper execution.
+	// Queries with required words always run sequentially.
+	ExecutionPlan PlanQuery(const Query& query, bool parallel_allowed, std::pmr::memory_resource* resource) const;
+	// Documents of the minus words and minus wildcards
+	DocumentBitmap CollectExcludedDocuments(const Query& query, std::pmr::memory_resource* resource) const;
+	// Ascending slots of the documents with every required word and without the minus words.
+	// The required posting lists are intersected shortest first.
+	std::pmr::vector<int> IntersectRequiredWords(const Query& query, std::pmr::memory_resource* resource) const;
+
+	// Documents accepted by a DocumentFilter, resolved through the secondary indexes
+	struct DocumentCandidates {
+		bool accepts_all = false;
+		// A single-status filter uses the status bitmap of the index as is, without a copy
+		const DocumentBitmap* status_bitmap = nullptr;
+		DocumentBitmap bitmap;
+
+		const DocumentBitmap& GetBitmap() const {
+			return status_bitmap != nullptr ? *status_bitmap : bitmap;
+		}
+	};
+
+	DocumentCandidates SelectCandidates(const DocumentFilter& filter) const;
+
+	// Scores a group of queries, one score column each, and stores their top documents.
+	// results[i] receives the answer to queries[i].
+	void FindTopDocumentsBatchGroup(const std::vector<const Query*>& queries, const DocumentCandidates& candidates,
+		std::vector<std::vector<Document>*>& results, std::pmr::memory_resource* resource) const;
+	void IndexDocumentAttributes(int document_id, DocumentStatus status, int rating);
+	void RemoveDocumentAttributes(int document_id, DocumentStatus status, int rating);
+
+	// Everything a batch removal changes in the postings of one word; owned by one thread at a time
+	struct WordRemoval {
+		std::string_view word;
+		std::map<int, double>* postings;
+		SlotPostings* slot_postings;
+		// nullptr without the positional index
+		std::map<int, PositionList>* positions;
+		std::vector<int> document_ids;
+		std::vector<int> slots;
+	};
+
+	// Validates and deduplicates the ids, then groups their postings by word
+	std::vector<WordRemoval> PrepareWordRemovals(std::vector<int>& document_ids);
+	static void ApplyWordRemoval(WordRemoval& removal);
+	// Drops emptied words and the removed documents' rows, sequentially
+	void FinishDocumentRemovals(const std::vector<int>& document_ids, const std::vector<WordRemoval>& removals);
+
+	int AcquireSlot(int document_id);
+	void ReleaseSlot(int slot);
+	// Appends the postings of the newest slot
+	void IndexSlotPostings(int slot, const std::map<std::string_view, double>& words_freq);
+	// Tombstones the postings of a slot; words gone from the index lose their slot postings
+	void RemoveSlotPostings(int slot, const std::map<std::string_view, double>& words_freq);
+	// Renumbers the slots without the free ones and drops the tombstones once more than half
+	// of the slots are free, so every slot costs O(1) amortized to reclaim
+	void ReclaimFreeSlots();
+
+	// Calls callback(document_id, term_freq) for the postings the predicate accepts
+	template <typename Postings, typename DocumentPredicate, typename Callback>
+	void ForEachAcceptedPosting(const Postings& postings, const DocumentPredicate& document_predicate,
+		Callback callback) const;
+	// Same for candidates: the smaller of the two sides drives the intersection
+	template <typename Postings, typename Callback>
+	void ForEachAcceptedPosting(const Postings& postings, const DocumentCandidates& candidates,
+		Callback callback) const;
+
+	template <typename DocumentPredicate>
+	bool IsAcceptedDocument(const DocumentPredicate& document_predicate, int document_id) const;
+	bool IsAcceptedDocument(const DocumentCandidates& candidates, int document_id) const;
+
+	// PostingFilter is either a DocumentPredicate or DocumentCandidates
+	// A null resource stands for the thread's query arena
+	template <typename PostingFilter, typename ExecutionPolicy, typename InverseDocumentFreq>
+	std::vector<Document> FindTopDocumentsImpl(const ExecutionPolicy& policy, std::string_view raw_query,
+		const PostingFilter& posting_filter, InverseDocumentFreq inverse_document_freq,
+		std::pmr::memory_resource* resource = nullptr) const;
+	template <typename PostingFilter, typename ExecutionPolicy, typename InverseDocumentFreq, typename DocumentVisitor>
+	void VisitTopDocumentsImpl(const ExecutionPolicy& policy, std::string_view raw_query,
+		const PostingFilter& posting_filter, InverseDocumentFreq inverse_document_freq, DocumentVisitor& visitor,
+		std::pmr::memory_resource* resource = nullptr) const;
+
+	template <typename PostingFilter, typename ExecutionPolicy, typename InverseDocumentFreq>
+	std::pmr::vector<Document> FindAllDocuments(const ExecutionPolicy& policy, const Query& query,
+		const PostingFilter& posting_filter, InverseDocumentFreq inverse_document_freq,
+		std::pmr::memory_resource* resource) const;
+	// Calls collect(document) for every matched document, on the calling thread
+	template <typename PostingFilter, typename ExecutionPolicy, typename InverseDocumentFreq, typename Collector>
+	void CollectMatchedDocuments(const ExecutionPolicy& policy, const Query& query,
+		const PostingFilter& posting_filter, InverseDocumentFreq inverse_document_freq,
+		std::pmr::memory_resource* resource, Collector collect) const;
+	// Sequential path: scores go to the dense buffer through the scoring kernels, and the
+	// filter is applied once per matched document instead of once per posting. A sparse plan
+	// collects and resets only the touched slots, in the order a full scan would visit them.
+	template <typename PostingFilter, typename InverseDocumentFreq, typename Collector>
+	void CollectMatchedDocumentsDense(const Query& query, const ExecutionPlan& plan,
+		const PostingFilter& posting_filter, InverseDocumentFreq inverse_document_freq,
+		std::pmr::memory_resource* resource, Collector& collect) const;
+	// Path of queries with required words: only the documents left by the intersection are scored
+	template <typename PostingFilter, typename InverseDocumentFreq, typename Collector>
+	void CollectMatchedDocumentsConjunctive(const Query& query, const ExecutionPlan& plan,
+		const PostingFilter& posting_filter, InverseDocumentFreq inverse_document_freq,
+		std::pmr::memory_resource* resource, Collector& collect) const;
 
 };
 
@@ -126,75 +630,321 @@ SearchServer::SearchServer(const StringContainer& stop_words)
 	}
 }
 
-template <typename DocumentPredicate, typename ExecutionPolicy>
-std::vector<Document> SearchServer::FindAllDocuments(const ExecutionPolicy& policy, const Query& query,
-	DocumentPredicate document_predicate) const {
-	
-	const int thread_count = 8;
-	ConcurrentMap<int, double> document_to_relevance(thread_count);
-	
-	std::for_each(policy, query.plus_words.begin(), query.plus_words.end(), [&](const std::string_view word) {
-		if (word_to_document_freqs_.count(word) == 0) {
+template <typename Postings, typename DocumentPredicate, typename Callback>
+void SearchServer::ForEachAcceptedPosting(const Postings& postings, const DocumentPredicate& document_predicate,
+	Callback callback) const {
+	for (const auto [document_id, term_freq] : postings) {
+		const auto& document_data = documents_.at(document_id);
+		if (document_predicate(document_id, document_data.status, document_data.rating)) {
+			callback(document_id, term_freq);
+		}
+	}
+}
+
+template <typename Postings, typename Callback>
+void SearchServer::ForEachAcceptedPosting(const Postings& postings, const DocumentCandidates& candidates,
+	Callback callback) const {
+	if constexpr (std::is_same_v<Postings, std::map<int, double>>) {
+		if (!candidates.accepts_all && candidates.GetBitmap().GetCount() < postings.size()) {
+			candidates.GetBitmap().ForEach([&](int document_id) {
+				if (const auto it = postings.find(document_id); it != postings.end()) {
+					callback(document_id, it->second);
+				}
+				});
 			return;
 		}
-		const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-		for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-			const auto& document_data = documents_.at(document_id);
-			if (document_predicate(document_id, document_data.status, document_data.rating)) {
-				document_to_relevance[document_id].ref_to_value += term_freq * inverse_document_freq;
+	}
+	for (const auto [document_id, term_freq] : postings) {
+		if (candidates.accepts_all || candidates.GetBitmap().Contains(document_id)) {
+			callback(document_id, term_freq);
+		}
+	}
+}
+
+template <typename DocumentPredicate>
+bool SearchServer::IsAcceptedDocument(const DocumentPredicate& document_predicate, int document_id) const {
+	const auto& document_data = documents_.at(document_id);
+	return document_predicate(document_id, document_data.status, document_data.rating);
+}
+
+inline bool SearchServer::IsAcceptedDocument(const DocumentCandidates& candidates, int document_id) const {
+	return candidates.accepts_all || candidates.GetBitmap().Contains(document_id);
+}
+
+template <typename PostingFilter, typename InverseDocumentFreq, typename Collector>
+void SearchServer::CollectMatchedDocumentsDense(const Query& query, const ExecutionPlan& plan,
+	const PostingFilter& posting_filter, InverseDocumentFreq inverse_document_freq,
+	std::pmr::memory_resource* resource, Collector& collect) const {
+
+	const size_t slot_count = slot_to_document_.size();
+	double* const scores = TakeScoreBuffer(slot_count);
+	std::pmr::vector<int> touched_slots(resource);
+	if (plan.sparse) {
+		touched_slots.reserve(plan.posting_count);
+	}
+	{
+		SEARCH_METRICS_STAGE(POSTINGS);
+		for (const PlannedTerm& term : plan.terms) {
+			const SlotPostings& postings = *term.postings;
+			SEARCH_METRICS_COUNT(POSTINGS_SCANNED, postings.slots.size());
+			AccumulateScores(postings.slots.data(), postings.term_freqs.data(), postings.slots.size(),
+				term.weight * inverse_document_freq(term.word), scores);
+			if (plan.sparse) {
+				touched_slots.insert(touched_slots.end(), postings.slots.begin(), postings.slots.end());
 			}
 		}
-	});	
+		for (const std::string_view pattern : query.plus_wildcards) {
+			const auto postings = MergeWildcardPostings(pattern, resource);
+			if (postings.empty()) {
+				continue;
+			}
+			SEARCH_METRICS_COUNT(POSTINGS_SCANNED, postings.size());
+			const double pattern_inverse_document_freq =
+				ComputePatternInverseDocumentFreq(inverse_document_freq, pattern, postings.size());
+			for (const auto [document_id, term_freq] : postings) {
+				const int slot = documents_.at(document_id).slot;
+				scores[slot] += term_freq * pattern_inverse_document_freq;
+				if (plan.sparse) {
+					touched_slots.push_back(slot);
+				}
+			}
+		}
+	}
+	bool is_filter_selective = false;
+	if constexpr (std::is_same_v<PostingFilter, DocumentCandidates>) {
+		is_filter_selective = !posting_filter.accepts_all && posting_filter.GetBitmap().GetCount() < slot_count;
+	}
+	if (plan.sparse) {
+		std::sort(touched_slots.begin(), touched_slots.end());
+		touched_slots.erase(std::unique(touched_slots.begin(), touched_slots.end()), touched_slots.end());
+		// A selective filter makes a full scan visit the documents by id
+		if (is_filter_selective) {
+			std::sort(touched_slots.begin(), touched_slots.end(), [this](int lhs, int rhs) {
+				return slot_to_document_[lhs] < slot_to_document_[rhs];
+				});
+		}
+	}
+
+	{
+		SEARCH_METRICS_STAGE(MINUS_WORDS);
+		for (const std::string_view word : query.minus_words) {
+			if (const auto it = word_to_slot_postings_.find(word); it != word_to_slot_postings_.end()) {
+				for (const int slot : it->second.slots) {
+					scores[slot] = -0.0;
+				}
+			}
+		}
+		for (const std::string_view pattern : query.minus_wildcards) {
+			for (const auto [document_id, _] : MergeWildcardPostings(pattern, resource)) {
+				scores[documents_.at(document_id).slot] = -0.0;
+			}
+		}
+	}
+
+	std::pmr::vector<int> positional_matches(resource);
+	if (!query.positional_constraints.empty()) {
+		positional_matches = FindPositionalMatches(query, resource);
+	}
 
-	std::for_each(policy, query.minus_words.begin(), query.minus_words.end(), [&](const std::string_view word) {
-		if (word_to_document_freqs_.count(word) == 0) {
+	const auto add_if_matched = [&](int document_id, int slot) {
+		if (std::signbit(scores[slot]) || !IsAcceptedDocument(posting_filter, document_id)) {
+			return;
+		}
+		if (!query.positional_constraints.empty()
+			&& !std::binary_search(positional_matches.begin(), positional_matches.end(), document_id)) {
 			return;
 		}
-		for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-			document_to_relevance.Erase(document_id);
+		collect(Document(document_id, scores[slot], documents_.at(document_id).rating));
+	};
+	if (plan.sparse) {
+		for (const int slot : touched_slots) {
+			// A tombstone leaves its free slot at -0.0, which rejects it before the id is used
+			add_if_matched(slot_to_document_[slot], slot);
+		}
+		ReleaseScoreBuffer(touched_slots.data(), touched_slots.size());
+		return;
+	}
+	if constexpr (std::is_same_v<PostingFilter, DocumentCandidates>) {
+		// A selective filter drives the collection instead of the whole buffer
+		if (is_filter_selective) {
+			posting_filter.GetBitmap().ForEach([&](int document_id) {
+				add_if_matched(document_id, documents_.at(document_id).slot);
+				});
+			ReleaseScoreBuffer(slot_count);
+			return;
 		}
-	});
+	}
+	for (size_t slot = 0; slot < slot_count; ++slot) {
+		// Free slots are never touched, so their -0.0 rejects them before the id is used
+		add_if_matched(slot_to_document_[slot], static_cast<int>(slot));
+	}
+	ReleaseScoreBuffer(slot_count);
+}
+
+template <typename PostingFilter, typename InverseDocumentFreq, typename Collector>
+void SearchServer::CollectMatchedDocumentsConjunctive(const Query& query, const ExecutionPlan& plan,
+	const PostingFilter& posting_filter, InverseDocumentFreq inverse_document_freq,
+	std::pmr::memory_resource* resource, Collector& collect) const {
 
-	std::vector<Document> matched_documents;
-	for (const auto [document_id, relevance] : document_to_relevance.BuildOrdinaryMap()) {
-		matched_documents.push_back(
-			{ document_id, relevance, documents_.at(document_id).rating });
+	std::pmr::vector<int> slots(resource);
+	{
+		SEARCH_METRICS_STAGE(POSTINGS);
+		slots = IntersectRequiredWords(query, resource);
 	}
+	// The filter and the positions are checked while the candidates are few, before any scoring
+	size_t accepted_count = 0;
+	for (const int slot : slots) {
+		// The required lists may share the tombstones of a removed document
+		const int document_id = slot_to_document_[slot];
+		if (document_id >= 0 && IsAcceptedDocument(posting_filter, document_id)
+			&& MatchesPositionalConstraints(query, document_id)) {
+			slots[accepted_count++] = slot;
+		}
+	}
+	slots.resize(accepted_count);
+
+	std::pmr::vector<double> scores(slots.size(), 0.0, resource);
+	if (!slots.empty()) {
+		SEARCH_METRICS_STAGE(POSTINGS);
+		for (const PlannedTerm& term : plan.terms) {
+			const SlotPostings& postings = *term.postings;
+			SEARCH_METRICS_COUNT(POSTINGS_SCANNED, slots.size());
+			AccumulateMatchedScores(slots.data(), slots.size(), postings.slots.data(), postings.term_freqs.data(),
+				postings.slots.size(), term.weight * inverse_document_freq(term.word), scores.data());
+		}
+		for (const std::string_view pattern : query.plus_wildcards) {
+			const auto postings = MergeWildcardPostings(pattern, resource);
+			if (postings.empty()) {
+				continue;
+			}
+			const double pattern_inverse_document_freq =
+				ComputePatternInverseDocumentFreq(inverse_document_freq, pattern, postings.size());
+			for (size_t i = 0; i < slots.size(); ++i) {
+				const int document_id = slot_to_document_[slots[i]];
+				const auto it = std::lower_bound(postings.begin(), postings.end(), document_id,
+					[](const auto& posting, int id) {
+						return posting.first < id;
+					});
+				if (it != postings.end() && it->first == document_id) {
+					scores[i] += it->second * pattern_inverse_document_freq;
+				}
+			}
+		}
+	}
+
+	for (size_t i = 0; i < slots.size(); ++i) {
+		const int document_id = slot_to_document_[slots[i]];
+		collect(Document(document_id, scores[i], documents_.at(document_id).rating));
+	}
+}
+
+template <typename PostingFilter, typename ExecutionPolicy, typename InverseDocumentFreq>
+std::pmr::vector<Document> SearchServer::FindAllDocuments(const ExecutionPolicy& policy, const Query& query,
+	const PostingFilter& posting_filter, InverseDocumentFreq inverse_document_freq,
+	std::pmr::memory_resource* resource) const {
+
+	std::pmr::vector<Document> matched_documents(resource);
+	CollectMatchedDocuments(policy, query, posting_filter, inverse_document_freq, resource,
+		[&matched_documents](const Document& document) {
+			matched_documents.push_back(document);
+		});
 	return matched_documents;
 }
 
-template<typename ExecutionPolicy>
-void SearchServer::RemoveDocument(ExecutionPolicy&& policy, int document_id)
-{
-	const auto& words_map = document_to_word_freqs_[document_id];
+template <typename PostingFilter, typename ExecutionPolicy, typename InverseDocumentFreq, typename Collector>
+void SearchServer::CollectMatchedDocuments(const ExecutionPolicy& policy, const Query& query,
+	const PostingFilter& posting_filter, InverseDocumentFreq inverse_document_freq,
+	std::pmr::memory_resource* resource, Collector collect) const {
+
+	constexpr bool is_sequential = std::is_same_v<ExecutionPolicy, std::execution::sequenced_policy>;
+	const ExecutionPlan plan = PlanQuery(query, !is_sequential, resource);
+	if (!query.required_words.empty()) {
+		CollectMatchedDocumentsConjunctive(query, plan, posting_filter, inverse_document_freq, resource, collect);
+		return;
+	}
+	if (!plan.parallel) {
+		CollectMatchedDocumentsDense(query, plan, posting_filter, inverse_document_freq, resource, collect);
+		return;
+	}
 
-	std::vector<const std::string*> words_to_delete_(words_map.size());
-	std::transform(policy, words_map.cbegin(), words_map.cend(), words_to_delete_.begin(), [&](const auto& pair) {
-		return &pair.first;
+	// Minus words are resolved first, so excluded documents never reach the map
+	DocumentBitmap excluded_documents;
+	{
+		SEARCH_METRICS_STAGE(MINUS_WORDS);
+		excluded_documents = CollectExcludedDocuments(query, resource);
+	}
+
+	const int thread_count = 8;
+	// Tasks on other threads allocate here, so the single-threaded arena cannot be used
+	std::pmr::memory_resource* const shared_resource = GetThreadParallelQueryResource();
+	ConcurrentMap<int, double> document_to_relevance(thread_count, shared_resource);
+	
+	{
+		SEARCH_METRICS_STAGE(POSTINGS);
+		std::for_each(policy, plan.terms.begin(), plan.terms.end(), [&](const PlannedTerm& term) {
+			const double word_inverse_document_freq = term.weight * inverse_document_freq(term.word);
+			const auto& word_postings = word_to_document_freqs_.at(term.word);
+			SEARCH_METRICS_COUNT(POSTINGS_SCANNED, word_postings.size());
+			ForEachAcceptedPosting(word_postings, posting_filter, [&](int document_id, double term_freq) {
+				if (!excluded_documents.Contains(document_id)) {
+					document_to_relevance[document_id].ref_to_value += term_freq * word_inverse_document_freq;
+				}
+				});
+		});
+		std::for_each(policy, query.plus_wildcards.begin(), query.plus_wildcards.end(), [&](const std::string_view pattern) {
+			const auto postings = MergeWildcardPostings(pattern, shared_resource);
+			if (postings.empty()) {
+				return;
+			}
+			SEARCH_METRICS_COUNT(POSTINGS_SCANNED, postings.size());
+			const double pattern_inverse_document_freq =
+				ComputePatternInverseDocumentFreq(inverse_document_freq, pattern, postings.size());
+			ForEachAcceptedPosting(postings, posting_filter, [&](int document_id, double term_freq) {
+				if (!excluded_documents.Contains(document_id)) {
+					document_to_relevance[document_id].ref_to_value += term_freq * pattern_inverse_document_freq;
+				}
+				});
 		});
+	}
 
-	std::for_each(policy, words_to_delete_.cbegin(), words_to_delete_.cend(), [&](const auto word)
-		{
-			word_to_document_freqs_[*word].erase(document_id);
-            if(!word_to_document_freqs_.count(*word)) {
-                word_to_document_freqs_.erase(*word);
-            }
-		});	
-    
-    document_to_word_freqs_.erase(document_id);
-    
-    documents_.erase(document_id);
+	std::pmr::vector<int> positional_matches(resource);
+	if (!query.positional_constraints.empty()) {
+		positional_matches = FindPositionalMatches(query, resource);
+	}
 
-	//const auto it = find(policy, document_ids_.begin(), document_ids_.end(), document_id);
-	document_ids_.erase(document_id);
+	document_to_relevance.ForEach([&](int document_id, double relevance) {
+		if (!query.positional_constraints.empty()
+			&& !std::binary_search(positional_matches.begin(), positional_matches.end(), document_id)) {
+			return;
+		}
+		collect(Document(document_id, relevance, documents_.at(document_id).rating));
+		});
+}
+
+template<typename ExecutionPolicy>
+void SearchServer::RemoveDocument(ExecutionPolicy&& policy, int document_id)
+{
+	RemoveDocuments(policy, std::vector<int>{ document_id });
+}
+
+template <typename ExecutionPolicy>
+void SearchServer::RemoveDocuments(ExecutionPolicy&& policy, const std::vector<int>& document_ids) {
+	std::vector<int> unique_ids = document_ids;
+	auto removals = PrepareWordRemovals(unique_ids);
+	// Every task owns the inner containers of its word; the outer maps are not touched here
+	std::for_each(policy, removals.begin(), removals.end(), ApplyWordRemoval);
+	FinishDocumentRemovals(unique_ids, removals);
 }
 
 template <typename ExecutionPolicy>
 std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, DocumentStatus status) const {
-	return FindTopDocuments(policy,
-		raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
-			return document_status == status;
-		});
+	return FindTopDocuments(policy, raw_query, DocumentFilter(status));
+}
+
+template <typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query,
+	const DocumentFilter& filter) const {
+	return FindTopDocuments(policy, raw_query, filter, LocalInverseDocumentFreq{ this });
 }
 
 template <typename ExecutionPolicy>
@@ -206,25 +956,80 @@ template <typename DocumentPredicate, typename ExecutionPolicy>
 std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query,
 	DocumentPredicate document_predicate) const {
 
-	//LOG_DURATION_STREAM("Operation time", std::cout);
-	const auto query = ParseQuery(raw_query);
+	return FindTopDocuments(policy, raw_query, document_predicate, LocalInverseDocumentFreq{ this });
+}
 
-	auto matched_documents = FindAllDocuments(policy, query, document_predicate);
+template <typename DocumentPredicate, typename ExecutionPolicy, typename InverseDocumentFreq>
+std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query,
+	DocumentPredicate document_predicate, InverseDocumentFreq inverse_document_freq) const {
 
-	std::sort(policy, matched_documents.begin(), matched_documents.end(),
-		[](const Document& lhs, const Document& rhs) {
-			if (std::abs(lhs.relevance - rhs.relevance) < TOLERANCE) {
-				return lhs.rating > rhs.rating;
-			}
-			else {
-				return lhs.relevance > rhs.relevance;
+	return FindTopDocumentsImpl(policy, raw_query, document_predicate, inverse_document_freq);
+}
+
+template <typename ExecutionPolicy, typename InverseDocumentFreq>
+std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query,
+	const DocumentFilter& filter, InverseDocumentFreq inverse_document_freq) const {
+
+	return FindTopDocumentsImpl(policy, raw_query, SelectCandidates(filter), inverse_document_freq);
+}
+
+template <typename PostingFilter, typename ExecutionPolicy, typename InverseDocumentFreq>
+std::vector<Document> SearchServer::FindTopDocumentsImpl(const ExecutionPolicy& policy, std::string_view raw_query,
+	const PostingFilter& posting_filter, InverseDocumentFreq inverse_document_freq,
+	std::pmr::memory_resource* resource) const {
+
+	std::vector<Document> result;
+	auto collect = [&result](const Document& document) {
+		if (result.empty()) {
+			result.reserve(MAX_RESULT_DOCUMENT_COUNT);
+		}
+		result.push_back(document);
+	};
+	VisitTopDocumentsImpl(policy, raw_query, posting_filter, inverse_document_freq, collect, resource);
+	return result;
+}
+
+template <typename PostingFilter, typename ExecutionPolicy, typename InverseDocumentFreq, typename DocumentVisitor>
+void SearchServer::VisitTopDocumentsImpl(const ExecutionPolicy& policy, std::string_view raw_query,
+	const PostingFilter& posting_filter, InverseDocumentFreq inverse_document_freq, DocumentVisitor& visitor,
+	std::pmr::memory_resource* resource) const {
+
+	SEARCH_METRICS_COUNT(QUERIES, 1);
+	// Every temporary of the query comes from the thread's arena, unless the caller brought a resource
+	const QueryArenaScope arena_scope;
+	std::pmr::memory_resource* const query_resource = resource != nullptr ? resource : &arena_scope.GetArena();
+	const auto query = ParseQuery(raw_query, query_resource);
+
+	auto matched_documents = FindAllDocuments(policy, query, posting_filter, inverse_document_freq, query_resource);
+
+	{
+		SEARCH_METRICS_STAGE(SORT_TOP_K);
+		std::sort(policy, matched_documents.begin(), matched_documents.end(), IsMoreRelevant);
+	}
+	const size_t result_size = std::min(matched_documents.size(), static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT));
+
+	for (size_t i = 0; i < result_size; ++i) {
+		if constexpr (std::is_same_v<std::invoke_result_t<DocumentVisitor&, const Document&>, bool>) {
+			if (!visitor(matched_documents[i])) {
+				return;
 			}
-		});
-	if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-		matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+		}
+		else {
+			visitor(matched_documents[i]);
+		}
 	}
+}
 
-	return matched_documents;
+template <typename DocumentVisitor>
+void SearchServer::VisitTopDocuments(std::string_view raw_query, const DocumentFilter& filter,
+	DocumentVisitor visitor) const {
+	VisitTopDocuments(std::execution::seq, raw_query, filter, visitor);
+}
+
+template <typename ExecutionPolicy, typename DocumentVisitor>
+void SearchServer::VisitTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query,
+	const DocumentFilter& filter, DocumentVisitor visitor) const {
+	VisitTopDocumentsImpl(policy, raw_query, SelectCandidates(filter), LocalInverseDocumentFreq{ this }, visitor);
 }
 
 template <typename DocumentPredicate>
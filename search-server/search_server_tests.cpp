@@ -0,0 +1,1635 @@
+#include "admission_control.h"
+#include "concurrent_map.h"
+#include "corpus_loader.h"
+#include "impact_index.h"
+#include "position_list.h"
+#include "process_queries.h"
+#include "query_plan.h"
+#include "query_arena.h"
+#include "scoring_kernels.h"
+#include "search_server.h"
+#include "shard_coordinator.h"
+#include "shard_server.h"
+#include "sharded_search_server.h"
+#include "synthetic_data.h"
+#include "test_example_functions.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <execution>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <memory_resource>
+#include <mutex>
+#include <numeric>
+#include <random>
+#include <signal.h>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+// Zipf-distributed documents and queries; equal seeds give equal data
+struct TestData {
+    vector<string> dictionary;
+    vector<string> documents;
+    vector<string> queries;
+};
+
+TestData MakeTestData(uint32_t seed, int document_count, int query_count) {
+    mt19937 generator(seed);
+    TestData data;
+    data.dictionary = GenerateDictionary(generator, 300, 6);
+    const ZipfDistribution distribution(data.dictionary.size(), 1.0);
+    data.documents = GenerateZipfCorpus(generator, data.dictionary, distribution, document_count, 20);
+    for (int i = 0; i < query_count; ++i) {
+        data.queries.push_back(GenerateZipfText(generator, data.dictionary, distribution, 1 + i % 3, 0.1));
+    }
+    return data;
+}
+
+// Every fourth document is banned and ratings run from 0 to 9, so filters have something to drop
+void AddTestDocuments(SearchServer& search_server, const TestData& data) {
+    for (size_t i = 0; i < data.documents.size(); ++i) {
+        const int id = static_cast<int>(i);
+        search_server.AddDocument(id, data.documents[i], i % 4 == 3 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL,
+            { id % 10 });
+    }
+}
+
+const vector<DocumentFilter>& GetTestFilters() {
+    static const vector<DocumentFilter> filters = {
+        DocumentFilter(DocumentStatus::ACTUAL),
+        DocumentFilter(),
+        DocumentFilter(DocumentStatus::ACTUAL).SetRatingRange(7, 9),
+    };
+    return filters;
+}
+
+void AssertSameResults(const SearchServer& expected, const SearchServer& actual, const vector<string>& queries) {
+    ASSERT_EQUAL(expected.GetDocumentCount(), actual.GetDocumentCount());
+    for (const string& query : queries) {
+        for (const DocumentFilter& filter : GetTestFilters()) {
+            ASSERT_DOCUMENTS_EQUAL_HINT(expected.FindTopDocuments(query, filter), actual.FindTopDocuments(query, filter),
+                query);
+        }
+    }
+}
+
+vector<int> GetDocumentIds(SearchServer& search_server) {
+    return vector<int>(search_server.begin(), search_server.end());
+}
+
+// For results merged from independent parts, where equal documents may come in another order:
+// every position holds the same relevance and rating, and every group of such ties the same
+// ids, unless the group reaches the end of a full list and may continue past it
+void AssertSameRanking(const vector<Document>& expected, const vector<Document>& actual, const string& hint) {
+    ASSERT_EQUAL_HINT(actual.size(), expected.size(), hint);
+    const auto is_tie = [](const Document& lhs, const Document& rhs) {
+        return abs(lhs.relevance - rhs.relevance) < TOLERANCE && lhs.rating == rhs.rating;
+    };
+    for (size_t begin = 0; begin < expected.size();) {
+        size_t end = begin + 1;
+        while (end < expected.size() && is_tie(expected[begin], expected[end])) {
+            ++end;
+        }
+        vector<int> expected_ids;
+        vector<int> actual_ids;
+        for (size_t i = begin; i < end; ++i) {
+            ASSERT_HINT(is_tie(expected[i], actual[i]), hint);
+            expected_ids.push_back(expected[i].id);
+            actual_ids.push_back(actual[i].id);
+        }
+        sort(expected_ids.begin(), expected_ids.end());
+        sort(actual_ids.begin(), actual_ids.end());
+        if (end < static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT)) {
+            ASSERT_HINT(expected_ids == actual_ids, hint);
+        }
+        begin = end;
+    }
+}
+
+// RemoveDocuments
+
+void TestRemoveDocumentsMatchesRemoveDocument() {
+    const TestData data = MakeTestData(1, 2'000, 200);
+    SearchServer expected("and with"s);
+    SearchServer sequential("and with"s);
+    SearchServer parallel("and with"s);
+    for (SearchServer* search_server : { &expected, &sequential, &parallel }) {
+        AddTestDocuments(*search_server, data);
+    }
+
+    // Small batches tombstone the postings of frequent words, large ones compact them;
+    // repeated ids count once
+    mt19937 generator(2);
+    vector<int> live_ids = GetDocumentIds(expected);
+    for (const size_t batch_size : { 1, 3, 10, 400, 2, 600, 5 }) {
+        shuffle(live_ids.begin(), live_ids.end(), generator);
+        vector<int> batch(live_ids.end() - batch_size, live_ids.end());
+        live_ids.resize(live_ids.size() - batch_size);
+        for (const int id : batch) {
+            expected.RemoveDocument(id);
+        }
+        batch.push_back(batch.front());
+        sequential.RemoveDocuments(execution::seq, batch);
+        parallel.RemoveDocuments(execution::par, batch);
+
+        AssertSameResults(expected, sequential, data.queries);
+        AssertSameResults(expected, parallel, data.queries);
+        ASSERT(GetDocumentIds(expected) == GetDocumentIds(parallel));
+    }
+}
+
+void TestRemoveDocumentsRejectsUnknownIds() {
+    const TestData data = MakeTestData(3, 300, 50);
+    SearchServer expected("and with"s);
+    SearchServer search_server("and with"s);
+    AddTestDocuments(expected, data);
+    AddTestDocuments(search_server, data);
+
+    bool is_rejected = false;
+    try {
+        search_server.RemoveDocuments(execution::par, { 1, 2, 100'000 });
+    }
+    catch (const out_of_range&) {
+        is_rejected = true;
+    }
+    ASSERT(is_rejected);
+    AssertSameResults(expected, search_server, data.queries);
+}
+
+void TestRemoveDocuments() {
+    RUN_TEST(TestRemoveDocumentsMatchesRemoveDocument);
+    RUN_TEST(TestRemoveDocumentsRejectsUnknownIds);
+}
+
+// UpdateDocument
+
+void TestUpdateDocumentTextMatchesReadding() {
+    const TestData data = MakeTestData(4, 1'500, 200);
+    const TestData new_texts = MakeTestData(5, 1'500, 0);
+    SearchServer expected("and with"s);
+    SearchServer search_server("and with"s);
+    for (SearchServer* server : { &expected, &search_server }) {
+        server->EnablePositionalIndex();
+        AddTestDocuments(*server, data);
+    }
+    vector<string> queries = data.queries;
+    queries.push_back("\""s + data.dictionary[0] + " "s + data.dictionary[1] + "\""s);
+    queries.push_back(data.dictionary[2] + " NEAR/3 "s + data.dictionary[3]);
+
+    // A moved document leaves tombstones behind, so enough updates also renumber the slots
+    mt19937 generator(6);
+    for (int round = 0; round < 4; ++round) {
+        for (int i = 0; i < 300; ++i) {
+            const int id = static_cast<int>(generator() % data.documents.size());
+            const string& text = new_texts.documents[(id + round) % new_texts.documents.size()];
+            const DocumentStatus status = id % 4 == 3 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL;
+            expected.RemoveDocument(id);
+            expected.AddDocument(id, text, status, { id % 10 });
+            search_server.UpdateDocumentText(id, text);
+        }
+        AssertSameResults(expected, search_server, queries);
+        for (int id = 0; id < 50; ++id) {
+            ASSERT(expected.GetWordFrequencies(id) == search_server.GetWordFrequencies(id));
+        }
+    }
+}
+
+void TestUpdateDocumentIsOneChange() {
+    const TestData data = MakeTestData(7, 100, 0);
+    SearchServer search_server("and with"s);
+    AddTestDocuments(search_server, data);
+
+    uint64_t generation = search_server.GetGeneration();
+    search_server.UpdateDocument(1, "cat in the city"s, DocumentStatus::BANNED, { 8 });
+    ASSERT_EQUAL(search_server.GetGeneration(), generation + 1);
+    ASSERT_EQUAL(search_server.FindTopDocuments("cat"s, DocumentStatus::BANNED).size(), 1u);
+    ASSERT_EQUAL(search_server.FindTopDocuments("cat"s, DocumentStatus::BANNED)[0].rating, 8);
+
+    // An invalid text is rejected before the status and the rating change
+    generation = search_server.GetGeneration();
+    bool is_rejected = false;
+    try {
+        search_server.UpdateDocument(1, "dog\x01"s, DocumentStatus::ACTUAL, { 1 });
+    }
+    catch (const invalid_argument&) {
+        is_rejected = true;
+    }
+    ASSERT(is_rejected);
+    ASSERT_EQUAL(search_server.GetGeneration(), generation);
+    ASSERT_EQUAL(search_server.FindTopDocuments("cat"s, DocumentStatus::BANNED).size(), 1u);
+    ASSERT_EQUAL(search_server.FindTopDocuments("cat"s, DocumentStatus::BANNED)[0].rating, 8);
+}
+
+void TestUpdateDocumentTextFromIndexedWord() {
+    const TestData data = MakeTestData(8, 300, 0);
+    SearchServer search_server("and with"s);
+    AddTestDocuments(search_server, data);
+    for (int id = 100; id < 300; ++id) {
+        search_server.RemoveDocument(id);
+    }
+
+    // The budget forces a compaction, which frees the text the word points into
+    search_server.SetMemoryBudget(search_server.GetMemoryStats().total_bytes, MemoryBudgetPolicy::COMPACT);
+    const string_view indexed_word = search_server.GetWordFrequencies(0).begin()->first;
+    const string word(indexed_word);
+    search_server.UpdateDocumentText(1, indexed_word);
+    ASSERT_EQUAL(search_server.GetWordFrequencies(1).size(), 1u);
+    ASSERT_EQUAL(string(search_server.GetWordFrequencies(1).begin()->first), word);
+}
+
+void TestUpdateDocument() {
+    RUN_TEST(TestUpdateDocumentTextMatchesReadding);
+    RUN_TEST(TestUpdateDocumentIsOneChange);
+    RUN_TEST(TestUpdateDocumentTextFromIndexedWord);
+}
+
+// FindTopDocumentsPage
+
+vector<Document> ReadAllPages(const SearchServer& search_server, const string& query, const DocumentFilter& filter,
+    size_t page_size) {
+    vector<Document> documents;
+    SearchCursor cursor;
+    while (!cursor.IsAtEnd()) {
+        SearchPage page = search_server.FindTopDocumentsPage(query, filter, cursor, page_size);
+        ASSERT_HINT(page.documents.size() <= page_size, query);
+        ASSERT_HINT(!page.documents.empty() || page.next_cursor.IsAtEnd(), query);
+        documents.insert(documents.end(), page.documents.begin(), page.documents.end());
+        cursor = page.next_cursor;
+    }
+    return documents;
+}
+
+void TestPagesMatchFullSort() {
+    TestData data = MakeTestData(9, 1'000, 40);
+    // Copies of one text tie on relevance and rating, so only the id orders them
+    for (int i = 0; i < 30; ++i) {
+        data.documents.push_back(data.documents[i % 3]);
+    }
+    data.queries.push_back("+"s + data.dictionary[0] + " "s + data.dictionary[1]);
+    data.queries.push_back("+"s + data.dictionary[0] + " +"s + data.dictionary[2] + " -"s + data.dictionary[3]);
+    SearchServer search_server("and with"s);
+    AddTestDocuments(search_server, data);
+
+    for (const string& query : data.queries) {
+        for (const DocumentFilter& filter : GetTestFilters()) {
+            const vector<Document> full = search_server.FindTopDocumentsPage(query, filter, {},
+                data.documents.size()).documents;
+            ASSERT_HINT(is_sorted(full.begin(), full.end(), IsRankedBefore), query);
+            ASSERT_HINT(adjacent_find(full.begin(), full.end(), [](const Document& lhs, const Document& rhs) {
+                return !IsRankedBefore(lhs, rhs);
+            }) == full.end(), query);
+            // The tolerance of IsMoreRelevant may swap near ties, but not the relevances of the top
+            const vector<Document> top = search_server.FindTopDocuments(query, filter);
+            ASSERT_EQUAL_HINT(top.size(), min(full.size(), static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT)), query);
+            for (size_t i = 0; i < top.size(); ++i) {
+                ASSERT_HINT(abs(top[i].relevance - full[i].relevance) < TOLERANCE, query);
+            }
+            for (const size_t page_size : { 2, 7, 100 }) {
+                ASSERT_DOCUMENTS_EQUAL_HINT(full, ReadAllPages(search_server, query, filter, page_size), query);
+            }
+        }
+    }
+}
+
+void TestPageCursorIsChecked() {
+    const TestData data = MakeTestData(10, 200, 0);
+    SearchServer search_server("and with"s);
+    AddTestDocuments(search_server, data);
+    const string query = data.dictionary[0] + " "s + data.dictionary[1];
+    const DocumentFilter filter(DocumentStatus::ACTUAL);
+    const SearchCursor cursor = search_server.FindTopDocumentsPage(query, filter, {}, 2).next_cursor;
+    ASSERT(!cursor.IsAtEnd());
+
+    const auto is_rejected = [&](const string& raw_query, const DocumentFilter& page_filter) {
+        try {
+            search_server.FindTopDocumentsPage(raw_query, page_filter, cursor, 2);
+        }
+        catch (const invalid_argument&) {
+            return true;
+        }
+        return false;
+    };
+    ASSERT(!is_rejected(query, filter));
+    ASSERT(is_rejected(data.dictionary[0], filter));
+    ASSERT(is_rejected(query, DocumentFilter()));
+    ASSERT(is_rejected(query, DocumentFilter(DocumentStatus::ACTUAL).SetRatingRange(0, 5)));
+    search_server.RemoveDocument(0);
+    ASSERT(is_rejected(query, filter));
+}
+
+void TestFindTopDocumentsPage() {
+    RUN_TEST(TestPagesMatchFullSort);
+    RUN_TEST(TestPageCursorIsChecked);
+}
+
+// FindTopDocumentsBatch
+
+void TestBatchMatchesSingleQueries() {
+    // More queries than one block of ProcessQueries, with repeats and queries the batch answers one by one
+    TestData data = MakeTestData(11, 2'000, 600);
+    data.queries.push_back(data.queries[0]);
+    data.queries.push_back(data.dictionary[0].substr(0, 2) + "* "s + data.dictionary[1]);
+    data.queries.push_back("+"s + data.dictionary[0] + " "s + data.dictionary[4]);
+    data.queries.push_back("\""s + data.dictionary[0] + " "s + data.dictionary[1] + "\""s);
+    data.queries.push_back(""s);
+    SearchServer search_server("and with"s);
+    search_server.EnablePositionalIndex();
+    AddTestDocuments(search_server, data);
+    // Removed documents leave tombstones and free slots behind
+    for (int id = 0; id < 2'000; id += 7) {
+        search_server.RemoveDocument(id);
+    }
+
+    const vector<string_view> queries(data.queries.begin(), data.queries.end());
+    for (const DocumentFilter& filter : GetTestFilters()) {
+        const vector<vector<Document>> batch = search_server.FindTopDocumentsBatch(queries, filter);
+        ASSERT_EQUAL(batch.size(), queries.size());
+        for (size_t i = 0; i < queries.size(); ++i) {
+            ASSERT_DOCUMENTS_EQUAL_HINT(search_server.FindTopDocuments(queries[i], filter), batch[i], data.queries[i]);
+        }
+    }
+    const vector<vector<Document>> independent = ProcessQueries(search_server, data.queries);
+    const vector<vector<Document>> shared = ProcessQueries(search_server, data.queries, QueryBatchMode::SHARED_TRAVERSAL);
+    ASSERT_EQUAL(shared.size(), independent.size());
+    for (size_t i = 0; i < independent.size(); ++i) {
+        ASSERT_DOCUMENTS_EQUAL_HINT(independent[i], shared[i], data.queries[i]);
+    }
+}
+
+void TestFindTopDocumentsBatch() {
+    RUN_TEST(TestBatchMatchesSingleQueries);
+}
+
+// ConcurrentMap
+
+void TestConcurrentMapEraseMatchesMap() {
+    // One stripe and few keys make long clusters that wrap around the end of the table
+    mt19937 generator(12);
+    for (const size_t bucket_count : { 1, 3 }) {
+        ConcurrentMap<int, int> concurrent_map(bucket_count);
+        map<int, int> expected;
+        for (int step = 0; step < 20'000; ++step) {
+            const int key = static_cast<int>(generator() % 64) - 32;
+            if (generator() % 3 == 0) {
+                ASSERT_EQUAL(concurrent_map.Erase(key), expected.erase(key));
+            }
+            else {
+                concurrent_map[key].ref_to_value += step;
+                expected[key] += step;
+            }
+            if (step % 97 == 0) {
+                ASSERT(concurrent_map.BuildOrdinaryMap() == expected);
+            }
+        }
+        ASSERT(concurrent_map.BuildOrdinaryMap() == expected);
+        for (const auto& [key, _] : expected) {
+            ASSERT_EQUAL(concurrent_map.Erase(key), 1u);
+        }
+        ASSERT_EQUAL(concurrent_map.Erase(0), 0u);
+        ASSERT(concurrent_map.BuildOrdinaryMap().empty());
+    }
+}
+
+void TestConcurrentMapEraseFromThreads() {
+    // Every thread owns the keys equal to its index modulo the thread count
+    const int thread_count = 4;
+    const int key_count = 40'000;
+    ConcurrentMap<int, int> concurrent_map(2);
+    vector<int> thread_indexes(thread_count);
+    iota(thread_indexes.begin(), thread_indexes.end(), 0);
+    for_each(execution::par, thread_indexes.begin(), thread_indexes.end(), [&](int thread_index) {
+        for (int key = thread_index; key < key_count; key += thread_count) {
+            concurrent_map[key].ref_to_value = key;
+        }
+        for (int key = thread_index; key < key_count; key += thread_count) {
+            if (key % 3 != 0) {
+                concurrent_map.Erase(key);
+            }
+        }
+    });
+
+    map<int, int> expected;
+    for (int key = 0; key < key_count; key += 3) {
+        expected[key] = key;
+    }
+    ASSERT(concurrent_map.BuildOrdinaryMap() == expected);
+}
+
+void TestConcurrentMap() {
+    RUN_TEST(TestConcurrentMapEraseMatchesMap);
+    RUN_TEST(TestConcurrentMapEraseFromThreads);
+}
+
+// CorpusLoader
+
+void TestCorpusRoundTrip() {
+    const TestData data = MakeTestData(13, 500, 100);
+    SearchServer expected("and with"s);
+    AddTestDocuments(expected, data);
+
+    const string path = "search_server_tests_corpus.tsv"s;
+    {
+        ofstream corpus_file(path);
+        for (size_t i = 0; i < data.documents.size(); ++i) {
+            const int id = static_cast<int>(i);
+            WriteCorpusDocument(corpus_file, id, i % 4 == 3 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL,
+                { id % 10 }, data.documents[i]);
+        }
+    }
+    SearchServer search_server("and with"s);
+    CorpusLoader(search_server, { 64, 2 }).Load(path);
+    remove(path.c_str());
+    AssertSameResults(expected, search_server, data.queries);
+}
+
+void TestWriteCorpusDocumentRejectsControlCharacters() {
+    // Each of these would split or corrupt the line, or be rejected by AddDocument on load
+    for (const string& text : { "cat\tdog"s, "cat\ndog"s, "cat dog\r"s, "cat\x01"s }) {
+        ostringstream output;
+        bool is_rejected = false;
+        try {
+            WriteCorpusDocument(output, 1, DocumentStatus::ACTUAL, { 1 }, text);
+        }
+        catch (const invalid_argument&) {
+            is_rejected = true;
+        }
+        ASSERT(is_rejected);
+        ASSERT(output.str().empty());
+    }
+}
+
+void TestCorpusLoader() {
+    RUN_TEST(TestCorpusRoundTrip);
+    RUN_TEST(TestWriteCorpusDocumentRejectsControlCharacters);
+}
+
+// Compact
+
+void TestCompactMatchesRebuiltServer() {
+    TestData data = MakeTestData(14, 1'200, 200);
+    const TestData new_texts = MakeTestData(15, 200, 0);
+    data.queries.push_back("+"s + data.dictionary[0] + " "s + data.dictionary[1]);
+    data.queries.push_back("\""s + data.dictionary[0] + " "s + data.dictionary[1] + "\""s);
+    data.queries.push_back(data.dictionary[2] + " NEAR/3 "s + data.dictionary[3]);
+    data.queries.push_back(data.dictionary[4].substr(0, 2) + "* -"s + data.dictionary[5]);
+    data.queries.push_back(data.dictionary[6] + "x"s);
+
+    // The first half of the documents comes from a mapped corpus file, which Compact leaves in place
+    const string path = "search_server_tests_compact.tsv"s;
+    {
+        ofstream corpus_file(path);
+        for (int id = 0; id < 600; ++id) {
+            WriteCorpusDocument(corpus_file, id, id % 4 == 3 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL,
+                { id % 10 }, data.documents[id]);
+        }
+    }
+    SearchServer search_server("and with"s);
+    search_server.EnablePositionalIndex();
+    search_server.EnableFuzzyMatching();
+    CorpusLoader(search_server).Load(path);
+    remove(path.c_str());
+    for (size_t i = 600; i < data.documents.size(); ++i) {
+        const int id = static_cast<int>(i);
+        search_server.AddDocument(id, data.documents[i], id % 4 == 3 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL,
+            { id % 10 });
+    }
+
+    // Removed and rewritten documents leave tombstones, free slots and dead texts behind
+    map<int, string> live_texts;
+    for (size_t i = 0; i < data.documents.size(); ++i) {
+        live_texts[static_cast<int>(i)] = data.documents[i];
+    }
+    for (int id = 0; id < 1'200; id += 5) {
+        search_server.RemoveDocument(id);
+        live_texts.erase(id);
+    }
+    for (int id = 1; id < 1'200; id += 6) {
+        if (live_texts.count(id) == 0) {
+            continue;
+        }
+        const string& text = new_texts.documents[id % new_texts.documents.size()];
+        search_server.UpdateDocumentText(id, text);
+        live_texts[id] = text;
+    }
+
+    SearchServer expected("and with"s);
+    expected.EnablePositionalIndex();
+    expected.EnableFuzzyMatching();
+    for (const auto& [id, text] : live_texts) {
+        expected.AddDocument(id, text, id % 4 == 3 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL, { id % 10 });
+    }
+
+    const size_t string_bytes = search_server.GetMemoryStats().string_storage.allocated_bytes;
+    const uint64_t generation = search_server.GetGeneration();
+    search_server.Compact();
+    ASSERT(search_server.GetGeneration() != generation);
+    ASSERT(search_server.GetMemoryStats().string_storage.allocated_bytes < string_bytes);
+
+    AssertSameResults(expected, search_server, data.queries);
+    ASSERT(GetDocumentIds(expected) == GetDocumentIds(search_server));
+    for (const auto& [id, _] : live_texts) {
+        ASSERT(expected.GetWordFrequencies(id) == search_server.GetWordFrequencies(id));
+        for (size_t i = 0; i < 5; ++i) {
+            ASSERT(expected.MatchDocument(data.queries[i], id) == search_server.MatchDocument(data.queries[i], id));
+        }
+    }
+
+    // The compacted index keeps accepting changes
+    search_server.RemoveDocument(1);
+    expected.RemoveDocument(1);
+    search_server.UpdateDocumentText(2, new_texts.documents[0]);
+    expected.RemoveDocument(2);
+    expected.AddDocument(2, new_texts.documents[0], DocumentStatus::ACTUAL, { 2 });
+    AssertSameResults(expected, search_server, data.queries);
+}
+
+void TestCompact() {
+    RUN_TEST(TestCompactMatchesRebuiltServer);
+}
+
+// Required words and galloping
+
+vector<int> MakeSortedSlots(mt19937& generator, size_t count, int max_slot) {
+    vector<int> slots;
+    for (size_t i = 0; i < count; ++i) {
+        slots.push_back(static_cast<int>(generator() % max_slot));
+    }
+    sort(slots.begin(), slots.end());
+    slots.erase(unique(slots.begin(), slots.end()), slots.end());
+    return slots;
+}
+
+void TestGallopingMatchesMerge() {
+    mt19937 generator(16);
+    // Lists from empty to far longer than the other side, so the gallop runs off either end
+    for (const auto [lhs_size, rhs_size] : vector<pair<size_t, size_t>>{
+        { 0, 10 }, { 10, 0 }, { 1, 1 }, { 5, 5'000 }, { 50, 50 }, { 3'000, 40 }, { 200, 20'000 } }) {
+        const vector<int> lhs = MakeSortedSlots(generator, lhs_size, 30'000);
+        const vector<int> rhs = MakeSortedSlots(generator, rhs_size, 30'000);
+
+        vector<int> expected;
+        set_intersection(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), back_inserter(expected));
+        vector<int> output = lhs;
+        output.resize(IntersectSlots(output.data(), output.size(), rhs.data(), rhs.size(), output.data()));
+        ASSERT(output == expected);
+
+        expected.clear();
+        set_difference(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), back_inserter(expected));
+        output = lhs;
+        output.resize(SubtractSlots(output.data(), output.size(), rhs.data(), rhs.size(), output.data()));
+        ASSERT(output == expected);
+
+        for (const int slot : lhs) {
+            const size_t begin = generator() % (rhs.size() + 1);
+            const size_t position = GallopToSlot(rhs.data(), begin, rhs.size(), slot);
+            ASSERT_EQUAL(position, max(begin,
+                static_cast<size_t>(lower_bound(rhs.begin(), rhs.end(), slot) - rhs.begin())));
+        }
+
+        vector<float> term_freqs(rhs.size());
+        for (size_t i = 0; i < rhs.size(); ++i) {
+            term_freqs[i] = static_cast<float>(i + 1);
+        }
+        vector<double> scores(lhs.size(), 0.5);
+        AccumulateMatchedScores(lhs.data(), lhs.size(), rhs.data(), term_freqs.data(), rhs.size(), 2.0, scores.data());
+        for (size_t i = 0; i < lhs.size(); ++i) {
+            const auto it = lower_bound(rhs.begin(), rhs.end(), lhs[i]);
+            const double expected_score = it != rhs.end() && *it == lhs[i] ? 0.5 + term_freqs[it - rhs.begin()] * 2.0 : 0.5;
+            ASSERT_EQUAL(scores[i], expected_score);
+        }
+    }
+}
+
+void TestRequiredWordsMatchFilteredQuery() {
+    const TestData data = MakeTestData(17, 3'000, 0);
+    SearchServer search_server("and with"s);
+    search_server.EnablePositionalIndex();
+    AddTestDocuments(search_server, data);
+    // Removed and moved documents leave tombstones in the required lists
+    for (int id = 0; id < 3'000; id += 9) {
+        search_server.RemoveDocument(id);
+    }
+    for (int id = 4; id < 3'000; id += 11) {
+        if (search_server.GetWordFrequencies(id).empty()) {
+            continue;
+        }
+        search_server.UpdateDocumentText(id, data.documents[(id * 7) % data.documents.size()]);
+    }
+
+    const vector<string>& words = data.dictionary;
+    // Frequent and rare words, so the required lists differ in length by orders of magnitude
+    const vector<pair<string, vector<string>>> queries = {
+        { "+"s + words[0] + " +"s + words[1], { words[0], words[1] } },
+        { "+"s + words[0] + " +"s + words[60] + " "s + words[2], { words[0], words[60] } },
+        { "+"s + words[1] + " "s + words[3] + " -"s + words[4], { words[1] } },
+        { "+"s + words[0] + " +"s + words[2] + " +"s + words[5] + " -"s + words[7].substr(0, 2) + "*"s,
+            { words[0], words[2], words[5] } },
+        { "+"s + words[0] + " \""s + words[1] + " "s + words[2] + "\""s, { words[0] } },
+        { "+"s + words[250] + " +"s + words[0], { words[250], words[0] } },
+        { "+"s + words[0] + " +nosuchword"s, { words[0], "nosuchword"s } },
+    };
+    for (const auto& [query, required_words] : queries) {
+        // The same query without '+', restricted to the documents holding every required word
+        string plain_query = query;
+        plain_query.erase(remove(plain_query.begin(), plain_query.end(), '+'), plain_query.end());
+        const auto has_required_words = [&](int document_id, DocumentStatus status, int) {
+            const auto& word_frequencies = search_server.GetWordFrequencies(document_id);
+            return status == DocumentStatus::ACTUAL
+                && all_of(required_words.begin(), required_words.end(), [&](const string& word) {
+                    return word_frequencies.count(word) > 0;
+                });
+        };
+        const vector<Document> expected = search_server.FindTopDocuments(plain_query, has_required_words);
+        ASSERT_DOCUMENTS_EQUAL_HINT(expected, search_server.FindTopDocuments(query), query);
+        // The parallel sort may order ties differently
+        const vector<Document> parallel = search_server.FindTopDocuments(execution::par, query);
+        ASSERT_EQUAL_HINT(parallel.size(), expected.size(), query);
+        for (size_t i = 0; i < expected.size(); ++i) {
+            ASSERT_HINT(abs(parallel[i].relevance - expected[i].relevance) < TOLERANCE, query);
+        }
+
+        for (int id = 1; id < 3'000; id += 37) {
+            if (search_server.GetWordFrequencies(id).empty()) {
+                continue;
+            }
+            const auto [matched_words, status] = search_server.MatchDocument(query, id);
+            if (!has_required_words(id, DocumentStatus::ACTUAL, 0)) {
+                ASSERT_HINT(matched_words.empty(), query);
+            }
+        }
+    }
+}
+
+void TestRequiredWords() {
+    RUN_TEST(TestGallopingMatchesMerge);
+    RUN_TEST(TestRequiredWordsMatchFilteredQuery);
+}
+
+// Synthetic data
+
+void TestSyntheticDataIsPinned() {
+    // Benchmark corpora must not depend on the standard library, so the values for a seed are fixed
+    mt19937 generator(1);
+    ASSERT(GenerateDictionary(generator, 5, 6) == vector<string>({ "jq"s, "os"s, "qcsn"s, "tbh"s, "zwonwl"s }));
+    generator.seed(2);
+    const ZipfDistribution distribution(100, 1.0);
+    vector<size_t> ranks;
+    for (int i = 0; i < 5; ++i) {
+        ranks.push_back(distribution(generator));
+    }
+    ASSERT(ranks == vector<size_t>({ 4, 0, 0, 69, 9 }));
+}
+
+void TestSyntheticData() {
+    RUN_TEST(TestSyntheticDataIsPinned);
+}
+
+// ShardedSearchServer
+
+void AssertShardedMatchesSingle(const SearchServer& expected, const ShardedSearchServer& sharded,
+    const TestData& data) {
+    ASSERT_EQUAL(sharded.GetDocumentCount(), expected.GetDocumentCount());
+    for (const string& query : data.queries) {
+        for (const DocumentFilter& filter : GetTestFilters()) {
+            AssertSameRanking(expected.FindTopDocuments(query, filter), sharded.FindTopDocuments(query, filter), query);
+        }
+        const auto even_ids = [](int document_id, DocumentStatus, int) {
+            return document_id % 2 == 0;
+        };
+        AssertSameRanking(expected.FindTopDocuments(query, even_ids),
+            sharded.FindTopDocuments(execution::seq, query, even_ids), query);
+    }
+    for (size_t i = 0; i < 20; ++i) {
+        const string& query = data.queries[i];
+        for (int id = static_cast<int>(i); id < static_cast<int>(data.documents.size()); id += 97) {
+            if (expected.GetWordFrequencies(id).empty()) {
+                continue;
+            }
+            const auto [expected_words, expected_status] = expected.MatchDocument(query, id);
+            const auto [words, status] = sharded.MatchDocument(query, id);
+            ASSERT(vector<string>(words.begin(), words.end())
+                == vector<string>(expected_words.begin(), expected_words.end()));
+            ASSERT(status == expected_status);
+        }
+    }
+}
+
+void AssertDocumentsOnOwningShards(const ShardedSearchServer& sharded, int document_count) {
+    const size_t shard_count = sharded.GetShardCount();
+    vector<int> shard_document_counts(shard_count, 0);
+    for (int id = 0; id < document_count; ++id) {
+        const size_t owner = GetDocumentShardIndex(id, shard_count);
+        ASSERT_EQUAL(sharded.GetShardIndex(id), owner);
+        for (size_t shard = 0; shard < shard_count; ++shard) {
+            const bool is_present = !sharded.GetShard(shard).GetWordFrequencies(id).empty();
+            ASSERT(!is_present || shard == owner);
+            shard_document_counts[shard] += is_present;
+        }
+    }
+    for (size_t shard = 0; shard < shard_count; ++shard) {
+        ASSERT_EQUAL(sharded.GetShard(shard).GetDocumentCount(), shard_document_counts[shard]);
+    }
+}
+
+void TestShardedMatchesSingleServer() {
+    const TestData data = MakeTestData(18, 1'500, 150);
+    for (const size_t shard_count : { 1, 2, 3, 8 }) {
+        SearchServer expected("and with"s);
+        ShardedSearchServer sharded("and with"s, shard_count);
+        AddTestDocuments(expected, data);
+        for (size_t i = 0; i < data.documents.size(); ++i) {
+            const int id = static_cast<int>(i);
+            sharded.AddDocument(id, data.documents[i], i % 4 == 3 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL,
+                { id % 10 });
+        }
+        AssertDocumentsOnOwningShards(sharded, 1'500);
+        AssertShardedMatchesSingle(expected, sharded, data);
+
+        // Removals and updates go to the owning shard, and the corpus-wide IDF follows them
+        vector<int> removed_ids;
+        for (int id = 0; id < 1'500; id += 7) {
+            removed_ids.push_back(id);
+            expected.RemoveDocument(id);
+        }
+        sharded.RemoveDocuments(execution::par, removed_ids);
+        for (int id = 3; id < 1'500; id += 7) {
+            sharded.RemoveDocument(id);
+            expected.RemoveDocument(id);
+        }
+        for (int id = 1; id < 1'500; id += 13) {
+            if (id % 7 == 0 || id % 7 == 3) {
+                continue;
+            }
+            const string& text = data.documents[(id * 5) % data.documents.size()];
+            sharded.UpdateDocumentText(id, text);
+            expected.UpdateDocumentText(id, text);
+        }
+        AssertDocumentsOnOwningShards(sharded, 1'500);
+        AssertShardedMatchesSingle(expected, sharded, data);
+    }
+}
+
+void TestShardedSearchServer() {
+    RUN_TEST(TestShardedMatchesSingleServer);
+}
+
+// ShardCoordinator
+
+void TestCoordinatorSurvivesShardFailures() {
+    const TestData data = MakeTestData(19, 600, 60);
+    const size_t shard_count = 3;
+    vector<string> socket_paths;
+    vector<pid_t> pids;
+    for (size_t i = 0; i < shard_count; ++i) {
+        socket_paths.push_back("/tmp/search_server_tests_"s + to_string(getpid()) + "_"s + to_string(i) + ".sock"s);
+        pids.push_back(SpawnShardProcess(socket_paths.back(), "and with"s));
+    }
+    ShardCoordinator coordinator(socket_paths, chrono::milliseconds(500));
+    SearchServer expected("and with"s);
+    AddTestDocuments(expected, data);
+    for (size_t i = 0; i < data.documents.size(); ++i) {
+        const int id = static_cast<int>(i);
+        coordinator.AddDocument(id, data.documents[i], i % 4 == 3 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL,
+            { id % 10 });
+    }
+
+    // With every shard up the statistics are corpus-wide, so the ranking is the single server's
+    for (const string& query : data.queries) {
+        AssertSameRanking(expected.FindTopDocuments(query), coordinator.FindTopDocuments(query), query);
+        ASSERT_EQUAL(coordinator.GetLastQueryShardCount(), shard_count);
+    }
+
+    const auto assert_served_by = [&](const vector<size_t>& alive_shards) {
+        for (const string& query : data.queries) {
+            const auto documents = coordinator.FindTopDocuments(query);
+            ASSERT_EQUAL_HINT(coordinator.GetLastQueryShardCount(), alive_shards.size(), query);
+            for (const Document& document : documents) {
+                const size_t owner = GetDocumentShardIndex(document.id, shard_count);
+                ASSERT_HINT(find(alive_shards.begin(), alive_shards.end(), owner) != alive_shards.end(), query);
+            }
+        }
+    };
+
+    // A killed shard closes its connection
+    kill(pids[0], SIGKILL);
+    waitpid(pids[0], nullptr, 0);
+    assert_served_by({ 1, 2 });
+    ASSERT(!coordinator.IsShardAlive(0));
+
+    // A stopped shard keeps its connection open and runs into the receive timeout
+    kill(pids[1], SIGSTOP);
+    assert_served_by({ 2 });
+    ASSERT(!coordinator.IsShardAlive(1));
+    ASSERT_EQUAL(coordinator.GetAliveShardCount(), 1u);
+    kill(pids[1], SIGKILL);
+    waitpid(pids[1], nullptr, 0);
+
+    coordinator.Shutdown();
+    waitpid(pids[2], nullptr, 0);
+    for (const string& socket_path : socket_paths) {
+        unlink(socket_path.c_str());
+    }
+}
+
+void TestShardCoordinator() {
+    RUN_TEST(TestCoordinatorSurvivesShardFailures);
+}
+
+// Positional index
+
+void TestPositionListRoundTrip() {
+    // Gaps of 128 and more take several varint bytes
+    const vector<uint32_t> positions = { 0, 1, 127, 128, 255, 256, 300, 16'383, 16'384, 2'000'000, 2'000'001 };
+    PositionList list;
+    for (const uint32_t position : positions) {
+        list.Append(position);
+    }
+    ASSERT(list.Decode() == positions);
+    ASSERT_EQUAL(list.GetCount(), static_cast<uint32_t>(positions.size()));
+    ASSERT(list.GetEncodedSize() > positions.size());
+
+    PositionList far;
+    far.Append(130);
+    ASSERT(ContainsNear(list, far, 2));
+    ASSERT(!ContainsNear(list, far, 1));
+    PositionList next;
+    next.Append(16'385);
+    ASSERT(ContainsPhrase({ &list, &next }));
+    ASSERT(!ContainsPhrase({ &next, &list }));
+}
+
+void TestPhraseAndNearQueries() {
+    SearchServer search_server("and"s);
+    search_server.AddDocument(1, "white cat sat"s, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(2, "cat white"s, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(3, "white fluffy cat"s, DocumentStatus::ACTUAL, { 1 });
+    // Stop words take no position
+    search_server.AddDocument(4, "white and cat"s, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(5, "white a b cat"s, DocumentStatus::ACTUAL, { 1 });
+    string long_text;
+    for (int i = 0; i < 200; ++i) {
+        long_text += "filler"s + to_string(i) + " "s;
+    }
+    search_server.AddDocument(6, long_text + "white cat"s, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(7, "white "s + long_text + "cat"s, DocumentStatus::ACTUAL, { 1 });
+    search_server.EnablePositionalIndex();
+
+    const auto matches = [&](const string& query, int document_id) {
+        return !search_server.FindTopDocuments(query, [document_id](int id, DocumentStatus, int) {
+            return id == document_id;
+            }).empty();
+    };
+    const auto find_matches = [&](const string& query) {
+        vector<int> ids;
+        for (int id = 1; id <= 7; ++id) {
+            if (matches(query, id)) {
+                ids.push_back(id);
+            }
+        }
+        return ids;
+    };
+    ASSERT(find_matches("\"white cat\""s) == vector<int>({ 1, 4, 6 }));
+    ASSERT(find_matches("\"cat white\""s) == vector<int>({ 2 }));
+    ASSERT(find_matches("\"white fluffy cat\""s) == vector<int>({ 3 }));
+    ASSERT(find_matches("white NEAR/1 cat"s) == vector<int>({ 1, 2, 4, 6 }));
+    ASSERT(find_matches("white NEAR/2 cat"s) == vector<int>({ 1, 2, 3, 4, 6 }));
+    ASSERT(find_matches("white NEAR/3 cat"s) == vector<int>({ 1, 2, 3, 4, 5, 6 }));
+    ASSERT(!matches("white NEAR/200 cat"s, 7));
+    ASSERT(matches("white NEAR/201 cat"s, 7));
+}
+
+void TestInvalidPositionalQueries() {
+    SearchServer search_server("and"s);
+    search_server.AddDocument(1, "white cat"s, DocumentStatus::ACTUAL, { 1 });
+    search_server.EnablePositionalIndex();
+    for (const string& query : { "white NEAR/0 cat"s, "white NEAR/00 cat"s, "white NEAR/1234567890 cat"s,
+             "\"+white cat\""s, "\"white +cat\""s, "\"white -cat\""s, "\"white ca*\""s, "\"white cat"s,
+             "NEAR/2 cat"s, "white NEAR/2"s, "white NEAR/2 -cat"s }) {
+        bool is_rejected = false;
+        try {
+            search_server.FindTopDocuments(query);
+        } catch (const invalid_argument&) {
+            is_rejected = true;
+        }
+        ASSERT_HINT(is_rejected, query);
+    }
+}
+
+void TestPositionalIndex() {
+    RUN_TEST(TestPositionListRoundTrip);
+    RUN_TEST(TestPhraseAndNearQueries);
+    RUN_TEST(TestInvalidPositionalQueries);
+}
+
+// Wildcards
+
+void TestWildcardMatchesExpectedWords() {
+    SearchServer search_server(""s);
+    const vector<string> texts = { "prefix"s, "press"s, "pre"s, "prize"s, "apre"s, "cat"s, "cut"s, "coat"s, "cats"s };
+    for (size_t i = 0; i < texts.size(); ++i) {
+        search_server.AddDocument(static_cast<int>(i), texts[i], DocumentStatus::ACTUAL, { 1 });
+    }
+    const auto find_words = [&](const string& query) {
+        vector<string> words;
+        for (const Document& document : search_server.FindTopDocuments(query)) {
+            words.push_back(texts[document.id]);
+            const auto [matched_words, status] = search_server.MatchDocument(query, document.id);
+            ASSERT_EQUAL_HINT(matched_words.size(), 1u, query);
+            ASSERT_EQUAL_HINT(string(matched_words[0]), texts[document.id], query);
+        }
+        sort(words.begin(), words.end());
+        return words;
+    };
+    ASSERT(find_words("pre*"s) == vector<string>({ "pre"s, "prefix"s, "press"s }));
+    ASSERT(find_words("c*t"s) == vector<string>({ "cat"s, "coat"s, "cut"s }));
+    ASSERT(find_words("c*t*"s) == vector<string>({ "cat"s, "cats"s, "coat"s, "cut"s }));
+    ASSERT(find_words("pre* -pref*"s) == vector<string>({ "pre"s, "press"s }));
+    ASSERT(find_words("zebra*"s).empty());
+}
+
+void TestWildcardExpansionIsCapped() {
+    // One word per document, "wide000" to "wide199" in dictionary order
+    SearchServer search_server(""s);
+    const int document_count = MAX_WILDCARD_EXPANSION + 72;
+    for (int id = 0; id < document_count; ++id) {
+        string number = to_string(id);
+        search_server.AddDocument(id, "wide"s + string(3 - number.size(), '0') + number, DocumentStatus::ACTUAL, { 1 });
+    }
+    ASSERT_EQUAL(search_server.GetQueryTermDocumentCounts("wide*"s).at("wide*"sv), MAX_WILDCARD_EXPANSION);
+    const auto matches = [&](int document_id) {
+        return !search_server.FindTopDocuments("wide*"s, [document_id](int id, DocumentStatus, int) {
+            return id == document_id;
+            }).empty();
+    };
+    ASSERT(matches(0));
+    ASSERT(matches(MAX_WILDCARD_EXPANSION - 1));
+    ASSERT(!matches(MAX_WILDCARD_EXPANSION));
+    ASSERT(!matches(document_count - 1));
+}
+
+void TestWildcards() {
+    RUN_TEST(TestWildcardMatchesExpectedWords);
+    RUN_TEST(TestWildcardExpansionIsCapped);
+}
+
+// Fuzzy matching
+
+void TestFuzzyTypoWeights() {
+    SearchServer search_server(""s);
+    search_server.AddDocument(1, "elephant grey"s, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(2, "giraffe grey"s, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(3, "zebra"s, DocumentStatus::ACTUAL, { 1 });
+    search_server.EnableFuzzyMatching(2);
+
+    const auto exact = search_server.FindTopDocuments("elephant"s);
+    ASSERT_EQUAL(exact.size(), 1u);
+    ASSERT_EQUAL(exact[0].id, 1);
+    // One deletion, one substitution, then two deletions
+    for (const auto& [typo, distance] : vector<pair<string, int>>{ { "elephnt"s, 1 }, { "elephand"s, 1 },
+             { "elphnt"s, 2 } }) {
+        const auto documents = search_server.FindTopDocuments(typo);
+        ASSERT_EQUAL_HINT(documents.size(), 1u, typo);
+        ASSERT_EQUAL_HINT(documents[0].id, 1, typo);
+        ASSERT_HINT(abs(documents[0].relevance - exact[0].relevance / (1 + distance)) < TOLERANCE, typo);
+        const auto [words, status] = search_server.MatchDocument(typo, 1);
+        ASSERT_HINT(words == vector<string_view>({ "elephant"sv }), typo);
+    }
+    ASSERT(search_server.FindTopDocuments("elhnt"s).empty());
+}
+
+void TestFuzzyShortWordsStayExact() {
+    SearchServer search_server(""s);
+    search_server.AddDocument(1, "cat"s, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(2, "at"s, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(3, "horse"s, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(4, "dog"s, DocumentStatus::ACTUAL, { 1 });
+    search_server.EnableFuzzyMatching(2);
+    const auto find_ids = [&](const string& query) {
+        vector<int> ids;
+        for (const Document& document : search_server.FindTopDocuments(query)) {
+            ids.push_back(document.id);
+        }
+        sort(ids.begin(), ids.end());
+        return ids;
+    };
+
+    // Up to 2 characters: no edits
+    ASSERT(search_server.FindTopDocuments("ct"s).empty());
+    ASSERT(search_server.FindTopDocuments("ax"s).empty());
+    // Up to 5 characters: one edit, even though two are enabled
+    ASSERT(find_ids("cut"s) == vector<int>({ 1 }));
+    ASSERT(search_server.FindTopDocuments("cuts"s).empty());
+    ASSERT(find_ids("hors"s) == vector<int>({ 3 }));
+    ASSERT(search_server.FindTopDocuments("hrs"s).empty());
+}
+
+void TestFuzzyMatching() {
+    RUN_TEST(TestFuzzyTypoWeights);
+    RUN_TEST(TestFuzzyShortWordsStayExact);
+}
+
+// ImpactIndex
+
+// Relevance of one impact quantum, computed the way ImpactIndex does
+double ComputeImpactQuantum(SearchServer& search_server) {
+    double max_impact = 0;
+    for (const int document_id : search_server) {
+        for (const auto& [word, term_freq] : search_server.GetWordFrequencies(document_id)) {
+            max_impact = max(max_impact, term_freq * log(search_server.GetDocumentCount() * 1.0
+                / search_server.GetWordDocumentCount(word)));
+        }
+    }
+    return max_impact / ImpactIndex::IMPACT_LEVELS;
+}
+
+void TestImpactIndexMatchesServer() {
+    const TestData data = MakeTestData(20, 2'000, 200);
+    SearchServer search_server("and with"s);
+    AddTestDocuments(search_server, data);
+    const ImpactIndex impact_index(search_server);
+    ASSERT_EQUAL(impact_index.GetPostingCount(), [&] {
+        size_t count = 0;
+        for (const int document_id : search_server) {
+            count += search_server.GetWordFrequencies(document_id).size();
+        }
+        return count;
+    }());
+    const double quantum = ComputeImpactQuantum(search_server);
+
+    int checked_ids = 0;
+    for (const string& query : data.queries) {
+        // Every query word may shift a document by up to a quantum
+        const double bound = SplitIntoWords(query).size() * quantum + TOLERANCE;
+        for (const DocumentFilter& filter : GetTestFilters()) {
+            const auto expected = search_server.FindTopDocuments(query, filter);
+            ImpactSearchStats stats;
+            const auto actual = impact_index.FindTopDocuments(query, filter, numeric_limits<size_t>::max(), &stats);
+            ASSERT(stats.exact_relevance);
+            ASSERT_EQUAL_HINT(actual.size(), expected.size(), query);
+            for (size_t i = 0; i < actual.size(); ++i) {
+                // The i-th score moves no more than any single score does
+                ASSERT_HINT(abs(actual[i].relevance - expected[i].relevance) <= bound, query);
+                const int document_id = actual[i].id;
+                const auto exact = search_server.FindTopDocuments(query, [&](int id, DocumentStatus status, int rating) {
+                    return id == document_id && filter(id, status, rating);
+                    });
+                ASSERT_EQUAL_HINT(exact.size(), 1u, query);
+                ASSERT_HINT(abs(actual[i].relevance - exact[0].relevance) <= bound, query);
+                // A document further than two bounds from both neighbours cannot change places. Below the
+                // last one of a full list may be documents that did not make it, so it is not checked.
+                const bool is_apart_above = i == 0 || expected[i - 1].relevance - expected[i].relevance > 2 * bound;
+                const bool is_apart_below = i + 1 < expected.size()
+                    ? expected[i].relevance - expected[i + 1].relevance > 2 * bound
+                    : expected.size() < static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT);
+                if (is_apart_above && is_apart_below) {
+                    ASSERT_EQUAL_HINT(actual[i].id, expected[i].id, query);
+                    ++checked_ids;
+                }
+            }
+        }
+    }
+    ASSERT(checked_ids > 100);
+}
+
+void TestImpactIndexPostingBudget() {
+    const TestData data = MakeTestData(21, 2'000, 50);
+    SearchServer search_server("and with"s);
+    AddTestDocuments(search_server, data);
+    const ImpactIndex impact_index(search_server);
+    const DocumentFilter filter(DocumentStatus::ACTUAL);
+
+    int settled_stops = 0;
+    int budget_stops = 0;
+    for (const string& query : data.queries) {
+        ImpactSearchStats full_stats;
+        const auto full = impact_index.FindTopDocuments(query, filter, numeric_limits<size_t>::max(), &full_stats);
+        ASSERT(full_stats.exact_relevance);
+
+        // An early stop on settled top documents must not change them
+        if (full_stats.stopped_early) {
+            ImpactSearchStats stats;
+            const auto documents = impact_index.FindTopDocuments(query, filter, full_stats.postings_processed, &stats);
+            ASSERT(stats.stopped_early);
+            ASSERT(stats.exact_relevance);
+            ASSERT_DOCUMENTS_EQUAL_HINT(full, documents, query);
+            ++settled_stops;
+        }
+
+        ImpactSearchStats stats;
+        impact_index.FindTopDocuments(query, filter, 0, &stats);
+        ASSERT_EQUAL(stats.postings_processed, 0u);
+        ASSERT(stats.stopped_early == (full_stats.segments_processed > 0));
+        ASSERT(stats.exact_relevance == (full_stats.segments_processed == 0));
+
+        // The first segment reaches a budget of 1, so reading stops right after it
+        if (full_stats.segments_processed > 1) {
+            impact_index.FindTopDocuments(query, filter, 1, &stats);
+            ASSERT_EQUAL(stats.segments_processed, 1u);
+            ASSERT(stats.stopped_early);
+            ASSERT(!stats.exact_relevance);
+            ASSERT(stats.postings_processed < full_stats.postings_processed);
+            ++budget_stops;
+        }
+    }
+    ASSERT(settled_stops > 0);
+    ASSERT(budget_stops > 10);
+}
+
+void TestImpactIndexRejectsQueryForms() {
+    SearchServer search_server("and"s);
+    search_server.AddDocument(1, "white cat"s, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(2, "black dog"s, DocumentStatus::ACTUAL, { 1 });
+    search_server.EnablePositionalIndex();
+    search_server.EnableFuzzyMatching(2);
+    const ImpactIndex impact_index(search_server);
+    for (const string& query : { "\"white cat\""s, "white NEAR/2 cat"s, "whi*"s, "+white cat"s, "whyte"s }) {
+        bool is_rejected = false;
+        try {
+            impact_index.FindTopDocuments(query);
+        } catch (const invalid_argument&) {
+            is_rejected = true;
+        }
+        ASSERT_HINT(is_rejected, query);
+    }
+    // Minus words and minus wildcards are supported
+    const auto documents = impact_index.FindTopDocuments("white black -do*"s);
+    ASSERT_EQUAL(documents.size(), 1u);
+    ASSERT_EQUAL(documents[0].id, 1);
+}
+
+void TestImpactIndex() {
+    RUN_TEST(TestImpactIndexMatchesServer);
+    RUN_TEST(TestImpactIndexPostingBudget);
+    RUN_TEST(TestImpactIndexRejectsQueryForms);
+}
+
+// Caller-supplied query resource
+
+class CountingResource : public pmr::memory_resource {
+public:
+    size_t GetAllocationCount() const {
+        return allocation_count_;
+    }
+
+private:
+    size_t allocation_count_ = 0;
+
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        ++allocation_count_;
+        return pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void* data, size_t bytes, size_t alignment) override {
+        pmr::new_delete_resource()->deallocate(data, bytes, alignment);
+    }
+
+    bool do_is_equal(const pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
+void TestCallerResourceMatchesArena() {
+    const TestData data = MakeTestData(22, 1'000, 100);
+    SearchServer search_server("and with"s);
+    AddTestDocuments(search_server, data);
+
+    CountingResource resource;
+    vector<string_view> words;
+    vector<string_view> expected_words;
+    for (const string& query : data.queries) {
+        for (const DocumentFilter& filter : GetTestFilters()) {
+            ASSERT_DOCUMENTS_EQUAL_HINT(search_server.FindTopDocuments(query, filter),
+                search_server.FindTopDocuments(query, filter, &resource), query);
+        }
+        for (int id = 0; id < 1'000; id += 111) {
+            const DocumentStatus expected_status = search_server.MatchDocument(query, id, expected_words);
+            ASSERT(search_server.MatchDocument(query, id, words, &resource) == expected_status);
+            ASSERT_HINT(words == expected_words, query);
+        }
+    }
+    ASSERT(resource.GetAllocationCount() > 0);
+}
+
+void TestCallerResourceBypassesArena() {
+    const TestData data = MakeTestData(23, 300, 20);
+    SearchServer search_server("and with"s);
+    AddTestDocuments(search_server, data);
+
+    // A fresh thread has an untouched arena
+    size_t arena_high_water_mark = 0;
+    thread worker([&] {
+        array<byte, 64 << 10> buffer;
+        vector<string_view> words;
+        for (const string& query : data.queries) {
+            pmr::monotonic_buffer_resource resource(buffer.data(), buffer.size(), pmr::null_memory_resource());
+            search_server.FindTopDocuments(query, DocumentFilter(DocumentStatus::ACTUAL), &resource);
+            search_server.MatchDocument(query, 0, words, &resource);
+        }
+        arena_high_water_mark = GetThreadQueryArena().GetHighWaterMark();
+    });
+    worker.join();
+    ASSERT_EQUAL(arena_high_water_mark, 0u);
+}
+
+void TestQueryResource() {
+    RUN_TEST(TestCallerResourceMatchesArena);
+    RUN_TEST(TestCallerResourceBypassesArena);
+}
+
+// Query planning
+
+// Every document holds the eight common words and a unique one
+SearchServer MakePlannerTestServer() {
+    SearchServer search_server(""s);
+    for (int id = 0; id < 2'000; ++id) {
+        search_server.AddDocument(id, "alpha beta gamma delta epsilon zeta eta theta unique"s + to_string(id),
+            DocumentStatus::ACTUAL, { id % 10 });
+    }
+    QueryCostModel cost_model;
+    cost_model.thread_count = 8;
+    search_server.SetQueryCostModel(cost_model);
+    return search_server;
+}
+
+void TestPlannerCostsPerTermTasks() {
+    const SearchServer search_server = MakePlannerTestServer();
+    const QueryCostModel& cost_model = search_server.GetQueryCostModel();
+
+    // A single task cannot be spread over the threads, however long its posting list
+    const QueryPlan one_word = search_server.ExplainQuery("alpha"s);
+    ASSERT_EQUAL(one_word.posting_count, 2'000u);
+    ASSERT(abs(one_word.parallel_cost_ns - (cost_model.parallel_overhead_ns + cost_model.parallel_ns_per_posting * 2'000))
+        < TOLERANCE);
+    ASSERT(!one_word.parallel);
+
+    // Eight equal tasks on eight threads take as long as one of them
+    const QueryPlan eight_words = search_server.ExplainQuery("alpha beta gamma delta epsilon zeta eta theta"s);
+    ASSERT_EQUAL(eight_words.terms.size(), 8u);
+    ASSERT_EQUAL(eight_words.posting_count, 16'000u);
+    ASSERT(abs(eight_words.parallel_cost_ns - one_word.parallel_cost_ns) < TOLERANCE);
+    ASSERT(abs(eight_words.sequential_cost_ns - cost_model.EstimateSequential(16'000, 2'000)) < TOLERANCE);
+    ASSERT(eight_words.parallel);
+
+    // The longest task bounds the loop: one long list among short ones gains nothing
+    const QueryPlan skewed = search_server.ExplainQuery("alpha unique1 unique2 unique3"s);
+    ASSERT(abs(skewed.parallel_cost_ns - one_word.parallel_cost_ns) < TOLERANCE);
+    ASSERT(!skewed.parallel);
+
+    for (const string& query : { "alpha"s, "alpha beta gamma delta epsilon zeta eta theta"s }) {
+        AssertSameRanking(search_server.FindTopDocuments(query), search_server.FindTopDocuments(execution::par, query),
+            query);
+    }
+}
+
+void TestPlannerRequiredWords() {
+    const SearchServer search_server = MakePlannerTestServer();
+    const QueryPlan plan = search_server.ExplainQuery("+alpha +unique7 beta"s);
+    ASSERT(!plan.parallel);
+    ASSERT_EQUAL(plan.required_words.size(), 2u);
+    ASSERT_EQUAL(plan.required_words[0].word, "unique7"s);
+    ASSERT_EQUAL(plan.required_words[0].posting_count, 1u);
+    ASSERT_EQUAL(plan.required_words[1].word, "alpha"s);
+}
+
+void TestExplainOutput() {
+    QueryPlan plan;
+    plan.terms = { { "cat"s, 3, 1.0 }, { "kat"s, 2, 0.5 } };
+    plan.wildcards = { { "do*"s, 4, 1.0 } };
+    plan.excluded_document_count = 1;
+    plan.posting_count = 9;
+    plan.sequential_cost_ns = 12'345.0;
+    plan.parallel_cost_ns = 67'890.0;
+    plan.sparse = true;
+
+    ostringstream output;
+    output << setprecision(3) << scientific;
+    output << plan;
+    ASSERT_EQUAL(output.str(),
+        "term cat: postings = 3, weight = 1.000e+00\n"s
+        "term kat: postings = 2, weight = 5.000e-01\n"s
+        "wildcard do*: postings = 4\n"s
+        "excluded documents: 1\n"s
+        "cost: sequential = 12.3 us, parallel = 67.9 us\n"s
+        "execution: sequential (sparse)\n"s);
+    // The caller's formatting survives
+    ASSERT_EQUAL(output.precision(), 3);
+    ASSERT((output.flags() & ios_base::floatfield) == ios_base::scientific);
+
+    const SearchServer search_server = MakePlannerTestServer();
+    ostringstream explained;
+    explained << search_server.ExplainQuery("alpha beta gamma delta epsilon zeta eta theta"s);
+    ASSERT(explained.str().find("term alpha: postings = 2000, weight = 1\n"s) != string::npos);
+    ASSERT(explained.str().find("execution: parallel\n"s) != string::npos);
+}
+
+void TestQueryPlan() {
+    RUN_TEST(TestPlannerCostsPerTermTasks);
+    RUN_TEST(TestPlannerRequiredWords);
+    RUN_TEST(TestExplainOutput);
+}
+
+// AdmissionController
+
+// Holds every admitted query until opened, and records the order in which they were admitted
+class QueryGate {
+public:
+    AdmissionController::QueryRunner MakeRunner() {
+        return [this](const function<void()>& run_query) {
+            const bool is_batch = current_label[0] == 'b';
+            unique_lock lock(mutex_);
+            admitted_.push_back(current_label);
+            if (is_batch) {
+                max_batch_running_ = max(max_batch_running_, ++batch_running_);
+            }
+            opened_condition_.wait(lock, [this] {
+                return is_open_;
+            });
+            if (is_batch) {
+                --batch_running_;
+            }
+            lock.unlock();
+            run_query();
+        };
+    }
+
+    void Open() {
+        lock_guard guard(mutex_);
+        is_open_ = true;
+        opened_condition_.notify_all();
+    }
+
+    vector<string> GetAdmitted() const {
+        lock_guard guard(mutex_);
+        return admitted_;
+    }
+
+    int GetMaxBatchRunning() const {
+        lock_guard guard(mutex_);
+        return max_batch_running_;
+    }
+
+    // Set by every client thread before its request: "i..." for interactive, "b..." for batch
+    static thread_local string current_label;
+
+private:
+    mutable mutex mutex_;
+    condition_variable opened_condition_;
+    bool is_open_ = false;
+    vector<string> admitted_;
+    int batch_running_ = 0;
+    int max_batch_running_ = 0;
+};
+
+thread_local string QueryGate::current_label;
+
+SearchServer MakeAdmissionTestServer() {
+    SearchServer search_server(""s);
+    search_server.AddDocument(1, "white cat"s, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(2, "black dog"s, DocumentStatus::ACTUAL, { 2 });
+    return search_server;
+}
+
+// A fixed limit, so the adaptation cannot move it during a test
+AdmissionOptions MakeFixedLimitOptions(double concurrency_limit) {
+    AdmissionOptions options;
+    options.initial_concurrency_limit = concurrency_limit;
+    options.min_concurrency_limit = concurrency_limit;
+    options.max_concurrency_limit = concurrency_limit;
+    return options;
+}
+
+// Polls, since the requests block in other threads; fails after five seconds
+void WaitForStats(const AdmissionController& controller, const function<bool(const AdmissionStats&)>& condition) {
+    const auto give_up = chrono::steady_clock::now() + chrono::seconds(5);
+    while (!condition(controller.GetStats()) && chrono::steady_clock::now() < give_up) {
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+    ASSERT(condition(controller.GetStats()));
+}
+
+const AdmissionStats::PriorityStats& GetPriorityStats(const AdmissionStats& stats, RequestPriority priority) {
+    return stats.priorities[static_cast<size_t>(priority)];
+}
+
+thread StartRequest(AdmissionController& controller, const string& label, RequestPriority priority,
+    SearchResponse& response) {
+    return thread([&controller, label, priority, &response] {
+        QueryGate::current_label = label;
+        SearchRequest request;
+        request.raw_query = "cat"sv;
+        request.priority = priority;
+        response = controller.FindTopDocuments(request);
+    });
+}
+
+void TestAdmissionInteractiveFirst() {
+    const SearchServer search_server = MakeAdmissionTestServer();
+    QueryGate gate;
+    AdmissionController controller(search_server, MakeFixedLimitOptions(1), gate.MakeRunner());
+    vector<SearchResponse> responses(5);
+    vector<thread> clients;
+
+    clients.push_back(StartRequest(controller, "i0"s, RequestPriority::INTERACTIVE, responses[0]));
+    WaitForStats(controller, [](const AdmissionStats& stats) {
+        return GetPriorityStats(stats, RequestPriority::INTERACTIVE).in_flight == 1;
+    });
+    // Batch requests queue first, yet the interactive ones arriving later overtake them
+    clients.push_back(StartRequest(controller, "b1"s, RequestPriority::BATCH, responses[1]));
+    clients.push_back(StartRequest(controller, "b2"s, RequestPriority::BATCH, responses[2]));
+    WaitForStats(controller, [](const AdmissionStats& stats) {
+        return GetPriorityStats(stats, RequestPriority::BATCH).queued == 2;
+    });
+    clients.push_back(StartRequest(controller, "i3"s, RequestPriority::INTERACTIVE, responses[3]));
+    WaitForStats(controller, [](const AdmissionStats& stats) {
+        return GetPriorityStats(stats, RequestPriority::INTERACTIVE).queued == 1;
+    });
+    clients.push_back(StartRequest(controller, "i4"s, RequestPriority::INTERACTIVE, responses[4]));
+    WaitForStats(controller, [](const AdmissionStats& stats) {
+        return GetPriorityStats(stats, RequestPriority::INTERACTIVE).queued == 2;
+    });
+
+    gate.Open();
+    for (thread& client : clients) {
+        client.join();
+    }
+    ASSERT(gate.GetAdmitted() == vector<string>({ "i0"s, "i3"s, "i4"s, "b1"s, "b2"s }));
+    for (const SearchResponse& response : responses) {
+        ASSERT(response.outcome == AdmissionOutcome::SERVED);
+        ASSERT_EQUAL(response.documents.size(), 1u);
+    }
+}
+
+void TestAdmissionBatchShare() {
+    const SearchServer search_server = MakeAdmissionTestServer();
+    QueryGate gate;
+    AdmissionOptions options = MakeFixedLimitOptions(4);
+    options.batch_share = 0.5;
+    AdmissionController controller(search_server, options, gate.MakeRunner());
+    vector<SearchResponse> responses(8);
+    vector<thread> clients;
+
+    for (int i = 0; i < 6; ++i) {
+        clients.push_back(StartRequest(controller, "b"s + to_string(i), RequestPriority::BATCH, responses[i]));
+    }
+    WaitForStats(controller, [](const AdmissionStats& stats) {
+        return GetPriorityStats(stats, RequestPriority::BATCH).queued == 4;
+    });
+    ASSERT_EQUAL(GetPriorityStats(controller.GetStats(), RequestPriority::BATCH).in_flight, 2u);
+    // The slots batch requests may not take stay free for interactive ones
+    for (int i = 6; i < 8; ++i) {
+        clients.push_back(StartRequest(controller, "i"s + to_string(i), RequestPriority::INTERACTIVE, responses[i]));
+    }
+    WaitForStats(controller, [](const AdmissionStats& stats) {
+        return GetPriorityStats(stats, RequestPriority::INTERACTIVE).in_flight == 2;
+    });
+    ASSERT_EQUAL(GetPriorityStats(controller.GetStats(), RequestPriority::INTERACTIVE).queued, 0u);
+
+    gate.Open();
+    for (thread& client : clients) {
+        client.join();
+    }
+    ASSERT_EQUAL(gate.GetMaxBatchRunning(), 2);
+    ASSERT_EQUAL(GetPriorityStats(controller.GetStats(), RequestPriority::BATCH).served, 6u);
+}
+
+void TestAdmissionQueueFull() {
+    const SearchServer search_server = MakeAdmissionTestServer();
+    QueryGate gate;
+    AdmissionOptions options = MakeFixedLimitOptions(1);
+    options.max_queue_length = 2;
+    AdmissionController controller(search_server, options, gate.MakeRunner());
+    vector<SearchResponse> responses(3);
+    vector<thread> clients;
+
+    for (int i = 0; i < 3; ++i) {
+        clients.push_back(StartRequest(controller, "i"s + to_string(i), RequestPriority::INTERACTIVE, responses[i]));
+        WaitForStats(controller, [i](const AdmissionStats& stats) {
+            const auto& interactive = GetPriorityStats(stats, RequestPriority::INTERACTIVE);
+            return interactive.in_flight + interactive.queued == static_cast<size_t>(i + 1);
+        });
+    }
+    // From a thread as well, so a request that queues by mistake fails the wait instead of hanging the test
+    SearchResponse rejected_response;
+    thread rejected = StartRequest(controller, "i3"s, RequestPriority::INTERACTIVE, rejected_response);
+    WaitForStats(controller, [](const AdmissionStats& stats) {
+        return GetPriorityStats(stats, RequestPriority::INTERACTIVE).rejected_queue_full == 1;
+    });
+    rejected.join();
+    ASSERT(rejected_response.outcome == AdmissionOutcome::REJECTED_QUEUE_FULL);
+    // Queues are per priority
+    SearchResponse batch_response;
+    clients.push_back(StartRequest(controller, "b3"s, RequestPriority::BATCH, batch_response));
+    WaitForStats(controller, [](const AdmissionStats& stats) {
+        return GetPriorityStats(stats, RequestPriority::BATCH).queued == 1;
+    });
+
+    gate.Open();
+    for (thread& client : clients) {
+        client.join();
+    }
+    const AdmissionStats stats = controller.GetStats();
+    ASSERT_EQUAL(GetPriorityStats(stats, RequestPriority::INTERACTIVE).rejected_queue_full, 1u);
+    ASSERT_EQUAL(GetPriorityStats(stats, RequestPriority::INTERACTIVE).served, 3u);
+    ASSERT(batch_response.outcome == AdmissionOutcome::SERVED);
+}
+
+void TestAdmissionDeadlineInQueue() {
+    const SearchServer search_server = MakeAdmissionTestServer();
+    QueryGate gate;
+    AdmissionController controller(search_server, MakeFixedLimitOptions(1), gate.MakeRunner());
+    SearchResponse held_response;
+    thread holder = StartRequest(controller, "i0"s, RequestPriority::INTERACTIVE, held_response);
+    WaitForStats(controller, [](const AdmissionStats& stats) {
+        return GetPriorityStats(stats, RequestPriority::INTERACTIVE).in_flight == 1;
+    });
+
+    // Nothing has run yet, so the wait is predicted as zero and the request queues until its deadline
+    SearchRequest request;
+    request.raw_query = "cat"sv;
+    request.deadline = chrono::steady_clock::now() + chrono::milliseconds(50);
+    const SearchResponse response = controller.FindTopDocuments(request);
+    ASSERT(response.outcome == AdmissionOutcome::REJECTED_DEADLINE);
+    ASSERT(response.queue_time >= chrono::milliseconds(50));
+    AdmissionStats stats = controller.GetStats();
+    ASSERT_EQUAL(GetPriorityStats(stats, RequestPriority::INTERACTIVE).queued, 0u);
+    ASSERT_EQUAL(GetPriorityStats(stats, RequestPriority::INTERACTIVE).rejected_deadline, 1u);
+
+    // The expired waiter is gone: the slot goes to the next request, not to it
+    SearchResponse next_response;
+    thread next = StartRequest(controller, "i1"s, RequestPriority::INTERACTIVE, next_response);
+    WaitForStats(controller, [](const AdmissionStats& stats) {
+        return GetPriorityStats(stats, RequestPriority::INTERACTIVE).queued == 1;
+    });
+    gate.Open();
+    holder.join();
+    next.join();
+    ASSERT(gate.GetAdmitted() == vector<string>({ "i0"s, "i1"s }));
+    ASSERT(next_response.outcome == AdmissionOutcome::SERVED);
+    stats = controller.GetStats();
+    ASSERT_EQUAL(GetPriorityStats(stats, RequestPriority::INTERACTIVE).served, 2u);
+    ASSERT_EQUAL(GetPriorityStats(stats, RequestPriority::INTERACTIVE).in_flight, 0u);
+}
+
+void TestAdmissionControl() {
+    RUN_TEST(TestAdmissionInteractiveFirst);
+    RUN_TEST(TestAdmissionBatchShare);
+    RUN_TEST(TestAdmissionQueueFull);
+    RUN_TEST(TestAdmissionDeadlineInQueue);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    // ctest runs one group per process; without an argument every group runs
+    const map<string, function<void()>> groups = {
+        { "admission_control"s, TestAdmissionControl },
+        { "compact"s, TestCompact },
+        { "concurrent_map"s, TestConcurrentMap },
+        { "corpus_loader"s, TestCorpusLoader },
+        { "find_top_documents_batch"s, TestFindTopDocumentsBatch },
+        { "find_top_documents_page"s, TestFindTopDocumentsPage },
+        { "fuzzy_matching"s, TestFuzzyMatching },
+        { "impact_index"s, TestImpactIndex },
+        { "positional_index"s, TestPositionalIndex },
+        { "query_plan"s, TestQueryPlan },
+        { "query_resource"s, TestQueryResource },
+        { "remove_documents"s, TestRemoveDocuments },
+        { "required_words"s, TestRequiredWords },
+        { "shard_coordinator"s, TestShardCoordinator },
+        { "sharded_search_server"s, TestShardedSearchServer },
+        { "synthetic_data"s, TestSyntheticData },
+        { "update_document"s, TestUpdateDocument },
+        { "wildcards"s, TestWildcards },
+    };
+    if (argc < 2) {
+        for (const auto& [name, group] : groups) {
+            group();
+        }
+        return 0;
+    }
+    const auto it = groups.find(argv[1]);
+    if (it == groups.end()) {
+        cerr << "Unknown test group "s << argv[1] << endl;
+        return 1;
+    }
+    it->second();
+    return 0;
+}
@@ -0,0 +1,277 @@
+#include "shard_coordinator.h"
+#include "shard_protocol.h"
+#include "search_server.h"
+#include "sharded_search_server.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <map>
+
+using namespace std;
+
+namespace {
+
+// Turns an error response back into the exception thrown inside the shard
+BinaryReader CheckResponse(const string& response) {
+    BinaryReader reader(response);
+    const auto code = reader.Read<ShardResponse>();
+    if (code == ShardResponse::INVALID_ARGUMENT) {
+        throw invalid_argument(string(reader.ReadString()));
+    }
+    if (code == ShardResponse::OUT_OF_RANGE) {
+        throw out_of_range(string(reader.ReadString()));
+    }
+    if (code == ShardResponse::INTERNAL_ERROR) {
+        throw ShardRequestError(string(reader.ReadString()));
+    }
+    return reader;
+}
+
+// A dead shard is tried again after this long, not on every request
+const chrono::seconds RECONNECT_INTERVAL(1);
+
+} // namespace
+
+ShardCoordinator::ShardCoordinator(const vector<string>& socket_paths, chrono::milliseconds response_timeout)
+    : response_timeout_(response_timeout) {
+    for (const string& socket_path : socket_paths) {
+        ShardConnection shard{ socket_path };
+        TryReconnect(shard);
+        shards_.push_back(move(shard));
+    }
+}
+
+ShardCoordinator::~ShardCoordinator() {
+    for (ShardConnection& shard : shards_) {
+        CloseSocket(shard.fd);
+    }
+}
+
+void ShardCoordinator::AddDocument(int document_id, string_view document, DocumentStatus status,
+    const vector<int>& ratings) {
+    BinaryWriter writer;
+    writer.Write(ShardRequest::ADD_DOCUMENT);
+    writer.Write(static_cast<int32_t>(document_id));
+    writer.Write(status);
+    writer.Write(static_cast<uint32_t>(ratings.size()));
+    for (const int rating : ratings) {
+        writer.Write(static_cast<int32_t>(rating));
+    }
+    writer.WriteString(document);
+    CheckResponse(Call(shards_[GetDocumentShardIndex(document_id, shards_.size())], writer.GetBuffer()));
+}
+
+void ShardCoordinator::RemoveDocument(int document_id) {
+    BinaryWriter writer;
+    writer.Write(ShardRequest::REMOVE_DOCUMENT);
+    writer.Write(static_cast<int32_t>(document_id));
+    CheckResponse(Call(shards_[GetDocumentShardIndex(document_id, shards_.size())], writer.GetBuffer()));
+}
+
+tuple<vector<string>, DocumentStatus> ShardCoordinator::MatchDocument(string_view raw_query, int document_id) {
+    BinaryWriter writer;
+    writer.Write(ShardRequest::MATCH_DOCUMENT);
+    writer.WriteString(raw_query);
+    writer.Write(static_cast<int32_t>(document_id));
+    const string response = Call(shards_[GetDocumentShardIndex(document_id, shards_.size())], writer.GetBuffer());
+    BinaryReader reader = CheckResponse(response);
+    const auto status = reader.Read<DocumentStatus>();
+    vector<string> words(reader.ReadCount(sizeof(uint32_t)));
+    for (string& word : words) {
+        word = string(reader.ReadString());
+    }
+    return { words, status };
+}
+
+vector<Document> ShardCoordinator::FindTopDocuments(string_view raw_query, DocumentStatus status) {
+    BinaryWriter statistics_request;
+    statistics_request.Write(ShardRequest::GET_STATISTICS);
+    statistics_request.WriteString(raw_query);
+
+    int document_count = 0;
+    map<string, int, less<>> word_document_counts;
+    const auto statistics_responses = Broadcast(statistics_request.GetBuffer());
+    for (size_t shard_index = 0; shard_index < shards_.size(); ++shard_index) {
+        const string& response = statistics_responses[shard_index];
+        if (response.empty()) {
+            continue;
+        }
+        // Parsed completely before merging, so a malformed response adds nothing
+        int shard_document_count = 0;
+        vector<pair<string_view, int>> shard_word_counts;
+        try {
+            BinaryReader reader = CheckResponse(response);
+            shard_document_count = reader.Read<int32_t>();
+            for (uint32_t i = reader.ReadCount(2 * sizeof(uint32_t)); i > 0; --i) {
+                const string_view word = reader.ReadString();
+                shard_word_counts.emplace_back(word, reader.Read<int32_t>());
+            }
+        } catch (const ShardRequestError& e) {
+            // The shard is alive, so it still answers the search with its local statistics
+            cerr << "coordinator: shard "s << shards_[shard_index].socket_path << ": "s << e.what() << endl;
+            continue;
+        } catch (const ShardProtocolError& e) {
+            // A malformed response means the connection can no longer be trusted
+            cerr << "coordinator: shard "s << shards_[shard_index].socket_path << ": "s << e.what() << endl;
+            MarkDead(shards_[shard_index]);
+            continue;
+        }
+        document_count += shard_document_count;
+        for (const auto& [word, count] : shard_word_counts) {
+            const auto it = word_document_counts.find(word);
+            if (it == word_document_counts.end()) {
+                word_document_counts.emplace(word, count);
+            } else {
+                it->second += count;
+            }
+        }
+    }
+
+    BinaryWriter search_request;
+    search_request.Write(ShardRequest::FIND_TOP_DOCUMENTS);
+    search_request.WriteString(raw_query);
+    search_request.Write(status);
+    search_request.Write(static_cast<int32_t>(document_count));
+    search_request.Write(static_cast<uint32_t>(word_document_counts.size()));
+    for (const auto& [word, count] : word_document_counts) {
+        search_request.WriteString(word);
+        search_request.Write(static_cast<int32_t>(count));
+    }
+
+    vector<Document> result;
+    last_query_shard_count_ = 0;
+    const auto search_responses = Broadcast(search_request.GetBuffer());
+    for (size_t shard_index = 0; shard_index < shards_.size(); ++shard_index) {
+        const string& response = search_responses[shard_index];
+        if (response.empty()) {
+            continue;
+        }
+        const size_t shard_begin = result.size();
+        try {
+            BinaryReader reader = CheckResponse(response);
+            for (uint32_t i = reader.ReadCount(2 * sizeof(int32_t) + sizeof(double)); i > 0; --i) {
+                const int id = reader.Read<int32_t>();
+                const double relevance = reader.Read<double>();
+                const int rating = reader.Read<int32_t>();
+                result.emplace_back(id, relevance, rating);
+            }
+        } catch (const ShardRequestError& e) {
+            // Served like a dead shard for this query, see GetLastQueryShardCount
+            cerr << "coordinator: shard "s << shards_[shard_index].socket_path << ": "s << e.what() << endl;
+            continue;
+        } catch (const ShardProtocolError& e) {
+            cerr << "coordinator: shard "s << shards_[shard_index].socket_path << ": "s << e.what() << endl;
+            MarkDead(shards_[shard_index]);
+            result.resize(shard_begin);
+            continue;
+        }
+        ++last_query_shard_count_;
+    }
+
+    sort(result.begin(), result.end(), IsMoreRelevant);
+    if (result.size() > MAX_RESULT_DOCUMENT_COUNT) {
+        result.resize(MAX_RESULT_DOCUMENT_COUNT);
+    }
+    return result;
+}
+
+size_t ShardCoordinator::GetLastQueryShardCount() const {
+    return last_query_shard_count_;
+}
+
+size_t ShardCoordinator::GetShardCount() const {
+    return shards_.size();
+}
+
+size_t ShardCoordinator::GetAliveShardCount() const {
+    return count_if(shards_.begin(), shards_.end(), [](const ShardConnection& shard) {
+        return shard.fd >= 0;
+        });
+}
+
+bool ShardCoordinator::IsShardAlive(size_t index) const {
+    return shards_.at(index).fd >= 0;
+}
+
+void ShardCoordinator::Shutdown() {
+    BinaryWriter writer;
+    writer.Write(ShardRequest::SHUTDOWN);
+    Broadcast(writer.GetBuffer());
+    for (ShardConnection& shard : shards_) {
+        MarkDead(shard);
+    }
+    is_shut_down_ = true;
+}
+
+void ShardCoordinator::MarkDead(ShardConnection& shard) {
+    CloseSocket(shard.fd);
+    shard.fd = -1;
+    shard.reconnect_time = chrono::steady_clock::now() + RECONNECT_INTERVAL;
+}
+
+void ShardCoordinator::TryReconnect(ShardConnection& shard) {
+    if (shard.fd >= 0 || is_shut_down_ || chrono::steady_clock::now() < shard.reconnect_time) {
+        return;
+    }
+    try {
+        shard.fd = ConnectUnixSocket(shard.socket_path);
+        SetReceiveTimeout(shard.fd, response_timeout_);
+    } catch (const ShardProtocolError& e) {
+        cerr << "coordinator: "s << e.what() << endl;
+        CloseSocket(shard.fd);
+        shard.fd = -1;
+        shard.reconnect_time = chrono::steady_clock::now() + RECONNECT_INTERVAL;
+    }
+}
+
+vector<string> ShardCoordinator::Broadcast(const string& request) {
+    vector<string> responses(shards_.size());
+    // All requests go out before any response is read, so the shards work in parallel
+    for (ShardConnection& shard : shards_) {
+        TryReconnect(shard);
+        if (shard.fd < 0) {
+            continue;
+        }
+        try {
+            WriteFrame(shard.fd, request);
+        } catch (const ShardProtocolError& e) {
+            cerr << "coordinator: shard "s << shard.socket_path << ": "s << e.what() << endl;
+            MarkDead(shard);
+        }
+    }
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        ShardConnection& shard = shards_[i];
+        if (shard.fd < 0) {
+            continue;
+        }
+        try {
+            if (!ReadFrame(shard.fd, responses[i])) {
+                throw ShardProtocolError("connection closed"s);
+            }
+        } catch (const ShardProtocolError& e) {
+            cerr << "coordinator: shard "s << shard.socket_path << ": "s << e.what() << endl;
+            MarkDead(shard);
+            responses[i].clear();
+        }
+    }
+    return responses;
+}
+
+string ShardCoordinator::Call(ShardConnection& shard, const string& request) {
+    TryReconnect(shard);
+    if (shard.fd < 0) {
+        throw ShardProtocolError("Shard "s + shard.socket_path + " is down"s);
+    }
+    string response;
+    try {
+        WriteFrame(shard.fd, request);
+        if (!ReadFrame(shard.fd, response)) {
+            throw ShardProtocolError("connection closed"s);
+        }
+    } catch (const ShardProtocolError& e) {
+        MarkDead(shard);
+        throw ShardProtocolError("Shard "s + shard.socket_path + ": "s + e.what());
+    }
+    return response;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "document.h"
+
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+// Scatters queries to shard processes (see shard_server.h) and gathers their top documents.
+// Document frequencies are summed over the shards first, so every shard scores with
+// corpus-wide IDF. A shard that fails is marked dead and queries keep being served
+// from the remaining ones; GetLastQueryShardCount() tells how complete a result is.
+// A shard that stays silent for response_timeout in the middle of a response, e.g. because
+// it hangs, fails the same way.
+// A dead shard is connected to again at most once a second, so a shard process restarted
+// on the same socket rejoins, holding whatever documents it has by then.
+class ShardCoordinator {
+public:
+    explicit ShardCoordinator(const std::vector<std::string>& socket_paths,
+        std::chrono::milliseconds response_timeout = std::chrono::seconds(5));
+    ~ShardCoordinator();
+
+    ShardCoordinator(const ShardCoordinator&) = delete;
+    ShardCoordinator& operator=(const ShardCoordinator&) = delete;
+
+    // Throw ShardProtocolError if the owning shard is down and ShardRequestError if it
+    // fails the request for a reason other than its arguments
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status,
+        const std::vector<int>& ratings);
+    void RemoveDocument(int document_id);
+    std::tuple<std::vector<std::string>, DocumentStatus> MatchDocument(std::string_view raw_query, int document_id);
+
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL);
+
+    // Number of shards that answered the last FindTopDocuments
+    size_t GetLastQueryShardCount() const;
+    size_t GetShardCount() const;
+    size_t GetAliveShardCount() const;
+    bool IsShardAlive(size_t index) const;
+
+    // Asks every alive shard process to exit
+    void Shutdown();
+
+private:
+    struct ShardConnection {
+        std::string socket_path;
+        int fd = -1;
+        // Earliest time to try a dead shard again
+        std::chrono::steady_clock::time_point reconnect_time{};
+    };
+
+    const std::chrono::milliseconds response_timeout_;
+    std::vector<ShardConnection> shards_;
+    size_t last_query_shard_count_ = 0;
+    bool is_shut_down_ = false;
+
+    void MarkDead(ShardConnection& shard);
+    void TryReconnect(ShardConnection& shard);
+    // Sends the request to every alive shard, then collects the responses in the same order.
+    // Shards that fail are marked dead and get an empty response.
+    std::vector<std::string> Broadcast(const std::string& request);
+    std::string Call(ShardConnection& shard, const std::string& request);
+};
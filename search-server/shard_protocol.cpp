@@ -0,0 +1,139 @@
+#include "shard_protocol.h"
+
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+// Upper bound on a single frame, so a corrupted size does not trigger a huge allocation
+const uint32_t MAX_FRAME_SIZE = 256u << 20;
+
+sockaddr_un MakeAddress(const string& socket_path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path)) {
+        throw ShardProtocolError("Socket path is too long: "s + socket_path);
+    }
+    memcpy(address.sun_path, socket_path.c_str(), socket_path.size() + 1);
+    return address;
+}
+
+string DescribeError(const string& action) {
+    return action + ": "s + strerror(errno);
+}
+
+void WriteAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        // MSG_NOSIGNAL: a dead peer must produce an error, not kill the process with SIGPIPE
+        const ssize_t written = send(fd, data, size, MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw ShardProtocolError(DescribeError("send"s));
+        }
+        data += written;
+        size -= written;
+    }
+}
+
+// Returns the number of bytes read, which is less than size only at the end of stream
+size_t ReadAll(int fd, char* data, size_t size) {
+    size_t total = 0;
+    while (total < size) {
+        const ssize_t received = recv(fd, data + total, size - total, 0);
+        if (received < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // SO_RCVTIMEO ran out, see SetReceiveTimeout
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                throw ShardProtocolError("recv: timed out"s);
+            }
+            throw ShardProtocolError(DescribeError("recv"s));
+        }
+        if (received == 0) {
+            break;
+        }
+        total += received;
+    }
+    return total;
+}
+
+} // namespace
+
+int ListenUnixSocket(const string& socket_path) {
+    const sockaddr_un address = MakeAddress(socket_path);
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        throw ShardProtocolError(DescribeError("socket"s));
+    }
+    unlink(socket_path.c_str());
+    if (bind(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0
+        || listen(fd, 16) < 0) {
+        const string message = DescribeError("bind "s + socket_path);
+        close(fd);
+        throw ShardProtocolError(message);
+    }
+    return fd;
+}
+
+int ConnectUnixSocket(const string& socket_path) {
+    const sockaddr_un address = MakeAddress(socket_path);
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        throw ShardProtocolError(DescribeError("socket"s));
+    }
+    if (connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0) {
+        const string message = DescribeError("connect "s + socket_path);
+        close(fd);
+        throw ShardProtocolError(message);
+    }
+    return fd;
+}
+
+void SetReceiveTimeout(int fd, chrono::milliseconds timeout) {
+    timeval value{};
+    value.tv_sec = static_cast<time_t>(timeout.count() / 1000);
+    value.tv_usec = static_cast<suseconds_t>(timeout.count() % 1000 * 1000);
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &value, sizeof(value)) < 0) {
+        throw ShardProtocolError(DescribeError("setsockopt"s));
+    }
+}
+
+void WriteFrame(int fd, string_view payload) {
+    if (payload.size() > MAX_FRAME_SIZE) {
+        throw ShardProtocolError("Shard message is too large"s);
+    }
+    const uint32_t size = static_cast<uint32_t>(payload.size());
+    string frame(reinterpret_cast<const char*>(&size), sizeof(size));
+    frame.append(payload);
+    WriteAll(fd, frame.data(), frame.size());
+}
+
+bool ReadFrame(int fd, string& payload) {
+    uint32_t size = 0;
+    const size_t header_size = ReadAll(fd, reinterpret_cast<char*>(&size), sizeof(size));
+    if (header_size == 0) {
+        return false;
+    }
+    if (header_size < sizeof(size) || size > MAX_FRAME_SIZE) {
+        throw ShardProtocolError("Broken shard frame header"s);
+    }
+    payload.resize(size);
+    if (ReadAll(fd, payload.data(), size) < size) {
+        throw ShardProtocolError("Connection closed in the middle of a frame"s);
+    }
+    return true;
+}
+
+void CloseSocket(int fd) {
+    if (fd >= 0) {
+        close(fd);
+    }
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "document.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// Binary protocol between ShardCoordinator and shard processes over Unix domain sockets.
+// Every message is a frame: uint32 payload size followed by the payload. A request payload
+// starts with a ShardRequest byte, a response payload with a ShardResponse byte.
+// Both ends run on one host, so numbers are sent in native byte order.
+
+enum class ShardRequest : uint8_t {
+    ADD_DOCUMENT,       // id, status, ratings, text                      -> OK
+    REMOVE_DOCUMENT,    // id                                             -> OK
+    GET_STATISTICS,     // raw_query         -> document count, (word, document count) per query word
+    FIND_TOP_DOCUMENTS, // raw_query, status, global document count,
+                        // (word, global document count) per query word   -> documents
+    MATCH_DOCUMENT,     // raw_query, id                                  -> status, words
+    SHUTDOWN,           //                                                -> OK
+};
+
+enum class ShardResponse : uint8_t {
+    OK,
+    INVALID_ARGUMENT, // followed by the error message
+    OUT_OF_RANGE,     // followed by the error message
+    INTERNAL_ERROR,   // any other failure, e.g. an exceeded memory budget; followed by the error message
+};
+
+class ShardProtocolError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// The shard is alive but could not serve the request, see ShardResponse::INTERNAL_ERROR
+class ShardRequestError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+class BinaryWriter {
+public:
+    template <typename Number>
+    void Write(Number value) {
+        static_assert(std::is_arithmetic_v<Number> || std::is_enum_v<Number>);
+        buffer_.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    void WriteString(std::string_view text) {
+        Write(static_cast<uint32_t>(text.size()));
+        buffer_.append(text);
+    }
+
+    const std::string& GetBuffer() const {
+        return buffer_;
+    }
+
+private:
+    std::string buffer_;
+};
+
+class BinaryReader {
+public:
+    explicit BinaryReader(std::string_view data) : data_(data) {
+    }
+
+    template <typename Number>
+    Number Read() {
+        static_assert(std::is_arithmetic_v<Number> || std::is_enum_v<Number>);
+        Number value;
+        std::memcpy(&value, Take(sizeof(value)).data(), sizeof(value));
+        return value;
+    }
+
+    // The view points into the frame being read
+    std::string_view ReadString() {
+        return Take(Read<uint32_t>());
+    }
+
+    // Length of an array whose items take at least min_item_size bytes each. Checked against
+    // the rest of the frame, so a corrupt count cannot make the reader allocate for it.
+    uint32_t ReadCount(size_t min_item_size) {
+        const uint32_t count = Read<uint32_t>();
+        if (count > data_.size() / min_item_size) {
+            throw ShardProtocolError("Shard message array does not fit into the frame");
+        }
+        return count;
+    }
+
+    bool IsEmpty() const {
+        return data_.empty();
+    }
+
+private:
+    std::string_view data_;
+
+    std::string_view Take(size_t size) {
+        if (data_.size() < size) {
+            throw ShardProtocolError("Truncated shard message");
+        }
+        const std::string_view result = data_.substr(0, size);
+        data_.remove_prefix(size);
+        return result;
+    }
+};
+
+// Socket helpers; all of them throw ShardProtocolError on failure
+int ListenUnixSocket(const std::string& socket_path);
+int ConnectUnixSocket(const std::string& socket_path);
+// A ReadFrame that waits longer than timeout for data throws; zero waits forever
+void SetReceiveTimeout(int fd, std::chrono::milliseconds timeout);
+void WriteFrame(int fd, std::string_view payload);
+// Returns false on a clean end of stream before the frame starts
+bool ReadFrame(int fd, std::string& payload);
+void CloseSocket(int fd);
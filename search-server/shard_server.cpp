@@ -0,0 +1,186 @@
+#include "shard_server.h"
+#include "shard_protocol.h"
+
+#include <cerrno>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+// Replaces whatever part of the response was written before the failure
+void WriteError(BinaryWriter& writer, ShardResponse code, const char* message) {
+    writer = BinaryWriter();
+    writer.Write(code);
+    writer.WriteString(message);
+}
+
+// Statistics cover the terms the query parser scores, so the coordinator has the corpus-wide
+// counts of phrase words, NEAR operands and fuzzy expansions as well
+void HandleStatistics(const SearchServer& search_server, BinaryReader& reader, BinaryWriter& writer) {
+    const auto term_document_counts = search_server.GetQueryTermDocumentCounts(reader.ReadString());
+    writer.Write(ShardResponse::OK);
+    writer.Write(static_cast<int32_t>(search_server.GetDocumentCount()));
+    writer.Write(static_cast<uint32_t>(term_document_counts.size()));
+    for (const auto& [term, count] : term_document_counts) {
+        writer.WriteString(term);
+        writer.Write(static_cast<int32_t>(count));
+    }
+}
+
+void HandleFindTopDocuments(const SearchServer& search_server, BinaryReader& reader, BinaryWriter& writer) {
+    const string_view raw_query = reader.ReadString();
+    const auto status = reader.Read<DocumentStatus>();
+    const int document_count = reader.Read<int32_t>();
+    map<string_view, int> word_document_counts;
+    for (uint32_t i = reader.ReadCount(2 * sizeof(uint32_t)); i > 0; --i) {
+        const string_view word = reader.ReadString();
+        word_document_counts[word] = reader.Read<int32_t>();
+    }
+
+    // Filled only if the coordinator missed a term, e.g. because this shard failed its statistics
+    map<string_view, int> local_counts;
+    const auto documents = search_server.FindTopDocuments(execution::seq, raw_query, DocumentFilter(status),
+        [&](string_view word) {
+            const auto it = word_document_counts.find(word);
+            if (it == word_document_counts.end() || it->second == 0) {
+                if (local_counts.empty()) {
+                    local_counts = search_server.GetQueryTermDocumentCounts(raw_query);
+                }
+                return log(search_server.GetDocumentCount() * 1.0 / local_counts.at(word));
+            }
+            return log(document_count * 1.0 / it->second);
+        });
+
+    writer.Write(ShardResponse::OK);
+    writer.Write(static_cast<uint32_t>(documents.size()));
+    for (const Document& document : documents) {
+        writer.Write(static_cast<int32_t>(document.id));
+        writer.Write(document.relevance);
+        writer.Write(static_cast<int32_t>(document.rating));
+    }
+}
+
+void HandleMatchDocument(const SearchServer& search_server, BinaryReader& reader, BinaryWriter& writer) {
+    const string_view raw_query = reader.ReadString();
+    const int document_id = reader.Read<int32_t>();
+    const auto [words, status] = search_server.MatchDocument(raw_query, document_id);
+    writer.Write(ShardResponse::OK);
+    writer.Write(status);
+    writer.Write(static_cast<uint32_t>(words.size()));
+    for (const string_view word : words) {
+        writer.WriteString(word);
+    }
+}
+
+void HandleAddDocument(SearchServer& search_server, BinaryReader& reader, BinaryWriter& writer) {
+    const int document_id = reader.Read<int32_t>();
+    const auto status = reader.Read<DocumentStatus>();
+    vector<int> ratings(reader.ReadCount(sizeof(int32_t)));
+    for (int& rating : ratings) {
+        rating = reader.Read<int32_t>();
+    }
+    search_server.AddDocument(document_id, reader.ReadString(), status, ratings);
+    writer.Write(ShardResponse::OK);
+}
+
+// Returns false when the shard has to stop
+bool HandleRequest(SearchServer& search_server, string_view payload, BinaryWriter& writer) {
+    BinaryReader reader(payload);
+    try {
+        switch (reader.Read<ShardRequest>()) {
+        case ShardRequest::ADD_DOCUMENT:
+            HandleAddDocument(search_server, reader, writer);
+            break;
+        case ShardRequest::REMOVE_DOCUMENT:
+            search_server.RemoveDocument(reader.Read<int32_t>());
+            writer.Write(ShardResponse::OK);
+            break;
+        case ShardRequest::GET_STATISTICS:
+            HandleStatistics(search_server, reader, writer);
+            break;
+        case ShardRequest::FIND_TOP_DOCUMENTS:
+            HandleFindTopDocuments(search_server, reader, writer);
+            break;
+        case ShardRequest::MATCH_DOCUMENT:
+            HandleMatchDocument(search_server, reader, writer);
+            break;
+        case ShardRequest::SHUTDOWN:
+            writer.Write(ShardResponse::OK);
+            return false;
+        default:
+            throw ShardProtocolError("Unknown shard request"s);
+        }
+    } catch (const invalid_argument& e) {
+        WriteError(writer, ShardResponse::INVALID_ARGUMENT, e.what());
+    } catch (const out_of_range& e) {
+        WriteError(writer, ShardResponse::OUT_OF_RANGE, e.what());
+    } catch (const exception& e) {
+        // A malformed request, bad_alloc or an exceeded memory budget fails the request, not the shard
+        WriteError(writer, ShardResponse::INTERNAL_ERROR, e.what());
+    }
+    return true;
+}
+
+} // namespace
+
+void ServeShard(SearchServer& search_server, int listen_fd) {
+    string payload;
+    bool running = true;
+    while (running) {
+        const int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw ShardProtocolError("accept: "s + strerror(errno));
+        }
+        try {
+            while (running && ReadFrame(fd, payload)) {
+                BinaryWriter writer;
+                running = HandleRequest(search_server, payload, writer);
+                WriteFrame(fd, writer.GetBuffer());
+            }
+        } catch (const ShardProtocolError& e) {
+            // A broken client must not take the shard down: drop it and wait for the next one
+            cerr << "shard: "s << e.what() << endl;
+        }
+        CloseSocket(fd);
+    }
+}
+
+void RunShardServer(const string& socket_path, const string& stop_words_text) {
+    SearchServer search_server(stop_words_text);
+    const int listen_fd = ListenUnixSocket(socket_path);
+    ServeShard(search_server, listen_fd);
+    CloseSocket(listen_fd);
+    unlink(socket_path.c_str());
+}
+
+pid_t SpawnShardProcess(const string& socket_path, const string& stop_words_text) {
+    const int listen_fd = ListenUnixSocket(socket_path);
+    const pid_t pid = fork();
+    if (pid < 0) {
+        CloseSocket(listen_fd);
+        throw ShardProtocolError("fork: "s + strerror(errno));
+    }
+    if (pid == 0) {
+        int exit_code = 0;
+        try {
+            SearchServer search_server(stop_words_text);
+            ServeShard(search_server, listen_fd);
+        } catch (const exception& e) {
+            cerr << "shard: "s << e.what() << endl;
+            exit_code = 1;
+        }
+        CloseSocket(listen_fd);
+        unlink(socket_path.c_str());
+        _exit(exit_code);
+    }
+    CloseSocket(listen_fd);
+    return pid;
+}
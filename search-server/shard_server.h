@@ -0,0 +1,16 @@
+#pragma once
+
+#include "search_server.h"
+
+#include <string>
+#include <sys/types.h>
+
+// Shard-server mode: a SearchServer answering ShardRequest frames on a Unix domain socket.
+// Connections are served one at a time until a SHUTDOWN request arrives.
+void ServeShard(SearchServer& search_server, int listen_fd);
+
+void RunShardServer(const std::string& socket_path, const std::string& stop_words_text);
+
+// Starts a shard in a child process. The socket is already listening when the call
+// returns, so a coordinator may connect right away. Returns the pid of the child.
+pid_t SpawnShardProcess(const std::string& socket_path, const std::string& stop_words_text);
@@ -0,0 +1,29 @@
+#include "shard_protocol.h"
+#include "shard_server.h"
+
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+// search_shard_server <socket path> [stop words...]
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        cerr << "Usage: "s << argv[0] << " <socket path> [stop words...]"s << endl;
+        return 1;
+    }
+    string stop_words;
+    for (int i = 2; i < argc; ++i) {
+        if (!stop_words.empty()) {
+            stop_words.push_back(' ');
+        }
+        stop_words += argv[i];
+    }
+    try {
+        RunShardServer(argv[1], stop_words);
+    } catch (const exception& e) {
+        cerr << "search_shard_server: "s << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
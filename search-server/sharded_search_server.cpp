@@ -0,0 +1,121 @@
+#include "sharded_search_server.h"
+
+#include <numeric>
+
+using namespace std;
+
+size_t GetDocumentShardIndex(int document_id, size_t shard_count) {
+	const uint64_t hash = static_cast<uint64_t>(static_cast<uint32_t>(document_id)) * 11400714819323198485ull;
+	return static_cast<size_t>((hash >> 32) % shard_count);
+}
+
+ShardedSearchServer::ShardedSearchServer(const string& stop_words_text, size_t shard_count)
+	: ShardedSearchServer(SplitIntoWords(stop_words_text), shard_count)
+{
+}
+
+ShardedSearchServer::ShardedSearchServer(string_view stop_words_text, size_t shard_count)
+	: ShardedSearchServer(SplitIntoWords(stop_words_text), shard_count)
+{
+}
+
+void ShardedSearchServer::AddDocument(int document_id, string_view document, DocumentStatus status,
+	const vector<int>& ratings) {
+	// Uniqueness of ids is checked by the owning shard: equal ids always land on the same one
+	GetDocumentShard(document_id).AddDocument(document_id, document, status, ratings);
+}
+
+vector<Document> ShardedSearchServer::FindTopDocuments(string_view raw_query, DocumentStatus status) const {
+	return FindTopDocuments(execution::par, raw_query, status);
+}
+
+vector<Document> ShardedSearchServer::FindTopDocuments(string_view raw_query) const {
+	return FindTopDocuments(execution::par, raw_query);
+}
+
+vector<Document> ShardedSearchServer::FindTopDocuments(string_view raw_query, const DocumentFilter& filter) const {
+	return FindTopDocuments(execution::par, raw_query, filter);
+}
+
+tuple<vector<string_view>, DocumentStatus> ShardedSearchServer::MatchDocument(string_view raw_query, int document_id) const {
+	return GetDocumentShard(document_id).MatchDocument(raw_query, document_id);
+}
+
+tuple<vector<string_view>, DocumentStatus> ShardedSearchServer::MatchDocument(const execution::sequenced_policy& policy,
+	string_view raw_query, int document_id) const {
+	return GetDocumentShard(document_id).MatchDocument(policy, raw_query, document_id);
+}
+
+tuple<vector<string_view>, DocumentStatus> ShardedSearchServer::MatchDocument(const execution::parallel_policy& policy,
+	string_view raw_query, int document_id) const {
+	return GetDocumentShard(document_id).MatchDocument(policy, raw_query, document_id);
+}
+
+const map<string_view, double>& ShardedSearchServer::GetWordFrequencies(int document_id) const {
+	return GetDocumentShard(document_id).GetWordFrequencies(document_id);
+}
+
+void ShardedSearchServer::RemoveDocument(int document_id) {
+	GetDocumentShard(document_id).RemoveDocument(document_id);
+}
+
+void ShardedSearchServer::RemoveDocuments(const vector<int>& document_ids) {
+	RemoveDocuments(execution::par, document_ids);
+}
+
+void ShardedSearchServer::UpdateDocumentStatus(int document_id, DocumentStatus status) {
+	GetDocumentShard(document_id).UpdateDocumentStatus(document_id, status);
+}
+
+void ShardedSearchServer::UpdateDocumentRatings(int document_id, const vector<int>& ratings) {
+	GetDocumentShard(document_id).UpdateDocumentRatings(document_id, ratings);
+}
+
+void ShardedSearchServer::UpdateDocumentText(int document_id, string_view document) {
+	GetDocumentShard(document_id).UpdateDocumentText(document_id, document);
+}
+
+void ShardedSearchServer::UpdateDocument(int document_id, string_view document, DocumentStatus status,
+	const vector<int>& ratings) {
+	GetDocumentShard(document_id).UpdateDocument(document_id, document, status, ratings);
+}
+
+void ShardedSearchServer::EnablePositionalIndex() {
+	for (SearchServer& shard : shards_) {
+		shard.EnablePositionalIndex();
+	}
+}
+
+bool ShardedSearchServer::HasPositionalIndex() const {
+	return shards_.front().HasPositionalIndex();
+}
+
+int ShardedSearchServer::GetDocumentCount() const {
+	return accumulate(shards_.begin(), shards_.end(), 0, [](int count, const SearchServer& shard) {
+		return count + shard.GetDocumentCount();
+		});
+}
+
+size_t ShardedSearchServer::GetShardCount() const {
+	return shards_.size();
+}
+
+const SearchServer& ShardedSearchServer::GetShard(size_t index) const {
+	return shards_.at(index);
+}
+
+size_t ShardedSearchServer::GetShardIndex(int document_id) const {
+	return GetDocumentShardIndex(document_id, shards_.size());
+}
+
+size_t ShardedSearchServer::GetDefaultShardCount() {
+	return max(1u, thread::hardware_concurrency());
+}
+
+SearchServer& ShardedSearchServer::GetDocumentShard(int document_id) {
+	return shards_[GetShardIndex(document_id)];
+}
+
+const SearchServer& ShardedSearchServer::GetDocumentShard(int document_id) const {
+	return shards_[GetShardIndex(document_id)];
+}
@@ -0,0 +1,217 @@
+#pragma once
+
+#include "search_server.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <execution>
+#include <map>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+// Shard owning the document; Fibonacci hashing spreads consecutive ids evenly
+size_t GetDocumentShardIndex(int document_id, size_t shard_count);
+
+// Partitions documents across independent SearchServer shards by document id hash.
+// A query runs on all shards at once with corpus-wide IDF, and the per-shard top
+// documents are merged, so results match a single SearchServer holding every document.
+// Fuzzy matching is not offered (see SearchServer::EnableFuzzyMatching).
+// A wildcard is scored with the document count of its merged postings summed over the shards;
+// each shard still expands it against its own dictionary, so results differ only when a
+// pattern matches more than MAX_WILDCARD_EXPANSION words.
+class ShardedSearchServer {
+public:
+	template <typename StringContainer>
+	ShardedSearchServer(const StringContainer& stop_words, size_t shard_count = GetDefaultShardCount());
+
+	explicit ShardedSearchServer(const std::string& stop_words_text, size_t shard_count = GetDefaultShardCount());
+	explicit ShardedSearchServer(std::string_view stop_words_text, size_t shard_count = GetDefaultShardCount());
+
+	void AddDocument(int document_id, std::string_view document, DocumentStatus status,
+		const std::vector<int>& ratings);
+
+	template <typename DocumentPredicate>
+	std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate) const;
+	std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status) const;
+	std::vector<Document> FindTopDocuments(std::string_view raw_query) const;
+	// Every shard applies the filter to its postings, see SearchServer
+	std::vector<Document> FindTopDocuments(std::string_view raw_query, const DocumentFilter& filter) const;
+
+	// The policy selects how shards are visited; every shard is scanned sequentially
+	template <typename DocumentPredicate, typename ExecutionPolicy>
+	std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query,
+		DocumentPredicate document_predicate) const;
+	template <typename ExecutionPolicy>
+	std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, DocumentStatus status) const;
+	template <typename ExecutionPolicy>
+	std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query) const;
+	template <typename ExecutionPolicy>
+	std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query,
+		const DocumentFilter& filter) const;
+
+	std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::string_view raw_query, int document_id) const;
+	std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(
+		const std::execution::sequenced_policy& policy, std::string_view raw_query, int document_id) const;
+	std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(
+		const std::execution::parallel_policy& policy, std::string_view raw_query, int document_id) const;
+
+	const std::map<std::string_view, double>& GetWordFrequencies(int document_id) const;
+
+	void RemoveDocument(int document_id);
+	// Throws out_of_range and removes nothing if an id is unknown; the policy selects how shards are visited
+	void RemoveDocuments(const std::vector<int>& document_ids);
+	template <typename ExecutionPolicy>
+	void RemoveDocuments(const ExecutionPolicy& policy, const std::vector<int>& document_ids);
+
+	void UpdateDocumentStatus(int document_id, DocumentStatus status);
+	void UpdateDocumentRatings(int document_id, const std::vector<int>& ratings);
+	void UpdateDocumentText(int document_id, std::string_view document);
+	void UpdateDocument(int document_id, std::string_view document, DocumentStatus status,
+		const std::vector<int>& ratings);
+
+	// Phrase and NEAR queries only look inside single documents, so shards answer them alone
+	void EnablePositionalIndex();
+	bool HasPositionalIndex() const;
+
+	int GetDocumentCount() const;
+
+	size_t GetShardCount() const;
+	const SearchServer& GetShard(size_t index) const;
+	size_t GetShardIndex(int document_id) const;
+
+	static size_t GetDefaultShardCount();
+
+private:
+	// A deque never relocates its elements: string_views inside a SearchServer must stay valid
+	std::deque<SearchServer> shards_;
+
+	// Corpus-wide figures behind the IDF of one query
+	struct QueryStatistics {
+		int document_count = 0;
+		std::map<std::string_view, int> term_document_counts;
+	};
+
+	SearchServer& GetDocumentShard(int document_id);
+	const SearchServer& GetDocumentShard(int document_id) const;
+
+	// Collected once per query, so a shard scores a word without asking the other shards
+	template <typename ExecutionPolicy>
+	QueryStatistics CollectQueryStatistics(const ExecutionPolicy& policy, std::string_view raw_query) const;
+
+	// PostingFilter is either a DocumentPredicate or a DocumentFilter
+	template <typename PostingFilter, typename ExecutionPolicy>
+	std::vector<Document> FindTopDocumentsImpl(const ExecutionPolicy& policy, std::string_view raw_query,
+		const PostingFilter& posting_filter) const;
+};
+
+template <typename StringContainer>
+ShardedSearchServer::ShardedSearchServer(const StringContainer& stop_words, size_t shard_count) {
+	using namespace std::string_literals;
+	if (shard_count == 0) {
+		throw std::invalid_argument("Shard count must be positive"s);
+	}
+	for (size_t i = 0; i < shard_count; ++i) {
+		shards_.emplace_back(stop_words);
+	}
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> ShardedSearchServer::FindTopDocuments(std::string_view raw_query,
+	DocumentPredicate document_predicate) const {
+	return FindTopDocuments(std::execution::par, raw_query, document_predicate);
+}
+
+template <typename ExecutionPolicy>
+std::vector<Document> ShardedSearchServer::FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query,
+	DocumentStatus status) const {
+	return FindTopDocuments(policy, raw_query, DocumentFilter(status));
+}
+
+template <typename ExecutionPolicy>
+std::vector<Document> ShardedSearchServer::FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query) const {
+	return FindTopDocuments(policy, raw_query, DocumentStatus::ACTUAL);
+}
+
+template <typename ExecutionPolicy>
+std::vector<Document> ShardedSearchServer::FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query,
+	const DocumentFilter& filter) const {
+	return FindTopDocumentsImpl(policy, raw_query, filter);
+}
+
+template <typename DocumentPredicate, typename ExecutionPolicy>
+std::vector<Document> ShardedSearchServer::FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query,
+	DocumentPredicate document_predicate) const {
+	return FindTopDocumentsImpl(policy, raw_query, document_predicate);
+}
+
+template <typename ExecutionPolicy>
+void ShardedSearchServer::RemoveDocuments(const ExecutionPolicy& policy, const std::vector<int>& document_ids) {
+	using namespace std::string_literals;
+	std::vector<std::vector<int>> shard_document_ids(shards_.size());
+	for (const int document_id : document_ids) {
+		if (GetDocumentShard(document_id).documents_.count(document_id) == 0) {
+			throw std::out_of_range("Invalid document_id"s);
+		}
+		shard_document_ids[GetShardIndex(document_id)].push_back(document_id);
+	}
+	std::vector<size_t> shard_indexes(shards_.size());
+	std::iota(shard_indexes.begin(), shard_indexes.end(), 0);
+	std::for_each(policy, shard_indexes.begin(), shard_indexes.end(), [&](size_t index) {
+		if (!shard_document_ids[index].empty()) {
+			shards_[index].RemoveDocuments(shard_document_ids[index]);
+		}
+		});
+}
+
+template <typename ExecutionPolicy>
+ShardedSearchServer::QueryStatistics ShardedSearchServer::CollectQueryStatistics(const ExecutionPolicy& policy,
+	std::string_view raw_query) const {
+
+	std::vector<std::map<std::string_view, int>> shard_counts(shards_.size());
+	std::transform(policy, shards_.begin(), shards_.end(), shard_counts.begin(), [raw_query](const SearchServer& shard) {
+		return shard.GetQueryTermDocumentCounts(raw_query);
+		});
+
+	QueryStatistics statistics;
+	statistics.document_count = GetDocumentCount();
+	for (const auto& counts : shard_counts) {
+		for (const auto& [term, count] : counts) {
+			statistics.term_document_counts[term] += count;
+		}
+	}
+	return statistics;
+}
+
+template <typename PostingFilter, typename ExecutionPolicy>
+std::vector<Document> ShardedSearchServer::FindTopDocumentsImpl(const ExecutionPolicy& policy, std::string_view raw_query,
+	const PostingFilter& posting_filter) const {
+
+	const QueryStatistics statistics = CollectQueryStatistics(policy, raw_query);
+	// Called only for terms indexed by the calling shard, so the corpus-wide count is positive
+	const auto inverse_document_freq = [&statistics](std::string_view term) {
+		return std::log(statistics.document_count * 1.0 / statistics.term_document_counts.at(term));
+	};
+
+	std::vector<std::vector<Document>> shard_results(shards_.size());
+	std::transform(policy, shards_.begin(), shards_.end(), shard_results.begin(), [&](const SearchServer& shard) {
+		return shard.FindTopDocuments(std::execution::seq, raw_query, posting_filter, inverse_document_freq);
+		});
+
+	// Every shard already returns its own top, so the global top is among them
+	std::vector<Document> result;
+	for (const auto& documents : shard_results) {
+		result.insert(result.end(), documents.begin(), documents.end());
+	}
+	std::sort(result.begin(), result.end(), IsMoreRelevant);
+	if (result.size() > MAX_RESULT_DOCUMENT_COUNT) {
+		result.resize(MAX_RESULT_DOCUMENT_COUNT);
+	}
+	return result;
+}
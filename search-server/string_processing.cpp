@@ -1,41 +1,109 @@
 #include "string_processing.h"
 
 #include <algorithm>
+#include <numeric>
 
 using namespace std;
 
-vector<string_view> SplitIntoWords(string_view text) {
-    /*vector<string_view> words;
-    string word;
-    for (const char c : text) {
-        if (c == ' ') {
-            if (!word.empty()) {
-                words.push_back(word);
-                word.clear();
-            }
-        }
-        else {
-            word += c;
-        }
-    }
-    if (!word.empty()) {
-        words.push_back(word);
-    }
-
-    return words;*/
-    
-    
-    // According to https://www.cppstories.com/2018/07/string-view-perf-followup/    
+namespace {
 
+// According to https://www.cppstories.com/2018/07/string-view-perf-followup/
+template <typename Words>
+void AppendWords(string_view text, Words& words) {
     std::string_view delims = " ";
-    std::vector<std::string_view> words;
-
     for (auto first = text.data(), second = text.data(), last = first + text.size(); second != last && first != last; first = second + 1) {
         second = std::find_first_of(first, last, std::cbegin(delims), std::cend(delims));
         if (first != second)
             words.emplace_back(first, second - first);
     }
+}
+
+} // namespace
+
+vector<string_view> SplitIntoWords(string_view text) {
+    vector<string_view> words;
+    AppendWords(text, words);
+    return words;
+}
 
+pmr::vector<string_view> SplitIntoWords(string_view text, pmr::memory_resource* resource) {
+    pmr::vector<string_view> words(resource);
+    AppendWords(text, words);
     return words;
+}
 
-}
\ No newline at end of file
+bool MatchesWildcard(string_view pattern, string_view word) {
+    // Greedy matching with backtracking to the last star: O(|pattern| * |word|) at worst
+    size_t p = 0;
+    size_t w = 0;
+    size_t star = string_view::npos;
+    size_t star_word = 0;
+    while (w < word.size()) {
+        if (p < pattern.size() && pattern[p] == '*') {
+            star = p++;
+            star_word = w;
+        } else if (p < pattern.size() && pattern[p] == word[w]) {
+            ++p;
+            ++w;
+        } else if (star != string_view::npos) {
+            p = star + 1;
+            w = ++star_word;
+        } else {
+            return false;
+        }
+    }
+    while (p < pattern.size() && pattern[p] == '*') {
+        ++p;
+    }
+    return p == pattern.size();
+}
+
+vector<string> GenerateDeletions(string_view word, int max_deletions) {
+    vector<string> deletions{ string(word) };
+    size_t level_begin = 0;
+    for (int deleted = 0; deleted < max_deletions; ++deleted) {
+        const size_t level_end = deletions.size();
+        for (size_t i = level_begin; i < level_end; ++i) {
+            for (size_t position = 0; position < deletions[i].size(); ++position) {
+                string deletion = deletions[i];
+                deletion.erase(position, 1);
+                deletions.push_back(move(deletion));
+            }
+        }
+        // Different positions often give the same string ("aab" -> "ab" twice)
+        sort(deletions.begin() + level_end, deletions.end());
+        deletions.erase(unique(deletions.begin() + level_end, deletions.end()), deletions.end());
+        level_begin = level_end;
+    }
+    return deletions;
+}
+
+int ComputeEditDistance(string_view lhs, string_view rhs, int max_distance) {
+    const int length_difference = static_cast<int>(lhs.size()) - static_cast<int>(rhs.size());
+    if (abs(length_difference) > max_distance) {
+        return max_distance + 1;
+    }
+    // Three rolling rows of the dynamic programming table: i - 2, i - 1 and i
+    vector<int> before_previous(rhs.size() + 1);
+    vector<int> previous(rhs.size() + 1);
+    vector<int> current(rhs.size() + 1);
+    iota(previous.begin(), previous.end(), 0);
+    for (size_t i = 1; i <= lhs.size(); ++i) {
+        current[0] = static_cast<int>(i);
+        int row_minimum = current[0];
+        for (size_t j = 1; j <= rhs.size(); ++j) {
+            const int substitution_cost = lhs[i - 1] == rhs[j - 1] ? 0 : 1;
+            current[j] = min({ previous[j] + 1, current[j - 1] + 1, previous[j - 1] + substitution_cost });
+            if (i > 1 && j > 1 && lhs[i - 1] == rhs[j - 2] && lhs[i - 2] == rhs[j - 1]) {
+                current[j] = min(current[j], before_previous[j - 2] + 1);
+            }
+            row_minimum = min(row_minimum, current[j]);
+        }
+        if (row_minimum > max_distance) {
+            return max_distance + 1;
+        }
+        swap(before_previous, previous);
+        swap(previous, current);
+    }
+    return min(previous[rhs.size()], max_distance + 1);
+}
@@ -1,12 +1,24 @@
 #pragma once
 
 #include <vector>
+#include <memory_resource>
 #include <string>
 #include <string_view>
 #include <set>
 #include <cmath>
 
 std::vector<std::string_view> SplitIntoWords(std::string_view text);
+std::pmr::vector<std::string_view> SplitIntoWords(std::string_view text, std::pmr::memory_resource* resource);
+
+// Glob match where '*' stands for any (possibly empty) sequence of characters
+bool MatchesWildcard(std::string_view pattern, std::string_view word);
+
+// Distinct strings obtained from word by deleting at most max_deletions characters, word included
+std::vector<std::string> GenerateDeletions(std::string_view word, int max_deletions);
+
+// Optimal string alignment distance: Levenshtein plus transposition of adjacent characters.
+// Stops early and returns max_distance + 1 once the distance is known to exceed max_distance.
+int ComputeEditDistance(std::string_view lhs, std::string_view rhs, int max_distance);
 
 template <typename StringContainer>
 std::set<std::string, std::less<>> MakeUniqueNonEmptyStrings(const StringContainer& strings) {
@@ -0,0 +1,106 @@
+#include "synthetic_data.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+string GenerateWord(mt19937& generator, int max_length) {
+    const int length = 1 + static_cast<int>(generator() % max_length);
+    string word;
+    word.reserve(length);
+    for (int i = 0; i < length; ++i) {
+        word.push_back(static_cast<char>('a' + generator() % 26));
+    }
+    return word;
+}
+
+vector<string> GenerateDictionary(mt19937& generator, int word_count, int max_length) {
+    vector<string> words;
+    words.reserve(word_count);
+    for (int i = 0; i < word_count; ++i) {
+        words.push_back(GenerateWord(generator, max_length));
+    }
+    sort(words.begin(), words.end());
+    words.erase(unique(words.begin(), words.end()), words.end());
+    return words;
+}
+
+string GenerateQuery(mt19937& generator, const vector<string>& dictionary, int word_count, double minus_prob) {
+    string query;
+    for (int i = 0; i < word_count; ++i) {
+        if (!query.empty()) {
+            query.push_back(' ');
+        }
+        if (GenerateUnitDouble(generator) < minus_prob) {
+            query.push_back('-');
+        }
+        query += dictionary[generator() % dictionary.size()];
+    }
+    return query;
+}
+
+vector<string> GenerateQueries(mt19937& generator, const vector<string>& dictionary, int query_count, int max_word_count) {
+    vector<string> queries;
+    queries.reserve(query_count);
+    for (int i = 0; i < query_count; ++i) {
+        queries.push_back(GenerateQuery(generator, dictionary, max_word_count));
+    }
+    return queries;
+}
+
+ZipfDistribution::ZipfDistribution(size_t n, double exponent) : cdf_(max<size_t>(n, 1)) {
+    double sum = 0;
+    for (size_t rank = 0; rank < cdf_.size(); ++rank) {
+        sum += 1.0 / pow(static_cast<double>(rank + 1), exponent);
+        cdf_[rank] = sum;
+    }
+    for (double& value : cdf_) {
+        value /= sum;
+    }
+}
+
+size_t ZipfDistribution::operator()(mt19937& generator) const {
+    const double u = GenerateUnitDouble(generator);
+    const auto it = upper_bound(cdf_.begin(), cdf_.end(), u);
+    return min<size_t>(it - cdf_.begin(), cdf_.size() - 1);
+}
+
+double GenerateUnitDouble(mt19937& generator) {
+    return generator() / 4294967296.0;
+}
+
+string GenerateZipfText(mt19937& generator, const vector<string>& dictionary,
+    const ZipfDistribution& distribution, int word_count, double minus_prob) {
+    string text;
+    for (int i = 0; i < word_count; ++i) {
+        if (!text.empty()) {
+            text.push_back(' ');
+        }
+        if (minus_prob > 0 && GenerateUnitDouble(generator) < minus_prob) {
+            text.push_back('-');
+        }
+        text += dictionary[distribution(generator) % dictionary.size()];
+    }
+    return text;
+}
+
+vector<string> GenerateZipfCorpus(mt19937& generator, const vector<string>& dictionary,
+    const ZipfDistribution& distribution, int document_count, int max_word_count) {
+    vector<string> documents;
+    documents.reserve(document_count);
+    for (int i = 0; i < document_count; ++i) {
+        const int word_count = 1 + static_cast<int>(generator() % max_word_count);
+        documents.push_back(GenerateZipfText(generator, dictionary, distribution, word_count));
+    }
+    return documents;
+}
+
+vector<int> GenerateRatings(mt19937& generator, int max_count) {
+    const int count = 1 + static_cast<int>(generator() % max_count);
+    vector<int> ratings(count);
+    for (int& rating : ratings) {
+        rating = static_cast<int>(generator() % 201) - 100;
+    }
+    return ratings;
+}
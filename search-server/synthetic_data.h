@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+// All generators below consume only raw mt19937 output, see ZipfDistribution
+std::string GenerateWord(std::mt19937& generator, int max_length);
+
+std::vector<std::string> GenerateDictionary(std::mt19937& generator, int word_count, int max_length);
+
+std::string GenerateQuery(std::mt19937& generator, const std::vector<std::string>& dictionary, int word_count, double minus_prob = 0);
+
+std::vector<std::string> GenerateQueries(std::mt19937& generator, const std::vector<std::string>& dictionary, int query_count, int max_word_count);
+
+// Samples ranks 0..n-1 with P(rank) ~ 1 / (rank + 1)^exponent.
+// Only raw mt19937 output is consumed, so a given seed yields the same sequence
+// with every standard library (std::*_distribution results are implementation-defined).
+class ZipfDistribution {
+public:
+    ZipfDistribution(size_t n, double exponent);
+
+    size_t operator()(std::mt19937& generator) const;
+
+private:
+    std::vector<double> cdf_;
+};
+
+// Uniform double in [0, 1) built from a single mt19937 draw
+double GenerateUnitDouble(std::mt19937& generator);
+
+// Zipf-distributed text: dictionary[0] is the most popular word
+std::string GenerateZipfText(std::mt19937& generator, const std::vector<std::string>& dictionary,
+    const ZipfDistribution& distribution, int word_count, double minus_prob = 0);
+
+std::vector<std::string> GenerateZipfCorpus(std::mt19937& generator, const std::vector<std::string>& dictionary,
+    const ZipfDistribution& distribution, int document_count, int max_word_count);
+
+std::vector<int> GenerateRatings(std::mt19937& generator, int max_count);
@@ -0,0 +1,48 @@
+#include "test_example_functions.h"
+
+#include "search_server.h"
+
+#include <cmath>
+#include <cstdlib>
+
+using namespace std;
+
+void AssertImpl(bool value, const string& expr_str, const string& file, const string& func, unsigned line,
+    const string& hint) {
+    if (value) {
+        return;
+    }
+    cerr << file << "("s << line << "): "s << func << ": ASSERT("s << expr_str << ") failed."s;
+    if (!hint.empty()) {
+        cerr << " Hint: "s << hint;
+    }
+    cerr << endl;
+    abort();
+}
+
+void AssertDocumentsEqualImpl(const vector<Document>& expected, const vector<Document>& actual,
+    const string& file, const string& func, unsigned line, const string& hint) {
+    const auto fail = [&](size_t index) {
+        cerr << file << "("s << line << "): "s << func << ": documents differ at position "s << index
+            << " of "s << expected.size() << " expected and "s << actual.size() << " actual."s;
+        if (index < expected.size() && index < actual.size()) {
+            cerr << " Expected { "s << expected[index].id << ", "s << expected[index].relevance << ", "s
+                << expected[index].rating << " }, actual { "s << actual[index].id << ", "s
+                << actual[index].relevance << ", "s << actual[index].rating << " }."s;
+        }
+        if (!hint.empty()) {
+            cerr << " Hint: "s << hint;
+        }
+        cerr << endl;
+        abort();
+    };
+    for (size_t i = 0; i < min(expected.size(), actual.size()); ++i) {
+        if (expected[i].id != actual[i].id || expected[i].rating != actual[i].rating
+            || abs(expected[i].relevance - actual[i].relevance) >= TOLERANCE) {
+            fail(i);
+        }
+    }
+    if (expected.size() != actual.size()) {
+        fail(min(expected.size(), actual.size()));
+    }
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "document.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Assertions of search_server_tests: a failed check prints where and why, then aborts the test
+
+void AssertImpl(bool value, const std::string& expr_str, const std::string& file, const std::string& func,
+    unsigned line, const std::string& hint);
+
+template <typename T, typename U>
+void AssertEqualImpl(const T& t, const U& u, const std::string& t_str, const std::string& u_str,
+    const std::string& file, const std::string& func, unsigned line, const std::string& hint) {
+    if (t != u) {
+        std::cerr << file << "(" << line << "): " << func << ": ASSERT_EQUAL(" << t_str << ", " << u_str
+            << ") failed: " << t << " != " << u << ".";
+        if (!hint.empty()) {
+            std::cerr << " Hint: " << hint;
+        }
+        std::cerr << std::endl;
+        std::abort();
+    }
+}
+
+// Same ids and ratings in the same order, relevance equal up to TOLERANCE
+void AssertDocumentsEqualImpl(const std::vector<Document>& expected, const std::vector<Document>& actual,
+    const std::string& file, const std::string& func, unsigned line, const std::string& hint);
+
+#define ASSERT(expr) AssertImpl(!!(expr), #expr, __FILE__, __FUNCTION__, __LINE__, std::string())
+#define ASSERT_HINT(expr, hint) AssertImpl(!!(expr), #expr, __FILE__, __FUNCTION__, __LINE__, (hint))
+#define ASSERT_EQUAL(a, b) AssertEqualImpl((a), (b), #a, #b, __FILE__, __FUNCTION__, __LINE__, std::string())
+#define ASSERT_EQUAL_HINT(a, b, hint) AssertEqualImpl((a), (b), #a, #b, __FILE__, __FUNCTION__, __LINE__, (hint))
+#define ASSERT_DOCUMENTS_EQUAL_HINT(expected, actual, hint) \
+    AssertDocumentsEqualImpl((expected), (actual), __FILE__, __FUNCTION__, __LINE__, (hint))
+
+template <typename TestFunc>
+void RunTestImpl(const TestFunc& func, const std::string& test_name) {
+    func();
+    std::cerr << test_name << " OK" << std::endl;
+}
+
+#define RUN_TEST(func) RunTestImpl((func), #func)